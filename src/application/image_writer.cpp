@@ -0,0 +1,202 @@
+/**
+ * @file image_writer.cpp
+ * @brief Writes images to disk on a background thread.
+ */
+
+#include "application/image_writer.hpp"
+#include "application/imageio.hpp"
+
+#include <cassert>
+#include <iostream>
+
+namespace _462 {
+
+#define IMAGE_SIZE(w,h) ( (size_t) ( 4 * (w) * (h) ) )
+
+ImageWriter::ImageWriter()
+    : thread( 0 ), mutex( 0 ), cond( 0 ), max_buffers( 0 ),
+      compression_level( -1 ), num_writing( 0 ), failed( false ), stopping( false ) { }
+
+ImageWriter::~ImageWriter()
+{
+    if ( thread ) {
+        SDL_LockMutex( mutex );
+        stopping = true;
+        SDL_CondBroadcast( cond );
+        SDL_UnlockMutex( mutex );
+        // the thread drains the queue before exiting
+        SDL_WaitThread( thread, 0 );
+    }
+
+    if ( cond )
+        SDL_DestroyCond( cond );
+    if ( mutex )
+        SDL_DestroyMutex( mutex );
+
+    for ( BufferList::iterator i = buffers.begin(); i != buffers.end(); ++i ) {
+        free( i->data );
+    }
+}
+
+bool ImageWriter::initialize( size_t num_buffers, int compression_level )
+{
+    assert( num_buffers > 0 && !mutex );
+
+    this->max_buffers = num_buffers;
+    this->compression_level = compression_level;
+
+    mutex = SDL_CreateMutex();
+    cond = SDL_CreateCond();
+    if ( !mutex || !cond )
+        return false;
+
+    buffers.reserve( num_buffers );
+    free_buffers.reserve( num_buffers );
+
+    thread = SDL_CreateThread( run_thread, this );
+    if ( !thread ) {
+        std::cout << "Unable to start image writer thread, images will be saved synchronously.\n";
+    }
+
+    return true;
+}
+
+unsigned char* ImageWriter::acquire_buffer( int width, int height )
+{
+    size_t size = IMAGE_SIZE( width, height );
+    unsigned char* rv = 0;
+
+    SDL_LockMutex( mutex );
+
+    // allocate lazily, so a single image never pays for the whole pool
+    while ( free_buffers.empty() && buffers.size() == max_buffers ) {
+        SDL_CondWait( cond, mutex );
+    }
+
+    if ( !free_buffers.empty() ) {
+        rv = free_buffers.back();
+        free_buffers.pop_back();
+    }
+
+    SDL_UnlockMutex( mutex );
+
+    // only this thread touches the buffer list, so it can be changed unlocked
+    Buffer* buf = 0;
+    for ( size_t i = 0; i < buffers.size(); ++i ) {
+        if ( buffers[i].data == rv ) {
+            buf = &buffers[i];
+            break;
+        }
+    }
+
+    if ( !buf ) {
+        Buffer b;
+        b.data = 0;
+        b.size = 0;
+        buffers.push_back( b );
+        buf = &buffers.back();
+    }
+
+    if ( buf->size < size ) {
+        unsigned char* data = (unsigned char*) realloc( buf->data, size );
+        if ( !data ) {
+            SDL_LockMutex( mutex );
+            if ( buf->data )
+                free_buffers.push_back( buf->data );
+            else
+                buffers.pop_back();
+            SDL_UnlockMutex( mutex );
+            return 0;
+        }
+        buf->data = data;
+        buf->size = size;
+    }
+
+    return buf->data;
+}
+
+void ImageWriter::submit( const char* filename, unsigned char* buffer, int width, int height )
+{
+    Job job;
+    job.filename = filename;
+    job.buffer = buffer;
+    job.width = width;
+    job.height = height;
+
+    if ( !thread ) {
+        write_job( job );
+        return;
+    }
+
+    SDL_LockMutex( mutex );
+    jobs.push_back( job );
+    SDL_CondBroadcast( cond );
+    SDL_UnlockMutex( mutex );
+}
+
+void ImageWriter::release_buffer( unsigned char* buffer )
+{
+    SDL_LockMutex( mutex );
+    free_buffers.push_back( buffer );
+    SDL_CondBroadcast( cond );
+    SDL_UnlockMutex( mutex );
+}
+
+bool ImageWriter::finish()
+{
+    SDL_LockMutex( mutex );
+    while ( !jobs.empty() || num_writing > 0 ) {
+        SDL_CondWait( cond, mutex );
+    }
+    bool rv = !failed;
+    failed = false;
+    SDL_UnlockMutex( mutex );
+    return rv;
+}
+
+int ImageWriter::run_thread( void* data )
+{
+    ImageWriter* writer = (ImageWriter*) data;
+
+    SDL_LockMutex( writer->mutex );
+    while ( true ) {
+        while ( writer->jobs.empty() && !writer->stopping ) {
+            SDL_CondWait( writer->cond, writer->mutex );
+        }
+        if ( writer->jobs.empty() )
+            break;
+
+        Job job = writer->jobs.front();
+        writer->jobs.pop_front();
+        writer->num_writing++;
+
+        SDL_UnlockMutex( writer->mutex );
+        writer->write_job( job );
+        SDL_LockMutex( writer->mutex );
+
+        writer->num_writing--;
+        SDL_CondBroadcast( writer->cond );
+    }
+    SDL_UnlockMutex( writer->mutex );
+
+    return 0;
+}
+
+void ImageWriter::write_job( const Job& job )
+{
+    const char* filename = job.filename.c_str();
+    bool result = imageio_save_image( filename, job.buffer, job.width, job.height, compression_level );
+
+    SDL_LockMutex( mutex );
+    if ( result ) {
+        std::cout << "Saved raytraced image to '" << filename << "'.\n";
+    } else {
+        std::cout << "Error saving raytraced image to '" << filename << "'.\n";
+        failed = true;
+    }
+    free_buffers.push_back( job.buffer );
+    SDL_CondBroadcast( cond );
+    SDL_UnlockMutex( mutex );
+}
+
+} /* _462 */
@@ -0,0 +1,122 @@
+/**
+ * @file image_writer.hpp
+ * @brief Writes images to disk on a background thread.
+ */
+
+#ifndef _462_APPLICATION_IMAGE_WRITER_HPP_
+#define _462_APPLICATION_IMAGE_WRITER_HPP_
+
+#include <SDL/SDL_thread.h>
+
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Compresses and saves RGBA images on a background thread, so the caller
+ * can render the next image while the last one is being written.
+ *
+ * The writer owns a small pool of image buffers. The caller acquires a
+ * buffer, fills it, and submits it with a filename; the buffer goes back to
+ * the pool once it has been written. Since every queued image holds one
+ * buffer, the pool size bounds the queue: acquire_buffer() blocks while all
+ * buffers are waiting to be written. With two buffers this is plain double
+ * buffering.
+ *
+ * If the thread cannot be started, images are written synchronously by
+ * submit() instead.
+ */
+class ImageWriter
+{
+public:
+
+    ImageWriter();
+
+    /// Waits for all submitted images to be written and frees the pool.
+    ~ImageWriter();
+
+    /**
+     * Starts the writer thread. Must be called before any other function.
+     * @param num_buffers The number of buffers in the pool, at least 1.
+     * @param compression_level The zlib level to save with, from 0 to 9, or
+     *  negative for the default.
+     * @return false if out of memory.
+     */
+    bool initialize( size_t num_buffers, int compression_level );
+
+    /**
+     * Returns a buffer with room for a width x height RGBA image, waiting
+     * for one to be written if none are free. The contents are undefined.
+     * Returns null if out of memory.
+     */
+    unsigned char* acquire_buffer( int width, int height );
+
+    /**
+     * Queues a buffer from acquire_buffer() to be written to the given file.
+     * The caller must not touch the buffer afterwards.
+     */
+    void submit( const char* filename, unsigned char* buffer, int width, int height );
+
+    /// Returns a buffer from acquire_buffer() to the pool without writing it.
+    void release_buffer( unsigned char* buffer );
+
+    /**
+     * Waits for every submitted image to be written.
+     * @return false if any image failed to save since the last call.
+     */
+    bool finish();
+
+private:
+
+    struct Buffer
+    {
+        unsigned char* data;
+        size_t size;
+    };
+
+    struct Job
+    {
+        std::string filename;
+        unsigned char* buffer;
+        int width, height;
+    };
+
+    typedef std::vector< Buffer > BufferList;
+    typedef std::vector< unsigned char* > FreeList;
+    typedef std::deque< Job > JobQueue;
+
+    static int run_thread( void* data );
+
+    // writes a single image and returns its buffer to the pool. called
+    // without the lock held.
+    void write_job( const Job& job );
+
+    SDL_Thread* thread;
+    // guards everything below
+    SDL_mutex* mutex;
+    // signalled whenever a job is queued or finished
+    SDL_cond* cond;
+
+    BufferList buffers;
+    FreeList free_buffers;
+    JobQueue jobs;
+    size_t max_buffers;
+    int compression_level;
+    // number of jobs taken off the queue but not yet written
+    size_t num_writing;
+    // true if any write failed since the last finish()
+    bool failed;
+    // true when the thread should exit once the queue is empty
+    bool stopping;
+
+    // no meaningful assignment or copy
+    ImageWriter( const ImageWriter& );
+    ImageWriter& operator=( const ImageWriter& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_IMAGE_WRITER_HPP_ */
@@ -31,6 +31,7 @@
 #include <iostream>
 #include <png.h>
 #include <cassert>
+#include <algorithm>
 
 namespace _462 {
 
@@ -148,7 +149,7 @@ static unsigned char* _load_image_RGBA_png(const char *fileName, int *width, int
 }
 
 static bool _save_image_RGBA_png(const char *fileName, unsigned char *buffer,
-  int width, int height)
+  int width, int height, int compressionLevel)
 {
     // open the file
     FILE *fp = fopen(fileName, "wb");
@@ -178,6 +179,8 @@ static bool _save_image_RGBA_png(const char *fileName, unsigned char *buffer,
 
     // set up the io
     png_init_io(png_ptr, fp);
+    if (compressionLevel >= 0)
+        png_set_compression_level(png_ptr, compressionLevel);
 
     // write the header
     png_set_IHDR(png_ptr, info_ptr, width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
@@ -198,6 +201,71 @@ static bool _save_image_RGBA_png(const char *fileName, unsigned char *buffer,
     return true;
 }
 
+// ***** pfm related internal functions ***** //
+
+static float* _load_image_RGB_pfm(const char *fileName, int *width, int *height)
+{
+    *width = *height = -1;
+    FILE *fp = fopen(fileName, "rb");
+    if (!fp)
+        return 0;
+
+    // only color images are read. a single whitespace character separates
+    // the scale from the samples.
+    char type[3] = { 0 };
+    int w = -1, h = -1;
+    float scale = 0;
+    if (fscanf(fp, "%2s %d %d %f", type, &w, &h, &scale) != 4 ||
+      strcmp(type, "PF") || w < 1 || h < 1 || scale == 0 || fgetc(fp) == EOF) {
+        fclose(fp);
+        return 0;
+    }
+
+    size_t count = 3 * (size_t) w * (size_t) h;
+    float *buffer = (float *) malloc(count * sizeof(float));
+    if (!buffer || fread(buffer, sizeof(float), count, fp) != count) {
+        free(buffer);
+        fclose(fp);
+        return 0;
+    }
+    fclose(fp);
+
+    // a negative scale means little endian samples
+    const unsigned int one = 1;
+    bool littleEndian = *(const unsigned char *) &one == 1;
+    if ((scale < 0) != littleEndian) {
+        for (size_t i = 0; i < count; i++) {
+            unsigned char *bytes = (unsigned char *) &buffer[i];
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+
+    *width = w;
+    *height = h;
+    return buffer;
+}
+
+static bool _save_image_RGB_pfm(const char *fileName, const float *buffer,
+  int width, int height)
+{
+    FILE *fp = fopen(fileName, "wb");
+    if (!fp)
+        return false;
+
+    // the sign of the scale gives the byte order of the samples, which are
+    // written as-is in host order
+    const unsigned int one = 1;
+    bool littleEndian = *(const unsigned char *) &one == 1;
+    fprintf(fp, "PF\n%d %d\n%s\n", width, height, littleEndian ? "-1.0" : "1.0");
+
+    // pfm rows go bottom to top, as do ours, so write the buffer in one go
+    size_t count = 3 * (size_t) width * (size_t) height;
+    bool result = fwrite(buffer, sizeof(float), count, fp) == count;
+
+    return fclose(fp) == 0 && result;
+}
+
 // ***** external functions ***** //
 
 // Sets the width and height to the appropriate values and mallocs
@@ -215,16 +283,47 @@ unsigned char* imageio_load_image( const char *fileName, int *width, int *height
 
 // Saves image given by buffer with specicified width and height
 // to the given file name, returns true on success, false otherwise.
-// The image format is RGBA.
+// The image format is RGBA. compressionLevel is a zlib level from 0 (none)
+// to 9 (smallest), or negative for the zlib default.
 bool imageio_save_image( const char *fileName, unsigned char *buffer,
-                         int width, int height )
+                         int width, int height, int compressionLevel )
 {
     if (_ends_with(fileName, ".png"))
-        return _save_image_RGBA_png(fileName, buffer, width, height);
+        return _save_image_RGBA_png(fileName, buffer, width, height,
+          compressionLevel);
+    else
+        return false;
+}
+
+// Loads a floating point RGB image saved by imageio_save_hdr_image, as
+// malloced floats, 3 per pixel with rows bottom to top. On error, returns 0
+// and sets width = height = -1.
+float* imageio_load_hdr_image( const char *fileName, int *width, int *height )
+{
+    if (_ends_with(fileName, ".pfm"))
+        return _load_image_RGB_pfm(fileName, width, height);
+    *width = *height = -1;
+    return 0;
+}
+
+// Saves a floating point RGB image, 3 floats per pixel with rows bottom
+// to top, to the given file name as an uncompressed pfm. Returns true on
+// success, false otherwise.
+bool imageio_save_hdr_image( const char *fileName, const float *buffer,
+                             int width, int height )
+{
+    if (_ends_with(fileName, ".pfm"))
+        return _save_image_RGB_pfm(fileName, buffer, width, height);
     else
         return false;
 }
 
+// Returns true iff the given file name is for a floating point image.
+bool imageio_is_hdr_name( const char *fileName )
+{
+    return _ends_with(fileName, ".pfm");
+}
+
 // Wraps the general functionality of saving an image and writes the current
 // frame buffer to a specified file name.  Also returns true on succces,
 // false otherwise.
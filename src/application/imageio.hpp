@@ -40,8 +40,25 @@ unsigned char* imageio_load_image( const char* filename, int *width, int *height
 
 // Saves image given by buffer with specicified width and height
 // to the given file name, returns true on success, false otherwise.
-// The image format is RGBA.
-bool imageio_save_image( const char* filename, unsigned char* buffer, int width, int height );
+// The image format is RGBA. compression_level is a zlib level from 0 (none)
+// to 9 (smallest), or negative for the zlib default.
+bool imageio_save_image( const char* filename, unsigned char* buffer, int width, int height,
+                         int compression_level = -1 );
+
+// Loads a floating point RGB image saved by imageio_save_hdr_image, with
+// 3 floats per pixel and rows bottom to top, in a buffer to be freed with
+// free(). If there was an error reading the file, 0 is returned and width =
+// height are set to -1.
+float* imageio_load_hdr_image( const char* filename, int *width, int *height );
+
+// Saves a floating point RGB image, 3 floats per pixel with rows bottom
+// to top, to the given file name. Only .pfm files are supported, which are
+// written uncompressed. Returns true on success, false otherwise.
+bool imageio_save_hdr_image( const char* filename, const float* buffer, int width, int height );
+
+// Returns true if the given file name should be saved with
+// imageio_save_hdr_image rather than imageio_save_image.
+bool imageio_is_hdr_name( const char* filename );
 
 // Writes the current opengl frame buffer to a specified file name.
 // Returns true on succces, false otherwise.
@@ -0,0 +1,184 @@
+/**
+ * @file parallel.cpp
+ * @brief Splits loops across threads.
+ */
+
+#include "application/parallel.hpp"
+
+#include <SDL/SDL_thread.h>
+#include <SDL/SDL_mutex.h>
+#include <algorithm>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace _462 {
+
+// the shared state of one parallel_for
+struct ParallelJob
+{
+    // the first index not yet handed out
+    size_t next;
+    size_t count;
+    size_t grain;
+    void ( *body )( void*, size_t, size_t );
+    void* data;
+};
+
+// threads kept waiting for jobs, so that a parallel_for costs a wakeup
+// rather than starting and joining threads. started by the first
+// parallel_for, and live for the rest of the program.
+struct ThreadPool
+{
+    // guards everything below, and the next index of the job
+    SDL_mutex* mutex;
+    // signalled when a job is posted, and when the last thread leaves it
+    SDL_cond* job_posted;
+    SDL_cond* job_left;
+    std::vector< SDL_Thread* > threads;
+    // the job being run, or null
+    ParallelJob* job;
+    // counts jobs posted, so each thread joins each job at most once
+    unsigned int num_posted;
+    // threads inside the job
+    size_t num_working;
+    // whether a parallel_for is running, in which case others run alone
+    bool busy;
+};
+
+static ThreadPool pool;
+
+// runs chunks until none are left
+static void run_job( ParallelJob* job )
+{
+    while ( true ) {
+        SDL_LockMutex( pool.mutex );
+        size_t begin = job->next;
+        job->next = std::min( job->count, begin + job->grain );
+        SDL_UnlockMutex( pool.mutex );
+
+        if ( begin >= job->count )
+            return;
+        job->body( job->data, begin, std::min( job->count, begin + job->grain ) );
+    }
+}
+
+// joins each job posted to the pool
+static int run_thread( void* )
+{
+    unsigned int num_joined = 0;
+
+    SDL_LockMutex( pool.mutex );
+    while ( true ) {
+        while ( pool.num_posted == num_joined ) {
+            SDL_CondWait( pool.job_posted, pool.mutex );
+        }
+        num_joined = pool.num_posted;
+
+        // the job may be over already, if the others finished it first
+        ParallelJob* job = pool.job;
+        if ( !job )
+            continue;
+
+        ++pool.num_working;
+        SDL_UnlockMutex( pool.mutex );
+        run_job( job );
+        SDL_LockMutex( pool.mutex );
+        if ( --pool.num_working == 0 ) {
+            SDL_CondSignal( pool.job_left );
+        }
+    }
+    return 0;
+}
+
+// starts the pool's threads, the calling thread being the last. returns
+// false if there are none.
+static bool start_pool()
+{
+    static bool started = false;
+
+    if ( !started ) {
+        started = true;
+        pool.mutex = SDL_CreateMutex();
+        pool.job_posted = SDL_CreateCond();
+        pool.job_left = SDL_CreateCond();
+        pool.job = 0;
+        pool.num_posted = 0;
+        pool.num_working = 0;
+        pool.busy = false;
+        if ( pool.mutex && pool.job_posted && pool.job_left ) {
+            for ( size_t i = 1; i < parallel_num_threads(); ++i ) {
+                SDL_Thread* thread = SDL_CreateThread( run_thread, 0 );
+                if ( thread )
+                    pool.threads.push_back( thread );
+            }
+        }
+    }
+    return !pool.threads.empty();
+}
+
+size_t parallel_num_threads()
+{
+    static size_t num_threads = 0;
+
+    if ( num_threads == 0 ) {
+        long count = 1;
+#if defined( _SC_NPROCESSORS_ONLN )
+        count = sysconf( _SC_NPROCESSORS_ONLN );
+#endif
+        num_threads = count > 0 ? size_t( count ) : 1;
+    }
+    return num_threads;
+}
+
+void parallel_for_chunks( size_t count, size_t grain,
+                          void ( *body )( void*, size_t, size_t ), void* data )
+{
+    if ( count == 0 )
+        return;
+    grain = std::max( grain, size_t( 1 ) );
+
+    size_t num_chunks = ( count + grain - 1 ) / grain;
+
+    if ( num_chunks == 1 || parallel_num_threads() == 1 || !start_pool() ) {
+        body( data, 0, count );
+        return;
+    }
+
+    ParallelJob job;
+    job.next = 0;
+    job.count = count;
+    job.grain = grain;
+    job.body = body;
+    job.data = data;
+
+    // a parallel_for from inside another, or from a second thread, runs
+    // on its own thread rather than waiting for the pool
+    SDL_LockMutex( pool.mutex );
+    if ( pool.busy ) {
+        SDL_UnlockMutex( pool.mutex );
+        body( data, 0, count );
+        return;
+    }
+    pool.busy = true;
+    pool.job = &job;
+    ++pool.num_posted;
+    SDL_CondBroadcast( pool.job_posted );
+    SDL_UnlockMutex( pool.mutex );
+
+    // the calling thread works too
+    run_job( &job );
+
+    // every chunk is handed out, so wait for those still being run
+    SDL_LockMutex( pool.mutex );
+    while ( pool.num_working > 0 ) {
+        SDL_CondWait( pool.job_left, pool.mutex );
+    }
+    pool.job = 0;
+    pool.busy = false;
+    SDL_UnlockMutex( pool.mutex );
+}
+
+} /* _462 */
@@ -0,0 +1,51 @@
+/**
+ * @file parallel.hpp
+ * @brief Splits loops across threads.
+ */
+
+#ifndef _462_APPLICATION_PARALLEL_HPP_
+#define _462_APPLICATION_PARALLEL_HPP_
+
+#include <cstddef>
+
+namespace _462 {
+
+/// Returns the number of threads parallel_for runs on, one per processor.
+size_t parallel_num_threads();
+
+/**
+ * Calls body( data, begin, end ) for consecutive chunks of at most grain
+ * indices covering [0, count), spread over parallel_num_threads()
+ * threads including the calling one. The other threads are kept waiting
+ * between calls rather than started for each. Returns once every chunk is
+ * done. A call made while another is running, from inside its body or
+ * from another thread, runs on the calling thread alone.
+ */
+void parallel_for_chunks( size_t count, size_t grain,
+                          void ( *body )( void*, size_t, size_t ), void* data );
+
+// calls a functor from parallel_for_chunks
+template< typename Body >
+struct ParallelThunk
+{
+    static void run( void* data, size_t begin, size_t end ) {
+        ( *static_cast< Body* >( data ) )( begin, end );
+    }
+};
+
+/**
+ * Calls body( begin, end ) for consecutive chunks of at most grain indices
+ * covering [0, count), spread over one thread per processor. Chunks never
+ * overlap, but several run at once, so the body must only write what its
+ * own indices own. Runs on the calling thread alone if there is only one
+ * chunk or no threads can be started.
+ */
+template< typename Body >
+void parallel_for( size_t count, size_t grain, Body& body )
+{
+    parallel_for_chunks( count, grain, &ParallelThunk< Body >::run, &body );
+}
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_PARALLEL_HPP_ */
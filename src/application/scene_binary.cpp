@@ -0,0 +1,742 @@
+/**
+ * @file scene_binary.cpp
+ * @brief Binary scene files, for scenes that are slow to load from XML.
+ *
+ * A binary scene is a header followed by sections of fixed-size records,
+ * one section per kind of scene object. Records refer to each other by
+ * index and to strings by offset into a string section, so the file is
+ * used straight from a read-only memory map: loading is a single pass
+ * that copies each record into its scene object and turns indices into
+ * pointers, with no parsing.
+ */
+
+#include "application/scene_binary.hpp"
+
+#include "scene/scene.hpp"
+#include "scene/sphere.hpp"
+#include "scene/model.hpp"
+#include "scene/triangle.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace _462 {
+
+static const char BINARY_SCENE_MAGIC[8] = "P4SCENE";
+// bump whenever a record changes
+static const unsigned int BINARY_SCENE_VERSION = 3;
+// written as is, so it reads back differently on the wrong byte order
+static const unsigned int BINARY_SCENE_BYTE_ORDER = 0x01020304;
+// an index that refers to nothing
+static const unsigned int NO_INDEX = 0xffffffff;
+// every section starts at a multiple of this
+static const size_t SECTION_ALIGNMENT = 8;
+
+enum Section
+{
+    SECTION_GLOBALS,
+    SECTION_KEYFRAMES,
+    SECTION_LIGHTS,
+    SECTION_AREA_LIGHTS,
+    SECTION_MATERIALS,
+    SECTION_MESHES,
+    SECTION_SPHERES,
+    SECTION_TRIANGLES,
+    SECTION_MODELS,
+    SECTION_STRINGS,
+    NUM_SECTIONS
+};
+
+struct SectionEntry
+{
+    // from the start of the file
+    unsigned int offset;
+    unsigned int count;
+    // size of each record, to catch files written with other layouts
+    unsigned int record_size;
+    unsigned int pad;
+};
+
+struct FileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;
+    unsigned int real_size;
+    unsigned int num_sections;
+    SectionEntry sections[NUM_SECTIONS];
+};
+
+// the camera and everything else there is one of
+struct GlobalsRecord
+{
+    Vector3 camera_position;
+    Quaternion camera_orientation;
+    real_t fov;
+    real_t near_clip;
+    real_t far_clip;
+    Color3 background_color;
+    Color3 ambient_light;
+    real_t refractive_index;
+};
+
+struct AreaLightRecord
+{
+    Vector3 position;
+    Color3 color;
+    PointLight::Attenuation attenuation;
+    real_t radius;
+    Vector3 edge_u;
+    Vector3 edge_v;
+    unsigned int shape;
+    unsigned int num_samples;
+};
+
+struct MaterialRecord
+{
+    Color3 ambient;
+    Color3 diffuse;
+    Color3 specular;
+    real_t shininess;
+    real_t refractive_index;
+    // string offset
+    unsigned int texture_filename;
+    unsigned int pad;
+};
+
+struct MeshRecord
+{
+    // string offset
+    unsigned int filename;
+    unsigned int normal_weighting;
+};
+
+struct GeometryRecord
+{
+    Vector3 position;
+    Quaternion orientation;
+    Vector3 scale;
+};
+
+struct SphereRecord
+{
+    GeometryRecord base;
+    real_t radius;
+    unsigned int material;
+    unsigned int pad;
+};
+
+struct VertexRecord
+{
+    Vector3 position;
+    Vector3 normal;
+    Vector2 tex_coord;
+    unsigned int material;
+    unsigned int pad;
+};
+
+struct TriangleRecord
+{
+    GeometryRecord base;
+    VertexRecord vertices[3];
+};
+
+struct ModelRecord
+{
+    GeometryRecord base;
+    unsigned int mesh;
+    unsigned int material;
+};
+
+static const unsigned int RECORD_SIZES[NUM_SECTIONS] = {
+    sizeof( GlobalsRecord ),
+    sizeof( CameraPath::Keyframe ),
+    sizeof( PointLight ),
+    sizeof( AreaLightRecord ),
+    sizeof( MaterialRecord ),
+    sizeof( MeshRecord ),
+    sizeof( SphereRecord ),
+    sizeof( TriangleRecord ),
+    sizeof( ModelRecord ),
+    sizeof( char )
+};
+
+typedef std::map< const Material*, unsigned int > MaterialIndexMap;
+typedef std::map< const Mesh*, unsigned int > MeshIndexMap;
+
+// the records of a scene being saved, in memory. records have no padding
+// besides their pad fields, which are zeroed so that saving the same scene
+// always gives the same file.
+struct SceneRecords
+{
+    std::vector< GlobalsRecord > globals;
+    std::vector< CameraPath::Keyframe > keyframes;
+    std::vector< PointLight > lights;
+    std::vector< AreaLightRecord > area_lights;
+    std::vector< MaterialRecord > materials;
+    std::vector< MeshRecord > meshes;
+    std::vector< SphereRecord > spheres;
+    std::vector< TriangleRecord > triangles;
+    std::vector< ModelRecord > models;
+    std::vector< char > strings;
+
+    MaterialIndexMap material_indices;
+    MeshIndexMap mesh_indices;
+
+    // adds a string, returning its offset
+    unsigned int add_string( const std::string& str ) {
+        unsigned int offset = strings.size();
+        strings.insert( strings.end(), str.c_str(), str.c_str() + str.size() + 1 );
+        return offset;
+    }
+
+    unsigned int material_index( const Material* material ) const {
+        MaterialIndexMap::const_iterator i = material_indices.find( material );
+        return i == material_indices.end() ? NO_INDEX : i->second;
+    }
+
+    unsigned int mesh_index( const Mesh* mesh ) const {
+        MeshIndexMap::const_iterator i = mesh_indices.find( mesh );
+        return i == mesh_indices.end() ? NO_INDEX : i->second;
+    }
+};
+
+// returns the bytes of a record list, or null if it is empty
+template< typename T >
+static const char* record_data( const std::vector< T >& records )
+{
+    return records.empty() ? NULL : reinterpret_cast< const char* >( &records[0] );
+}
+
+static GeometryRecord make_geometry_record( const Geometry* geom )
+{
+    GeometryRecord record;
+    record.position = geom->position;
+    record.orientation = geom->orientation;
+    record.scale = geom->scale;
+    return record;
+}
+
+static void load_geometry_record( const GeometryRecord& record, Geometry* geom )
+{
+    geom->position = record.position;
+    geom->orientation = record.orientation;
+    geom->scale = record.scale;
+}
+
+static void make_records( const Scene& scene, SceneRecords* records )
+{
+    GlobalsRecord globals;
+    globals.camera_position = scene.camera.position;
+    globals.camera_orientation = scene.camera.orientation;
+    globals.fov = scene.camera.fov;
+    globals.near_clip = scene.camera.near_clip;
+    globals.far_clip = scene.camera.far_clip;
+    globals.background_color = scene.background_color;
+    globals.ambient_light = scene.ambient_light;
+    globals.refractive_index = scene.refractive_index;
+    records->globals.push_back( globals );
+
+    const CameraPath::Keyframe* keyframes = scene.camera_path.get_keyframes();
+    records->keyframes.assign( keyframes, keyframes + scene.camera_path.num_keyframes() );
+
+    const PointLight* lights = scene.get_lights();
+    records->lights.assign( lights, lights + scene.num_lights() );
+
+    const AreaLight* area_lights = scene.get_area_lights();
+    for ( size_t i = 0; i < scene.num_area_lights(); ++i ) {
+        const AreaLight& light = area_lights[i];
+        AreaLightRecord record;
+        record.position = light.position;
+        record.color = light.color;
+        record.attenuation = light.attenuation;
+        record.radius = light.radius;
+        record.edge_u = light.edge_u;
+        record.edge_v = light.edge_v;
+        record.shape = light.shape;
+        record.num_samples = light.num_samples;
+        records->area_lights.push_back( record );
+    }
+
+    Material* const* materials = scene.get_materials();
+    for ( size_t i = 0; i < scene.num_materials(); ++i ) {
+        const Material* material = materials[i];
+        MaterialRecord record;
+        record.ambient = material->ambient;
+        record.diffuse = material->diffuse;
+        record.specular = material->specular;
+        record.shininess = material->shininess;
+        record.refractive_index = material->refractive_index;
+        record.texture_filename = records->add_string( material->texture_filename );
+        record.pad = 0;
+        records->materials.push_back( record );
+        records->material_indices[material] = i;
+    }
+
+    Mesh* const* meshes = scene.get_meshes();
+    for ( size_t i = 0; i < scene.num_meshes(); ++i ) {
+        MeshRecord record;
+        record.filename = records->add_string( meshes[i]->filename );
+        record.normal_weighting = meshes[i]->normal_weighting;
+        records->meshes.push_back( record );
+        records->mesh_indices[meshes[i]] = i;
+    }
+}
+
+// fills in the records of a geometry, returning false for unknown kinds
+static bool make_geometry_records( const Geometry* geom, SceneRecords* records )
+{
+    if ( const Sphere* sphere = dynamic_cast< const Sphere* >( geom ) ) {
+        SphereRecord record;
+        record.base = make_geometry_record( geom );
+        record.radius = sphere->radius;
+        record.material = records->material_index( sphere->material );
+        record.pad = 0;
+        records->spheres.push_back( record );
+    } else if ( const Triangle* triangle = dynamic_cast< const Triangle* >( geom ) ) {
+        TriangleRecord record;
+        record.base = make_geometry_record( geom );
+        for ( size_t i = 0; i < 3; ++i ) {
+            const Triangle::Vertex& vertex = triangle->vertices[i];
+            record.vertices[i].position = vertex.position;
+            record.vertices[i].normal = vertex.normal;
+            record.vertices[i].tex_coord = vertex.tex_coord;
+            record.vertices[i].material = records->material_index( vertex.material );
+            record.vertices[i].pad = 0;
+        }
+        records->triangles.push_back( record );
+    } else if ( const Model* model = dynamic_cast< const Model* >( geom ) ) {
+        ModelRecord record;
+        record.base = make_geometry_record( geom );
+        record.mesh = records->mesh_index( model->mesh );
+        record.material = records->material_index( model->material );
+        records->models.push_back( record );
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool save_binary_scene( const Scene& scene, const char* filename )
+{
+    SceneRecords records;
+
+    try {
+        make_records( scene, &records );
+
+        Geometry* const* geometries = scene.get_geometries();
+        for ( size_t i = 0; i < scene.num_geometries(); ++i ) {
+            if ( !make_geometry_records( geometries[i], &records ) ) {
+                std::cout << "Error: geometry " << i << " cannot be saved in a binary scene.\n";
+                return false;
+            }
+        }
+    } catch ( std::bad_alloc const& ) {
+        std::cout << "Out of memory error while saving scene.\n";
+        return false;
+    }
+
+    const char* data[NUM_SECTIONS] = {
+        record_data( records.globals ),
+        record_data( records.keyframes ),
+        record_data( records.lights ),
+        record_data( records.area_lights ),
+        record_data( records.materials ),
+        record_data( records.meshes ),
+        record_data( records.spheres ),
+        record_data( records.triangles ),
+        record_data( records.models ),
+        record_data( records.strings )
+    };
+    const size_t counts[NUM_SECTIONS] = {
+        records.globals.size(),
+        records.keyframes.size(),
+        records.lights.size(),
+        records.area_lights.size(),
+        records.materials.size(),
+        records.meshes.size(),
+        records.spheres.size(),
+        records.triangles.size(),
+        records.models.size(),
+        records.strings.size()
+    };
+
+    FileHeader header;
+    memset( &header, 0, sizeof header );
+    memcpy( header.magic, BINARY_SCENE_MAGIC, sizeof header.magic );
+    header.version = BINARY_SCENE_VERSION;
+    header.byte_order = BINARY_SCENE_BYTE_ORDER;
+    header.real_size = sizeof( real_t );
+    header.num_sections = NUM_SECTIONS;
+
+    // lay out the sections one after another
+    size_t offset = sizeof header;
+    for ( size_t i = 0; i < NUM_SECTIONS; ++i ) {
+        offset = ( offset + SECTION_ALIGNMENT - 1 ) & ~( SECTION_ALIGNMENT - 1 );
+        header.sections[i].offset = offset;
+        header.sections[i].count = counts[i];
+        header.sections[i].record_size = RECORD_SIZES[i];
+        offset += counts[i] * RECORD_SIZES[i];
+        if ( offset > 0xffffffffu ) {
+            std::cout << "Error: scene is too large for a binary scene.\n";
+            return false;
+        }
+    }
+
+    FILE* file = fopen( filename, "wb" );
+    if ( !file ) {
+        std::cout << "Error opening file '" << filename << "' for writing.\n";
+        return false;
+    }
+
+    static const char padding[SECTION_ALIGNMENT] = { 0 };
+    bool ok = fwrite( &header, sizeof header, 1, file ) == 1;
+    size_t position = sizeof header;
+    for ( size_t i = 0; ok && i < NUM_SECTIONS; ++i ) {
+        size_t size = counts[i] * RECORD_SIZES[i];
+        size_t pad = header.sections[i].offset - position;
+        ok = fwrite( padding, 1, pad, file ) == pad
+            && ( size == 0 || fwrite( data[i], size, 1, file ) == 1 );
+        position = header.sections[i].offset + size;
+    }
+    ok = fclose( file ) == 0 && ok;
+
+    if ( !ok ) {
+        std::cout << "Error writing binary scene '" << filename << "'.\n";
+        return false;
+    }
+
+    std::cout << "Saved binary scene to '" << filename << "'.\n";
+    return true;
+}
+
+/**
+ * A whole file in memory, mapped where the platform allows it.
+ */
+class MappedFile
+{
+public:
+
+    MappedFile() : data( 0 ), size( 0 ), mapped( false ) { }
+    ~MappedFile() { close(); }
+
+    // maps the file, printing a message on failure
+    bool open( const char* filename );
+    void close();
+
+    const char* data;
+    size_t size;
+
+private:
+
+    bool mapped;
+
+    // no meaningful assignment or copy
+    MappedFile( const MappedFile& );
+    MappedFile& operator=( const MappedFile& );
+};
+
+bool MappedFile::open( const char* filename )
+{
+    close();
+
+#ifndef _WIN32
+    int fd = ::open( filename, O_RDONLY );
+    if ( fd >= 0 ) {
+        struct stat st;
+        void* addr = MAP_FAILED;
+        if ( fstat( fd, &st ) == 0 && st.st_size > 0 ) {
+            addr = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        }
+        ::close( fd );
+        if ( addr != MAP_FAILED ) {
+            data = static_cast< const char* >( addr );
+            size = st.st_size;
+            mapped = true;
+            return true;
+        }
+    }
+#endif
+
+    // no mapping, so read it all instead
+    FILE* file = fopen( filename, "rb" );
+    if ( !file ) {
+        std::cout << "Error opening file '" << filename << "'.\n";
+        return false;
+    }
+
+    bool ok = fseek( file, 0, SEEK_END ) == 0;
+    long length = ok ? ftell( file ) : -1;
+    char* buffer = length > 0 ? static_cast< char* >( malloc( length ) ) : 0;
+    ok = buffer && fseek( file, 0, SEEK_SET ) == 0
+        && fread( buffer, length, 1, file ) == 1;
+    fclose( file );
+
+    if ( !ok ) {
+        free( buffer );
+        std::cout << "Error reading file '" << filename << "'.\n";
+        return false;
+    }
+
+    data = buffer;
+    size = length;
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if ( mapped ) {
+        munmap( const_cast< char* >( data ), size );
+    } else
+#endif
+    {
+        free( const_cast< char* >( data ) );
+    }
+    data = 0;
+    size = 0;
+    mapped = false;
+}
+
+bool is_binary_scene( const char* filename )
+{
+    char magic[sizeof BINARY_SCENE_MAGIC];
+    FILE* file = fopen( filename, "rb" );
+    if ( !file )
+        return false;
+    bool rv = fread( magic, sizeof magic, 1, file ) == 1
+        && memcmp( magic, BINARY_SCENE_MAGIC, sizeof magic ) == 0;
+    fclose( file );
+    return rv;
+}
+
+/**
+ * Gives checked access to the sections of a mapped binary scene. Every
+ * check failure prints a message and throws.
+ */
+class BinarySceneReader
+{
+public:
+
+    BinarySceneReader( const MappedFile& file ) : file( file ), header( 0 ) { }
+
+    // checks the header and the extents of all sections
+    void check_header();
+
+    template< typename T >
+    const T* get_records( Section section ) const {
+        return reinterpret_cast< const T* >( file.data + header->sections[section].offset );
+    }
+
+    size_t get_count( Section section ) const {
+        return header->sections[section].count;
+    }
+
+    const char* get_string( unsigned int offset ) const;
+
+    // returns the list's element at index, failing with the message
+    // missing if the record refers to none, as every reference is required
+    template< typename T >
+    T* lookup( const std::vector< T* >& list, unsigned int index, const char* missing ) const {
+        if ( index == NO_INDEX )
+            fail( missing );
+        if ( index >= list.size() )
+            fail( "index out of range" );
+        return list[index];
+    }
+
+    void fail( const char* message ) const;
+
+private:
+
+    const MappedFile& file;
+    const FileHeader* header;
+};
+
+void BinarySceneReader::fail( const char* message ) const
+{
+    std::cout << "Error: invalid binary scene, " << message << ".\n";
+    throw std::exception();
+}
+
+void BinarySceneReader::check_header()
+{
+    if ( file.size < sizeof( FileHeader ) )
+        fail( "file too short" );
+
+    header = reinterpret_cast< const FileHeader* >( file.data );
+
+    if ( memcmp( header->magic, BINARY_SCENE_MAGIC, sizeof header->magic ) != 0 )
+        fail( "bad magic number" );
+    if ( header->version != BINARY_SCENE_VERSION )
+        fail( "unsupported version" );
+    if ( header->byte_order != BINARY_SCENE_BYTE_ORDER || header->real_size != sizeof( real_t ) )
+        fail( "written on an incompatible machine" );
+    if ( header->num_sections != NUM_SECTIONS )
+        fail( "wrong number of sections" );
+
+    for ( size_t i = 0; i < NUM_SECTIONS; ++i ) {
+        const SectionEntry& entry = header->sections[i];
+        if ( entry.record_size != RECORD_SIZES[i] )
+            fail( "record size mismatch" );
+        if ( entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > file.size
+             || entry.count > ( file.size - entry.offset ) / entry.record_size )
+            fail( "section out of bounds" );
+    }
+
+    if ( get_count( SECTION_GLOBALS ) != 1 )
+        fail( "missing globals" );
+
+    size_t num_chars = get_count( SECTION_STRINGS );
+    if ( num_chars > 0 && get_records< char >( SECTION_STRINGS )[num_chars - 1] != '\0' )
+        fail( "unterminated string" );
+}
+
+const char* BinarySceneReader::get_string( unsigned int offset ) const
+{
+    if ( offset >= get_count( SECTION_STRINGS ) )
+        fail( "string out of range" );
+    return get_records< char >( SECTION_STRINGS ) + offset;
+}
+
+static void load_records( const BinarySceneReader& reader, Scene* scene )
+{
+    Arena* arena = scene->get_arena();
+
+    const GlobalsRecord& globals = *reader.get_records< GlobalsRecord >( SECTION_GLOBALS );
+    scene->camera.position = globals.camera_position;
+    scene->camera.orientation = globals.camera_orientation;
+    scene->camera.fov = globals.fov;
+    scene->camera.near_clip = globals.near_clip;
+    scene->camera.far_clip = globals.far_clip;
+    scene->background_color = globals.background_color;
+    scene->ambient_light = globals.ambient_light;
+    scene->refractive_index = globals.refractive_index;
+
+    const CameraPath::Keyframe* keyframes = reader.get_records< CameraPath::Keyframe >( SECTION_KEYFRAMES );
+    for ( size_t i = 0; i < reader.get_count( SECTION_KEYFRAMES ); ++i ) {
+        scene->camera_path.add_keyframe( keyframes[i] );
+    }
+
+    const PointLight* lights = reader.get_records< PointLight >( SECTION_LIGHTS );
+    for ( size_t i = 0; i < reader.get_count( SECTION_LIGHTS ); ++i ) {
+        scene->add_light( lights[i] );
+    }
+
+    const AreaLightRecord* area_lights = reader.get_records< AreaLightRecord >( SECTION_AREA_LIGHTS );
+    for ( size_t i = 0; i < reader.get_count( SECTION_AREA_LIGHTS ); ++i ) {
+        const AreaLightRecord& record = area_lights[i];
+        if ( record.shape > AreaLight::SHAPE_QUAD || record.num_samples < 1 )
+            reader.fail( "bad area light" );
+        AreaLight light;
+        light.shape = AreaLight::Shape( record.shape );
+        light.position = record.position;
+        light.color = record.color;
+        light.attenuation = record.attenuation;
+        light.radius = record.radius;
+        light.edge_u = record.edge_u;
+        light.edge_v = record.edge_v;
+        light.num_samples = record.num_samples;
+        scene->add_area_light( light );
+    }
+
+    std::vector< Material* > materials( reader.get_count( SECTION_MATERIALS ) );
+    const MaterialRecord* material_records = reader.get_records< MaterialRecord >( SECTION_MATERIALS );
+    for ( size_t i = 0; i < materials.size(); ++i ) {
+        const MaterialRecord& record = material_records[i];
+        Material* material = arena->create< Material >();
+        scene->add_material( material );
+        material->ambient = record.ambient;
+        material->diffuse = record.diffuse;
+        material->specular = record.specular;
+        material->shininess = record.shininess;
+        material->refractive_index = record.refractive_index;
+        material->texture_filename = reader.get_string( record.texture_filename );
+        materials[i] = material;
+    }
+
+    std::vector< Mesh* > meshes( reader.get_count( SECTION_MESHES ) );
+    const MeshRecord* mesh_records = reader.get_records< MeshRecord >( SECTION_MESHES );
+    for ( size_t i = 0; i < meshes.size(); ++i ) {
+        Mesh* mesh = arena->create< Mesh >();
+        scene->add_mesh( mesh );
+        mesh->filename = reader.get_string( mesh_records[i].filename );
+        if ( mesh_records[i].normal_weighting > Mesh::NORMALS_ANGLE )
+            reader.fail( "bad normal weighting" );
+        mesh->normal_weighting = Mesh::NormalWeighting( mesh_records[i].normal_weighting );
+        meshes[i] = mesh;
+    }
+
+    const SphereRecord* spheres = reader.get_records< SphereRecord >( SECTION_SPHERES );
+    for ( size_t i = 0; i < reader.get_count( SECTION_SPHERES ); ++i ) {
+        Sphere* geom = arena->create< Sphere >();
+        scene->add_geometry( geom );
+        load_geometry_record( spheres[i].base, geom );
+        geom->radius = spheres[i].radius;
+        geom->material = reader.lookup( materials, spheres[i].material, "missing material" );
+    }
+
+    const TriangleRecord* triangles = reader.get_records< TriangleRecord >( SECTION_TRIANGLES );
+    for ( size_t i = 0; i < reader.get_count( SECTION_TRIANGLES ); ++i ) {
+        Triangle* geom = arena->create< Triangle >();
+        scene->add_geometry( geom );
+        load_geometry_record( triangles[i].base, geom );
+        for ( size_t j = 0; j < 3; ++j ) {
+            const VertexRecord& record = triangles[i].vertices[j];
+            geom->vertices[j].position = record.position;
+            geom->vertices[j].normal = record.normal;
+            geom->vertices[j].tex_coord = record.tex_coord;
+            geom->vertices[j].material = reader.lookup( materials, record.material, "missing material" );
+        }
+    }
+
+    const ModelRecord* models = reader.get_records< ModelRecord >( SECTION_MODELS );
+    for ( size_t i = 0; i < reader.get_count( SECTION_MODELS ); ++i ) {
+        Model* geom = arena->create< Model >();
+        scene->add_geometry( geom );
+        load_geometry_record( models[i].base, geom );
+        geom->mesh = reader.lookup( meshes, models[i].mesh, "missing mesh" );
+        geom->material = reader.lookup( materials, models[i].material, "missing material" );
+    }
+}
+
+bool load_binary_scene( Scene* scene, const char* filename )
+{
+    MappedFile file;
+    BinarySceneReader reader( file );
+
+    assert( scene );
+
+    if ( !file.open( filename ) ) {
+        return false;
+    }
+
+    scene->reset();
+
+    try {
+        reader.check_header();
+        load_records( reader, scene );
+    } catch ( std::bad_alloc const& ) {
+        std::cout << "Out of memory error while loading scene\n.";
+        scene->reset();
+        return false;
+    } catch ( ... ) {
+        scene->reset();
+        return false;
+    }
+
+    return true;
+}
+
+} /* _462 */
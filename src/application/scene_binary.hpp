@@ -0,0 +1,38 @@
+/**
+ * @file scene_binary.hpp
+ * @brief Binary scene files, for scenes that are slow to load from XML.
+ */
+
+#ifndef _462_APPLICATION_SCENE_BINARY_HPP_
+#define _462_APPLICATION_SCENE_BINARY_HPP_
+
+namespace _462 {
+
+class Scene;
+
+/**
+ * Returns true if the file is a binary scene, judging by its header.
+ */
+bool is_binary_scene( const char* filename );
+
+/**
+ * Saves a scene in the binary format. Meshes and textures are saved by
+ * filename only, as they are in XML scenes. Binary scenes are a cache, not
+ * an interchange format: they can only be read back on machines with the
+ * same byte order and floating point size.
+ * Prints a message to stdout if an error occurs.
+ * @return True on success, false on error.
+ */
+bool save_binary_scene( const Scene& scene, const char* filename );
+
+/**
+ * Loads a scene from a binary scene file. Clears away the old scene.
+ * Prints a message to stdout if an error occurs.
+ * @return True on success, false on error.
+ * Will clear the scene on error.
+ */
+bool load_binary_scene( Scene* scene, const char* filename );
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_SCENE_BINARY_HPP_ */
@@ -6,15 +6,19 @@
  */
 
 #include "application/scene_loader.hpp"
+#include "application/scene_binary.hpp"
 
 #include "scene/scene.hpp"
 #include "scene/sphere.hpp"
 #include "scene/model.hpp"
 #include "scene/triangle.hpp"
+#include "scene/arena.hpp"
+#include "application/xml_stream.hpp"
 #include "tinyxml/tinyxml.h"
 
 #include <iostream>
 #include <map>
+#include <vector>
 #include <cstring>
 #include <exception>
 
@@ -28,12 +32,22 @@ struct StrCompare
     }
 };
 
+// the maps below only live while loading, so their nodes come from a
+// scratch arena freed in one go when loading finishes
+
 // map from strings to materials
-typedef std::map< const char*, const Material*, StrCompare > MaterialMap;
+typedef std::map< const char*, const Material*, StrCompare,
+                  ArenaAllocator< std::pair< const char* const, const Material* > > > MaterialMap;
 // map from strings to meshes
-typedef std::map< const char*, const Mesh*, StrCompare > MeshMap;
+typedef std::map< const char*, const Mesh*, StrCompare,
+                  ArenaAllocator< std::pair< const char* const, const Mesh* > > > MeshMap;
+// map from filenames to the mesh loaded from that file
+typedef MeshMap MeshFileMap;
 // map from strings to triangle vertices
-typedef std::map< const char*, Triangle::Vertex, StrCompare > TriVertMap;
+typedef std::map< const char*, Triangle::Vertex, StrCompare,
+                  ArenaAllocator< std::pair< const char* const, Triangle::Vertex > > > TriVertMap;
+// list of geometries
+typedef std::vector< Geometry*, ArenaAllocator< Geometry* > > GeometryList;
 
 static const char STR_FOV[] = "fov";
 static const char STR_NEAR[] = "near_clip";
@@ -57,19 +71,38 @@ static const char STR_REFRACT[] = "refractive_index";
 static const char STR_TEXTURE[] = "texture";
 static const char STR_NAME[] = "name";
 static const char STR_FILENAME[] = "filename";
+static const char STR_NWEIGHT[] = "normal_weighting";
 static const char STR_BACKGROUND[] = "background_color";
 static const char STR_AMLIGHT[] = "ambient_light";
 static const char STR_CAMERA[] = "camera";
 static const char STR_PLIGHT[] = "point_light";
+static const char STR_SLIGHT[] = "sphere_light";
+static const char STR_QLIGHT[] = "quad_light";
+static const char STR_EDGEU[] = "edge_u";
+static const char STR_EDGEV[] = "edge_v";
+static const char STR_SAMPLES[] = "samples";
 static const char STR_MATERIAL[] = "material";
 static const char STR_SPHERE[] = "sphere";
 static const char STR_TRIANGLE[] = "triangle";
 static const char STR_MODEL[] = "model";
 static const char STR_MESH[] = "mesh";
+static const char STR_CAMPATH[] = "camera_path";
+static const char STR_KEYFRAME[] = "keyframe";
+static const char STR_TIME[] = "time";
+
+// the children of the root read by each pass of load_scene
+static const char* const DEFINITION_ELEMENTS[] = {
+    STR_CAMERA, STR_CAMPATH, STR_BACKGROUND, STR_REFRACT, STR_AMLIGHT,
+    STR_PLIGHT, STR_SLIGHT, STR_QLIGHT, STR_MATERIAL, STR_MESH, 0
+};
+static const char* const VERTEX_ELEMENTS[] = { STR_VERTEX, 0 };
+static const char* const GEOMETRY_ELEMENTS[] = { STR_SPHERE, STR_TRIANGLE, STR_MODEL, 0 };
 
 static void print_error_header( const TiXmlElement* base )
 {
-    std::cout << "ERROR, " << base->Row() << ":" << base->Column() << "; "
+    int row, col;
+    XmlStream::get_location( base, &row, &col );
+    std::cout << "ERROR, " << row << ":" << col << "; "
         << "in " << base->Value() << ", ";
 }
 
@@ -196,6 +229,27 @@ static void parse_camera( const TiXmlElement* elem, Camera* camera )
     camera->orientation = normalize( ori );
 }
 
+static void parse_camera_path( const TiXmlElement* elem, CameraPath* path )
+{
+    const TiXmlElement* child = elem->FirstChildElement( STR_KEYFRAME );
+    while ( child ) {
+        CameraPath::Keyframe key;
+        Quaternion ori;
+        parse_attrib_double( child, true, STR_TIME, &key.time );
+        parse_elem( child, true,  STR_POSITION,  &key.position );
+        parse_elem( child, true,  STR_ORIENT,    &ori );
+        key.orientation = normalize( ori );
+        path->add_keyframe( key );
+        child = child->NextSiblingElement( STR_KEYFRAME );
+    }
+
+    if ( path->empty() ) {
+        print_error_header( elem );
+        std::cout << "no '" << STR_KEYFRAME << "' defined.\n";
+        throw std::exception();
+    }
+}
+
 static void parse_point_light( const TiXmlElement* elem, PointLight* light )
 {
     parse_elem( elem, false, STR_ACON,      &light->attenuation.constant );
@@ -205,10 +259,55 @@ static void parse_point_light( const TiXmlElement* elem, PointLight* light )
     parse_elem( elem, true,  STR_COLOR,     &light->color );
 }
 
+static void parse_area_light( const TiXmlElement* elem, AreaLight* light )
+{
+    real_t samples = light->num_samples;
+
+    parse_elem( elem, false, STR_ACON,      &light->attenuation.constant );
+    parse_elem( elem, false, STR_ALIN,      &light->attenuation.linear );
+    parse_elem( elem, false, STR_AQUAD,     &light->attenuation.quadratic );
+    parse_elem( elem, true,  STR_POSITION,  &light->position );
+    parse_elem( elem, true,  STR_COLOR,     &light->color );
+    parse_elem( elem, false, STR_SAMPLES,   &samples );
+    if ( light->shape == AreaLight::SHAPE_SPHERE ) {
+        parse_elem( elem, true,  STR_RADIUS,    &light->radius );
+    } else {
+        parse_elem( elem, true,  STR_EDGEU,     &light->edge_u );
+        parse_elem( elem, true,  STR_EDGEV,     &light->edge_v );
+    }
+
+    if ( samples < 1 ) {
+        print_error_header( elem );
+        std::cout << "'" << STR_SAMPLES << "' must be at least 1.\n";
+        throw std::exception();
+    }
+    light->num_samples = (unsigned int) samples;
+}
+
+static void parse_normal_weighting( const TiXmlElement* elem, Mesh::NormalWeighting* weighting )
+{
+    const char* att = 0;
+    parse_attrib_string( elem, false, STR_NWEIGHT, &att );
+    if ( !att ) {
+        return;
+    } else if ( strcmp( att, "uniform" ) == 0 ) {
+        *weighting = Mesh::NORMALS_UNIFORM;
+    } else if ( strcmp( att, "area" ) == 0 ) {
+        *weighting = Mesh::NORMALS_AREA;
+    } else if ( strcmp( att, "angle" ) == 0 ) {
+        *weighting = Mesh::NORMALS_ANGLE;
+    } else {
+        print_error_header( elem );
+        std::cout << "unknown " << STR_NWEIGHT << " '" << att << "'.\n";
+        throw std::exception();
+    }
+}
+
 template< typename T >
-static void parse_lookup_data( const std::map< const char*, T, StrCompare > tmap, const TiXmlElement* elem, const char* name, T* val )
+static void parse_lookup_data( const std::map< const char*, T, StrCompare, ArenaAllocator< std::pair< const char* const, T > > >& tmap,
+                               const TiXmlElement* elem, const char* name, T* val )
 {
-    typename std::map< const char*, T, StrCompare >::const_iterator iter;
+    typename std::map< const char*, T, StrCompare, ArenaAllocator< std::pair< const char* const, T > > >::const_iterator iter;
     const char* att;
 
     parse_attrib_string( elem, true, name, &att );
@@ -237,16 +336,6 @@ static const char* parse_material( const TiXmlElement* elem, Material* material
     return name;
 }
 
-static const char* parse_mesh( const TiXmlElement* elem, Mesh* mesh )
-{
-    const char* name;
-
-    parse_attrib_string( elem, false, STR_FILENAME, &mesh->filename );
-    parse_attrib_string( elem, true,  STR_NAME,     &name );
-
-    return name;
-}
-
 static const char* parse_triangle_vertex( const MaterialMap& matmap, const TiXmlElement* elem, Triangle::Vertex* vertex )
 {
     const char* name;
@@ -315,151 +404,223 @@ static void parse_geom_model( const MaterialMap& matmap, const MeshMap& meshmap,
     parse_lookup_data( matmap, elem, STR_MATERIAL, &geom->material );
 }
 
-static void check_mem( void* ptr )
+
+// copies a string out of the current element, which is freed when the
+// stream moves on
+static const char* copy_string( Arena* arena, const char* str )
+{
+    size_t len = strlen( str ) + 1;
+    char* copy = static_cast< char* >( arena->allocate( len ) );
+    memcpy( copy, str, len );
+    return copy;
+}
+
+// checks that an element that may appear only once was not seen before
+static void check_unique( const TiXmlElement* elem, bool* seen )
 {
-    if ( !ptr ) {
-        std::cout << "Error: ran out of memory loading scene.\n";
+    if ( *seen ) {
+        print_error_header( elem );
+        std::cout << "'" << elem->Value() << "' multiply defined.\n";
+        throw std::exception();
+    }
+    *seen = true;
+}
+
+// checks that a required element was seen
+static void check_defined( const TiXmlElement* root, bool seen, const char* name )
+{
+    if ( !seen ) {
+        print_error_header( root );
+        std::cout << "no '" << name << "' defined.\n";
         throw std::exception();
     }
 }
 
 bool load_scene( Scene* scene, const char* filename )
 {
-    TiXmlDocument doc( filename );
+    XmlStream stream;
     const TiXmlElement* root = 0;
     const TiXmlElement* elem = 0;
-    MaterialMap materials;
-    MeshMap meshes;
-    TriVertMap triverts;
+    // declared before the maps so that it outlives them
+    Arena scratch;
+    ArenaAllocator< char > scratch_alloc( &scratch );
+    MaterialMap materials( StrCompare(), scratch_alloc );
+    MeshMap meshes( StrCompare(), scratch_alloc );
+    MeshFileMap mesh_files( StrCompare(), scratch_alloc );
+    TriVertMap triverts( StrCompare(), scratch_alloc );
+    // triangles and models, added to the scene after all spheres
+    GeometryList triangles( scratch_alloc );
+    GeometryList models( scratch_alloc );
 
     assert( scene );
 
-    // load the document
-
-    if ( !doc.LoadFile() ) {
-        std::cout << "ERROR, " << doc.ErrorRow() << ":" << doc.ErrorCol() << "; "
-            << "parse error: " << doc.ErrorDesc() << "\n";
-        return false;
+    // binary scenes, made from XML ones by the converter, load separately
+    if ( is_binary_scene( filename ) ) {
+        return load_binary_scene( scene, filename );
     }
 
-    // check for root element
+    // open the document, which is read one child of the root at a time
+    // rather than all at once, so huge scenes don't need a huge DOM
 
-    root = doc.RootElement();
-    if ( !root ) {
-        std::cout << "No root element.\n";
+    if ( !stream.open( filename ) ) {
         return false;
     }
+    root = stream.get_root();
 
     // reset the scene
 
     scene->reset();
 
     try {
-        // parse the camera
-        elem = get_unique_child( root, true, STR_CAMERA );
-        parse_camera( elem, &scene->camera );
-        // parse background color
-        parse_elem( root, true,  STR_BACKGROUND, &scene->background_color );
-        // parse refractive index
-        parse_elem( root, true,  STR_REFRACT, &scene->refractive_index );
-        // parse ambient light
-        parse_elem( root, false, STR_AMLIGHT, &scene->ambient_light );
-
-        // parse the lights
-        elem = root->FirstChildElement( STR_PLIGHT );
-        while ( elem ) {
-            PointLight pl;
-            parse_point_light( elem, &pl );
-            scene->add_light( pl );
-            elem = elem->NextSiblingElement( STR_PLIGHT );
+        bool has_camera = false;
+        bool has_camera_path = false;
+        bool has_background = false;
+        bool has_refract = false;
+        bool has_ambient = false;
+
+        // the first pass reads the camera, lights, materials, and meshes.
+        // later passes look things up by name, so that things can be used
+        // before they are defined
+        while ( ( elem = stream.next( DEFINITION_ELEMENTS ) ) ) {
+            const char* type = elem->Value();
+
+            if ( strcmp( type, STR_CAMERA ) == 0 ) {
+                check_unique( elem, &has_camera );
+                parse_camera( elem, &scene->camera );
+            } else if ( strcmp( type, STR_CAMPATH ) == 0 ) {
+                // the optional camera path used for animations
+                check_unique( elem, &has_camera_path );
+                parse_camera_path( elem, &scene->camera_path );
+            } else if ( strcmp( type, STR_BACKGROUND ) == 0 ) {
+                check_unique( elem, &has_background );
+                parse_elem( elem, &scene->background_color );
+            } else if ( strcmp( type, STR_REFRACT ) == 0 ) {
+                check_unique( elem, &has_refract );
+                parse_elem( elem, &scene->refractive_index );
+            } else if ( strcmp( type, STR_AMLIGHT ) == 0 ) {
+                check_unique( elem, &has_ambient );
+                parse_elem( elem, &scene->ambient_light );
+            } else if ( strcmp( type, STR_PLIGHT ) == 0 ) {
+                PointLight pl;
+                parse_point_light( elem, &pl );
+                scene->add_light( pl );
+            } else if ( strcmp( type, STR_SLIGHT ) == 0 || strcmp( type, STR_QLIGHT ) == 0 ) {
+                AreaLight al;
+                al.shape = strcmp( type, STR_SLIGHT ) == 0 ? AreaLight::SHAPE_SPHERE : AreaLight::SHAPE_QUAD;
+                parse_area_light( elem, &al );
+                scene->add_area_light( al );
+            } else if ( strcmp( type, STR_MATERIAL ) == 0 ) {
+                Material* mat = scene->get_arena()->create< Material >();
+                scene->add_material( mat );
+                const char* name = parse_material( elem, mat );
+                assert( name );
+                // place each material in map by it's name, so we can associate geometries
+                // with them when loading geometries
+                // check for repeat name
+                if ( !materials.insert( std::make_pair( copy_string( &scratch, name ), mat ) ).second ) {
+                    print_error_header( elem );
+                    std::cout << "Material '" << name << "' multiply defined.\n";
+                    throw std::exception();
+                }
+            } else if ( strcmp( type, STR_MESH ) == 0 ) {
+                const char* name;
+                const char* filename = "";
+                const Mesh* mesh;
+                Mesh::NormalWeighting weighting = Mesh::NORMALS_UNIFORM;
+                parse_attrib_string( elem, false, STR_FILENAME, &filename );
+                parse_attrib_string( elem, true,  STR_NAME,     &name );
+                parse_normal_weighting( elem, &weighting );
+                assert( name );
+                // meshes naming the same file are loaded once and shared,
+                // unless they generate normals differently
+                MeshFileMap::const_iterator file = mesh_files.find( filename );
+                if ( file != mesh_files.end() && file->second->normal_weighting == weighting ) {
+                    mesh = file->second;
+                } else {
+                    Mesh* new_mesh = scene->get_arena()->create< Mesh >();
+                    scene->add_mesh( new_mesh );
+                    new_mesh->filename = filename;
+                    new_mesh->normal_weighting = weighting;
+                    if ( file == mesh_files.end() )
+                        mesh_files.insert( std::make_pair( new_mesh->filename.c_str(), new_mesh ) );
+                    mesh = new_mesh;
+                }
+                // place each mesh in map by it's name, so we can associate geometries
+                // with them when loading geometries
+                if ( !meshes.insert( std::make_pair( copy_string( &scratch, name ), mesh ) ).second ) {
+                    print_error_header( elem );
+                    std::cout << "Mesh '" << name << "' multiply defined.\n";
+                    throw std::exception();
+                }
+            }
         }
 
-        // parse the materials
-        elem = root->FirstChildElement( STR_MATERIAL );
-        while ( elem ) {
-            Material* mat = new Material();
-            check_mem( mat );
-            scene->add_material( mat );
-            const char* name = parse_material( elem, mat );
-            assert( name );
-            // place each material in map by it's name, so we can associate geometries
-            // with them when loading geometries
-            // check for repeat name
-            if ( !materials.insert( std::make_pair( name, mat ) ).second ) {
-                print_error_header( elem );
-                std::cout << "Material '" << name << "' multiply defined.\n";
-                throw std::exception();
-            }
-            elem = elem->NextSiblingElement( STR_MATERIAL );
+        if ( stream.has_error() ) {
+            throw std::exception();
         }
 
-        // parse the meshes
-        elem = root->FirstChildElement( STR_MESH );
-        while ( elem ) {
-            Mesh* mesh = new Mesh();
-            check_mem( mesh );
-            scene->add_mesh( mesh );
-            const char* name = parse_mesh( elem, mesh );
-            assert( name );
-            // place each mesh in map by it's name, so we can associate geometries
-            // with them when loading geometries
-            if ( !meshes.insert( std::make_pair( name, mesh ) ).second ) {
-                print_error_header( elem );
-                std::cout << "Mesh '" << name << "' multiply defined.\n";
-                throw std::exception();
-            }
-            elem = elem->NextSiblingElement( STR_MESH );
+        check_defined( root, has_camera, STR_CAMERA );
+        check_defined( root, has_background, STR_BACKGROUND );
+        check_defined( root, has_refract, STR_REFRACT );
+
+        // the second pass reads vertices (used by triangles), which need
+        // the materials
+        if ( !stream.rewind() ) {
+            throw std::exception();
         }
 
-        // parse vertices (used by triangles)
-        elem = root->FirstChildElement( STR_VERTEX );
-        while ( elem ) {
+        while ( ( elem = stream.next( VERTEX_ELEMENTS ) ) ) {
             Triangle::Vertex v;
             const char* name = parse_triangle_vertex( materials, elem, &v );
             assert( name );
             // place each vertex in map by it's name, so we can associate triangles
             // with them when loading geometries
-            if ( !triverts.insert( std::make_pair( name, v ) ).second ) {
+            if ( !triverts.insert( std::make_pair( copy_string( &scratch, name ), v ) ).second ) {
                 print_error_header( elem );
                 std::cout << "Triangle vertex '" << name << "' multiply defined.\n";
                 throw std::exception();
             }
-            elem = elem->NextSiblingElement( STR_VERTEX );
         }
 
-        // parse the geometries
+        if ( stream.has_error() ) {
+            throw std::exception();
+        }
 
-        // spheres
-        elem = root->FirstChildElement( STR_SPHERE );
-        while ( elem ) {
-            Sphere* geom = new Sphere();
-            check_mem( geom );
-            scene->add_geometry( geom );
-            parse_geom_sphere( materials, elem, geom );
-            elem = elem->NextSiblingElement( STR_SPHERE );
+        // the last pass reads the geometries
+        if ( !stream.rewind() ) {
+            throw std::exception();
         }
 
-        // triangles
-        elem = root->FirstChildElement( STR_TRIANGLE );
-        while ( elem ) {
-            Triangle* geom = new Triangle();
-            check_mem( geom );
-            scene->add_geometry( geom );
-            parse_geom_triangle( materials, triverts, elem, geom );
-            elem = elem->NextSiblingElement( STR_TRIANGLE );
+        while ( ( elem = stream.next( GEOMETRY_ELEMENTS ) ) ) {
+            const char* type = elem->Value();
+
+            if ( strcmp( type, STR_SPHERE ) == 0 ) {
+                Sphere* geom = scene->get_arena()->create< Sphere >();
+                scene->add_geometry( geom );
+                parse_geom_sphere( materials, elem, geom );
+            } else if ( strcmp( type, STR_TRIANGLE ) == 0 ) {
+                Triangle* geom = scene->get_arena()->create< Triangle >();
+                triangles.push_back( geom );
+                parse_geom_triangle( materials, triverts, elem, geom );
+            } else if ( strcmp( type, STR_MODEL ) == 0 ) {
+                Model* geom = scene->get_arena()->create< Model >();
+                models.push_back( geom );
+                parse_geom_model( materials, meshes, elem, geom );
+            }
+
+            // TODO add you own geometries here
         }
 
-        // models
-        elem = root->FirstChildElement( STR_MODEL );
-        while ( elem ) {
-            Model* geom = new Model();
-            check_mem( geom );
-            scene->add_geometry( geom );
-            parse_geom_model( materials, meshes, elem, geom );
-            elem = elem->NextSiblingElement( STR_MODEL );
+        if ( stream.has_error() ) {
+            throw std::exception();
         }
 
-        // TODO add you own geometries here
+        for ( size_t i = 0; i < triangles.size(); ++i ) {
+            scene->add_geometry( triangles[i] );
+        }
+        for ( size_t i = 0; i < models.size(); ++i ) {
+            scene->add_geometry( models[i] );
+        }
 
     } catch ( std::bad_alloc const& ) {
         std::cout << "Out of memory error while loading scene\n.";
@@ -475,4 +636,3 @@ bool load_scene( Scene* scene, const char* filename )
 }
 
 } /* _462 */
-
@@ -13,7 +13,8 @@ namespace _462 {
 class Scene;
 
 /**
- * Loads a scene from a .scene file.
+ * Loads a scene from a .scene file, either XML or binary (see
+ * scene_binary.hpp).
  * Clears away the old scene. Prints a message to stdout if an error occurs.
  * @return True on success, false on error.
  * Will clear the scene on error.
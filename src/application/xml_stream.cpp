@@ -0,0 +1,310 @@
+/**
+ * @file xml_stream.cpp
+ * @brief Reads an XML document one child of the root at a time.
+ */
+
+#include "application/xml_stream.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+namespace _462 {
+
+// size of each chunk read from the file
+#define XML_STREAM_CHUNK_SIZE ( 64 * 1024 )
+
+static bool is_space( int c )
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+XmlStream::XmlStream()
+    : file( 0 ), buffer( XML_STREAM_CHUNK_SIZE ), buffer_pos( 0 ), buffer_len( 0 ),
+      row( 1 ), col( 1 ), capture( false ), at_end( true ), error( false ) { }
+
+XmlStream::~XmlStream()
+{
+    close();
+}
+
+bool XmlStream::open( const char* filename )
+{
+    close();
+
+    file = fopen( filename, "rb" );
+    if ( !file ) {
+        std::cout << "ERROR, could not open '" << filename << "'.\n";
+        return false;
+    }
+
+    return read_root();
+}
+
+void XmlStream::close()
+{
+    if ( file ) {
+        fclose( file );
+        file = 0;
+    }
+    root_doc.Clear();
+    child_doc.Clear();
+    at_end = true;
+    error = false;
+}
+
+bool XmlStream::rewind()
+{
+    if ( !file || fseek( file, 0, SEEK_SET ) != 0 )
+        return false;
+    return read_root();
+}
+
+const TiXmlElement* XmlStream::get_root() const
+{
+    return root_doc.RootElement();
+}
+
+void XmlStream::get_location( const TiXmlElement* elem, int* row, int* col )
+{
+    const PieceDocument* doc = dynamic_cast< const PieceDocument* >( elem->GetDocument() );
+    *row = elem->Row();
+    *col = elem->Column();
+    if ( doc ) {
+        // only the first line of the piece is offset horizontally
+        if ( *row == 1 )
+            *col += doc->col - 1;
+        *row += doc->row - 1;
+    }
+}
+
+int XmlStream::get()
+{
+    if ( buffer_pos == buffer_len ) {
+        buffer_len = fread( &buffer[0], 1, buffer.size(), file );
+        buffer_pos = 0;
+        if ( buffer_len == 0 )
+            return EOF;
+    }
+
+    int c = (unsigned char) buffer[buffer_pos++];
+    if ( c == '\n' ) {
+        ++row;
+        col = 1;
+    } else {
+        ++col;
+    }
+    if ( capture )
+        text += char( c );
+    return c;
+}
+
+bool XmlStream::skip_until( const char* terminator )
+{
+    size_t len = strlen( terminator );
+    // the last len characters read
+    char window[8] = { 0 };
+    assert( len < sizeof window );
+
+    while ( true ) {
+        int c = get();
+        if ( c == EOF )
+            return false;
+        memmove( window, window + 1, len - 1 );
+        window[len - 1] = char( c );
+        if ( memcmp( window, terminator, len ) == 0 )
+            return true;
+    }
+}
+
+XmlStream::MarkupKind XmlStream::read_markup()
+{
+    int c = get();
+
+    if ( c == '?' ) {
+        return skip_until( "?>" ) ? MARKUP_OTHER : MARKUP_EOF;
+    } else if ( c == '!' ) {
+        c = get();
+        bool found;
+        if ( c == '-' ) {
+            found = get() == '-' && skip_until( "-->" );
+        } else if ( c == '[' ) {
+            found = skip_until( "]]>" );
+        } else {
+            found = c != EOF && skip_until( ">" );
+        }
+        return found ? MARKUP_OTHER : MARKUP_EOF;
+    } else if ( c == '/' ) {
+        return skip_until( ">" ) ? MARKUP_CLOSE : MARKUP_EOF;
+    }
+
+    // a start tag, which ends at the first '>' outside of quotes
+    int quote = 0;
+    int last = 0;
+    while ( c != EOF ) {
+        if ( quote ) {
+            if ( c == quote )
+                quote = 0;
+        } else if ( c == '"' || c == '\'' ) {
+            quote = c;
+        } else if ( c == '>' ) {
+            return last == '/' ? MARKUP_EMPTY : MARKUP_OPEN;
+        } else if ( !is_space( c ) ) {
+            last = c;
+        }
+        c = get();
+    }
+    return MARKUP_EOF;
+}
+
+bool XmlStream::read_root()
+{
+    buffer_pos = 0;
+    buffer_len = 0;
+    row = 1;
+    col = 1;
+    capture = false;
+    root_doc.Clear();
+    child_doc.Clear();
+    at_end = true;
+    error = true;
+
+    while ( true ) {
+        int c = get();
+        if ( c == EOF ) {
+            std::cout << "No root element.\n";
+            return false;
+        } else if ( c != '<' ) {
+            // whitespace, or a byte order mark
+            continue;
+        }
+
+        int start_row = row;
+        int start_col = col - 1;
+        text = "<";
+        capture = true;
+        MarkupKind kind = read_markup();
+        capture = false;
+
+        if ( kind == MARKUP_OTHER ) {
+            continue;
+        } else if ( kind == MARKUP_EOF || kind == MARKUP_CLOSE ) {
+            print_error( start_row, start_col );
+            std::cout << "parse error: expected the root element.\n";
+            return false;
+        }
+
+        // parse just the start tag, closed off so it stands alone
+        if ( kind == MARKUP_OPEN )
+            text.insert( text.size() - 1, "/" );
+        if ( !parse_piece( &root_doc, start_row, start_col ) )
+            return false;
+
+        at_end = kind == MARKUP_EMPTY;
+        error = false;
+        return true;
+    }
+}
+
+const TiXmlElement* XmlStream::next( const char* const* names )
+{
+    if ( at_end || error )
+        return 0;
+
+    while ( true ) {
+        int c = get();
+        if ( c == EOF ) {
+            print_error( row, col );
+            std::cout << "parse error: root element '" << get_root()->Value()
+                      << "' is not closed.\n";
+            error = true;
+            return 0;
+        } else if ( c != '<' ) {
+            // text directly inside the root
+            continue;
+        }
+
+        int start_row = row;
+        int start_col = col - 1;
+        text = "<";
+        capture = true;
+        MarkupKind kind = read_markup();
+
+        // read the rest of the element, counting nested elements
+        int depth = kind == MARKUP_OPEN ? 1 : 0;
+        while ( depth > 0 && kind != MARKUP_EOF ) {
+            c = get();
+            if ( c == EOF ) {
+                kind = MARKUP_EOF;
+            } else if ( c == '<' ) {
+                MarkupKind inner = read_markup();
+                if ( inner == MARKUP_OPEN ) {
+                    ++depth;
+                } else if ( inner == MARKUP_CLOSE ) {
+                    --depth;
+                } else if ( inner == MARKUP_EOF ) {
+                    kind = MARKUP_EOF;
+                }
+            }
+        }
+        capture = false;
+
+        if ( kind == MARKUP_EOF ) {
+            print_error( start_row, start_col );
+            std::cout << "parse error: unexpected end of file.\n";
+            error = true;
+            return 0;
+        } else if ( kind == MARKUP_CLOSE ) {
+            at_end = true;
+            return 0;
+        } else if ( kind == MARKUP_OTHER || !is_wanted( names ) ) {
+            continue;
+        }
+
+        if ( !parse_piece( &child_doc, start_row, start_col ) ) {
+            error = true;
+            return 0;
+        }
+        return child_doc.RootElement();
+    }
+}
+
+bool XmlStream::is_wanted( const char* const* names ) const
+{
+    if ( !names )
+        return true;
+
+    // the name runs from after the '<' to the first space, '/', or '>'
+    size_t len = strcspn( text.c_str() + 1, " \t\r\n/>" );
+    for ( ; *names; ++names ) {
+        if ( strlen( *names ) == len && text.compare( 1, len, *names ) == 0 )
+            return true;
+    }
+    return false;
+}
+
+bool XmlStream::parse_piece( PieceDocument* doc, int row, int col )
+{
+    doc->Clear();
+    doc->row = row;
+    doc->col = col;
+    doc->Parse( text.c_str() );
+
+    if ( doc->Error() ) {
+        int error_row = doc->ErrorRow();
+        int error_col = doc->ErrorCol();
+        if ( error_row <= 1 )
+            error_col += col - 1;
+        print_error( error_row + row - 1, error_col );
+        std::cout << "parse error: " << doc->ErrorDesc() << "\n";
+        return false;
+    }
+    return true;
+}
+
+void XmlStream::print_error( int row, int col )
+{
+    std::cout << "ERROR, " << row << ":" << col << "; ";
+}
+
+} /* _462 */
@@ -0,0 +1,136 @@
+/**
+ * @file xml_stream.hpp
+ * @brief Reads an XML document one child of the root at a time.
+ */
+
+#ifndef _462_APPLICATION_XML_STREAM_HPP_
+#define _462_APPLICATION_XML_STREAM_HPP_
+
+#include "tinyxml/tinyxml.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Streams the children of a document's root element from a file. The file
+ * is scanned in fixed-size chunks for the extent of each child, and only
+ * that child's text is handed to TinyXML, so at most one child's subtree
+ * is ever in memory no matter how large the document is.
+ *
+ * Text, comments, and processing instructions directly inside the root
+ * are skipped.
+ */
+class XmlStream
+{
+public:
+
+    XmlStream();
+    ~XmlStream();
+
+    /**
+     * Opens a file and reads up to the start of the root's first child.
+     * Prints a message to stdout on error.
+     * @return True on success.
+     */
+    bool open( const char* filename );
+
+    /// Closes the file.
+    void close();
+
+    /**
+     * Goes back to the root's first child, so the children can be read
+     * again.
+     * @return True on success.
+     */
+    bool rewind();
+
+    /**
+     * Returns the root element, with its attributes but none of its
+     * children. Valid until the stream is closed or rewound.
+     */
+    const TiXmlElement* get_root() const;
+
+    /**
+     * Reads and parses the next child of the root. The element is valid
+     * until the next call.
+     * @param names If not null, a null-terminated list of element names.
+     *  Children with other names are skipped without being parsed.
+     * @return The child, or null after the last child or on error.
+     */
+    const TiXmlElement* next( const char* const* names = 0 );
+
+    /// Returns true if reading stopped because of an error.
+    bool has_error() const { return error; }
+
+    /**
+     * Returns the location in the file of an element read from a stream.
+     * Elements read elsewhere just give their own Row() and Column().
+     */
+    static void get_location( const TiXmlElement* elem, int* row, int* col );
+
+private:
+
+    // a document holding one piece of the file, which knows where in the
+    // file that piece started
+    class PieceDocument : public TiXmlDocument
+    {
+    public:
+        PieceDocument() : row( 1 ), col( 1 ) { }
+        // location of the start of the piece in the file
+        int row;
+        int col;
+    };
+
+    // what a piece of markup starting with '<' turned out to be
+    enum MarkupKind
+    {
+        MARKUP_OPEN,
+        MARKUP_EMPTY,
+        MARKUP_CLOSE,
+        MARKUP_OTHER,
+        MARKUP_EOF
+    };
+
+    // returns the next character, or EOF
+    int get();
+    // reads the rest of a piece of markup after its '<'
+    MarkupKind read_markup();
+    // reads up to and including the terminator, returning false on EOF
+    bool skip_until( const char* terminator );
+    // reads up to the root's first child
+    bool read_root();
+    // returns true if the captured element has one of the given names
+    bool is_wanted( const char* const* names ) const;
+    // parses the captured text into the document
+    bool parse_piece( PieceDocument* doc, int row, int col );
+    // prints an error header for the current location
+    void print_error( int row, int col );
+
+    FILE* file;
+    std::vector< char > buffer;
+    size_t buffer_pos;
+    size_t buffer_len;
+    // location of the next character
+    int row;
+    int col;
+
+    // text of the markup being read, when capturing
+    std::string text;
+    bool capture;
+
+    PieceDocument root_doc;
+    PieceDocument child_doc;
+    bool at_end;
+    bool error;
+
+    // no meaningful assignment or copy
+    XmlStream( const XmlStream& );
+    XmlStream& operator=( const XmlStream& );
+};
+
+} /* _462 */
+
+#endif /* _462_APPLICATION_XML_STREAM_HPP_ */
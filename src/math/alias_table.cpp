@@ -0,0 +1,90 @@
+/**
+ * @file alias_table.cpp
+ * @brief Constant time sampling from a discrete distribution.
+ */
+
+#include "math/alias_table.hpp"
+
+namespace _462 {
+
+void AliasTable::build( const real_t* weights, size_t count )
+{
+    entries.resize( count );
+    if ( count == 0 )
+        return;
+
+    real_t total = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        total += std::max( weights[i], real_t( 0 ) );
+    }
+
+    // scaled so the average is one
+    std::vector< real_t > scaled( count );
+    std::vector< size_t > small, large;
+    for ( size_t i = 0; i < count; ++i ) {
+        real_t p = total > 0 ? std::max( weights[i], real_t( 0 ) ) / total : 1.0 / count;
+        entries[i].pdf = p;
+        entries[i].alias = i;
+        scaled[i] = p * count;
+        if ( scaled[i] < 1 ) {
+            small.push_back( i );
+        } else {
+            large.push_back( i );
+        }
+    }
+
+    // pair each underfull entry with an overfull one that tops it up
+    while ( !small.empty() && !large.empty() ) {
+        size_t s = small.back();
+        size_t l = large.back();
+        small.pop_back();
+        entries[s].keep = scaled[s];
+        entries[s].alias = l;
+        scaled[l] -= 1 - scaled[s];
+        if ( scaled[l] < 1 ) {
+            large.pop_back();
+            small.push_back( l );
+        }
+    }
+
+    // whatever is left is full, up to rounding, except entries that can
+    // never be picked. those always take the likeliest entry instead, so
+    // no sample comes back with a pdf of zero.
+    size_t likeliest = 0;
+    for ( size_t i = 1; i < count; ++i ) {
+        if ( entries[i].pdf > entries[likeliest].pdf )
+            likeliest = i;
+    }
+    for ( size_t i = 0; i < small.size(); ++i ) {
+        Entry& entry = entries[small[i]];
+        if ( entry.pdf > 0 ) {
+            entry.keep = 1;
+        } else {
+            entry.keep = 0;
+            entry.alias = likeliest;
+        }
+    }
+    for ( size_t i = 0; i < large.size(); ++i ) {
+        entries[large[i]].keep = 1;
+    }
+}
+
+void AliasTable::clear()
+{
+    entries.clear();
+}
+
+size_t AliasTable::sample( real_t u, real_t* pdf ) const
+{
+    // the integer part picks an entry, the fraction decides whether to
+    // keep it or take its alias
+    real_t scaled = u * entries.size();
+    size_t index = std::min( size_t( scaled ), entries.size() - 1 );
+    real_t frac = scaled - index;
+    if ( frac >= entries[index].keep )
+        index = entries[index].alias;
+    *pdf = entries[index].pdf;
+    return index;
+}
+
+} /* _462 */
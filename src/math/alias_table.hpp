@@ -0,0 +1,58 @@
+/**
+ * @file alias_table.hpp
+ * @brief Constant time sampling from a discrete distribution.
+ */
+
+#ifndef _462_MATH_ALIAS_TABLE_HPP_
+#define _462_MATH_ALIAS_TABLE_HPP_
+
+#include "math/math.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Picks indices with probability proportional to given weights, in
+ * constant time per sample (Walker's alias method, built with Vose's
+ * algorithm in linear time).
+ */
+class AliasTable
+{
+public:
+
+    /**
+     * Builds the table. Negative weights count as zero. If every weight
+     * is zero, all indices are equally likely.
+     */
+    void build( const real_t* weights, size_t count );
+
+    void clear();
+    bool empty() const { return entries.empty(); }
+    size_t size() const { return entries.size(); }
+
+    /**
+     * Picks an index using one uniform number in [0, 1).
+     * @param pdf Set to the probability of the index picked.
+     */
+    size_t sample( real_t u, real_t* pdf ) const;
+
+    /// Returns the probability of picking an index.
+    real_t get_pdf( size_t index ) const { return entries[index].pdf; }
+
+private:
+
+    struct Entry
+    {
+        // chance of keeping this index rather than taking its alias
+        real_t keep;
+        size_t alias;
+        real_t pdf;
+    };
+
+    std::vector< Entry > entries;
+};
+
+} /* _462 */
+
+#endif /* _462_MATH_ALIAS_TABLE_HPP_ */
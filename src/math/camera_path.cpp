@@ -0,0 +1,76 @@
+/**
+ * @file camera_path.cpp
+ * @brief A keyframed camera path.
+ */
+
+#include "math/camera_path.hpp"
+
+namespace _462 {
+
+CameraPath::CameraPath() { }
+
+CameraPath::~CameraPath() { }
+
+void CameraPath::add_keyframe( const Keyframe& key )
+{
+    KeyframeList::iterator i = keyframes.begin();
+    while ( i != keyframes.end() && i->time < key.time )
+        ++i;
+
+    if ( i != keyframes.end() && i->time == key.time )
+        *i = key;
+    else
+        keyframes.insert( i, key );
+}
+
+void CameraPath::clear()
+{
+    keyframes.clear();
+}
+
+const CameraPath::Keyframe* CameraPath::get_keyframes() const
+{
+    return keyframes.empty() ? NULL : &keyframes[0];
+}
+
+real_t CameraPath::start_time() const
+{
+    return keyframes.empty() ? 0 : keyframes.front().time;
+}
+
+real_t CameraPath::end_time() const
+{
+    return keyframes.empty() ? 0 : keyframes.back().time;
+}
+
+void CameraPath::evaluate( real_t time, Camera* camera ) const
+{
+    if ( keyframes.empty() )
+        return;
+
+    if ( time <= keyframes.front().time ) {
+        camera->position = keyframes.front().position;
+        camera->orientation = keyframes.front().orientation;
+        return;
+    }
+    if ( time >= keyframes.back().time ) {
+        camera->position = keyframes.back().position;
+        camera->orientation = keyframes.back().orientation;
+        return;
+    }
+
+    // find the first keyframe after the given time; paths are short, so a
+    // linear search is fine
+    size_t next = 1;
+    while ( keyframes[next].time <= time )
+        ++next;
+
+    const Keyframe& a = keyframes[next - 1];
+    const Keyframe& b = keyframes[next];
+    real_t t = ( time - a.time ) / ( b.time - a.time );
+
+    camera->position = a.position + ( b.position - a.position ) * t;
+    camera->orientation = slerp( a.orientation, b.orientation, t );
+}
+
+} /* _462 */
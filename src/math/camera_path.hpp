@@ -0,0 +1,70 @@
+/**
+ * @file camera_path.hpp
+ * @brief A keyframed camera path.
+ */
+
+#ifndef _462_MATH_CAMERA_PATH_HPP_
+#define _462_MATH_CAMERA_PATH_HPP_
+
+#include "math/camera.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/**
+ * A sequence of camera poses at increasing times. Positions are linearly
+ * interpolated and orientations are spherically interpolated between the
+ * two keyframes surrounding a given time.
+ */
+class CameraPath
+{
+public:
+
+    struct Keyframe
+    {
+        real_t time;
+        Vector3 position;
+        Quaternion orientation;
+    };
+
+    CameraPath();
+    ~CameraPath();
+
+    /**
+     * Adds a keyframe, keeping the path sorted by time. A keyframe at the
+     * same time as an existing one replaces it.
+     */
+    void add_keyframe( const Keyframe& key );
+
+    /// Removes all keyframes.
+    void clear();
+
+    bool empty() const { return keyframes.empty(); }
+    size_t num_keyframes() const { return keyframes.size(); }
+    /// The keyframes, sorted by time.
+    const Keyframe* get_keyframes() const;
+
+    /// Time of the first keyframe, or 0 if the path is empty.
+    real_t start_time() const;
+    /// Time of the last keyframe, or 0 if the path is empty.
+    real_t end_time() const;
+
+    /**
+     * Sets the position and orientation of the camera to the pose at the
+     * given time. Times outside the path are clamped to its ends. Other
+     * camera parameters (field of view, clipping planes) are left alone.
+     * Does nothing if the path is empty.
+     */
+    void evaluate( real_t time, Camera* camera ) const;
+
+private:
+
+    typedef std::vector< Keyframe > KeyframeList;
+
+    KeyframeList keyframes;
+};
+
+} /* _462 */
+
+#endif /* _462_MATH_CAMERA_PATH_HPP_ */
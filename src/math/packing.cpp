@@ -0,0 +1,120 @@
+/**
+ * @file packing.cpp
+ * @brief Compact encodings of unit vectors and floats.
+ */
+
+#include "math/packing.hpp"
+
+#include <cstring>
+
+namespace _462 {
+
+// largest value of a 16-bit signed fixed point component
+#define SNORM16_MAX 32767
+
+static real_t sign_not_zero( real_t x )
+{
+    return x >= 0 ? 1.0 : -1.0;
+}
+
+unsigned int pack_unit_vector( const Vector3& v )
+{
+    real_t sum = fabs( v.x ) + fabs( v.y ) + fabs( v.z );
+    // written this way so that NaN is caught too
+    if ( !( sum > 0 ) )
+        return pack_unit_vector( Vector3::UnitZ );
+
+    real_t x = v.x / sum;
+    real_t y = v.y / sum;
+    if ( v.z < 0 ) {
+        real_t fx = ( 1 - fabs( y ) ) * sign_not_zero( x );
+        real_t fy = ( 1 - fabs( x ) ) * sign_not_zero( y );
+        x = fx;
+        y = fy;
+    }
+
+    int qx = int( floor( clamp( x, -1.0, 1.0 ) * SNORM16_MAX + 0.5 ) );
+    int qy = int( floor( clamp( y, -1.0, 1.0 ) * SNORM16_MAX + 0.5 ) );
+    return ( unsigned int )( unsigned short )( short )qx
+        | ( ( unsigned int )( unsigned short )( short )qy << 16 );
+}
+
+Vector3 unpack_unit_vector( unsigned int packed )
+{
+    real_t x = real_t( short( packed & 0xffff ) ) / SNORM16_MAX;
+    real_t y = real_t( short( packed >> 16 ) ) / SNORM16_MAX;
+    real_t z = 1 - fabs( x ) - fabs( y );
+    if ( z < 0 ) {
+        real_t fx = ( 1 - fabs( y ) ) * sign_not_zero( x );
+        real_t fy = ( 1 - fabs( x ) ) * sign_not_zero( y );
+        x = fx;
+        y = fy;
+    }
+    return normalize( Vector3( x, y, z ) );
+}
+
+unsigned short pack_half( float f )
+{
+    unsigned int bits;
+    memcpy( &bits, &f, sizeof bits );
+
+    unsigned int sign = ( bits >> 16 ) & 0x8000;
+    int exponent = int( ( bits >> 23 ) & 0xff ) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    if ( ( ( bits >> 23 ) & 0xff ) == 0xff ) {
+        // infinity stays infinity, NaN stays NaN
+        return sign | 0x7c00 | ( mantissa ? 0x200 : 0 );
+    } else if ( exponent >= 31 ) {
+        return sign | 0x7c00;
+    } else if ( exponent <= 0 ) {
+        // subnormal, or too small for even that
+        if ( exponent < -10 )
+            return sign;
+        mantissa |= 0x800000;
+        unsigned int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rest = mantissa & ( ( 1u << shift ) - 1 );
+        unsigned int halfway = 1u << ( shift - 1 );
+        if ( rest > halfway || ( rest == halfway && ( half & 1 ) ) )
+            ++half;
+        return sign | half;
+    }
+
+    unsigned int half = ( exponent << 10 ) | ( mantissa >> 13 );
+    unsigned int rest = mantissa & 0x1fff;
+    // rounding up may carry into the exponent, which is still right
+    if ( rest > 0x1000 || ( rest == 0x1000 && ( half & 1 ) ) )
+        ++half;
+    return sign | half;
+}
+
+float unpack_half( unsigned short h )
+{
+    unsigned int sign = ( h & 0x8000u ) << 16;
+    unsigned int exponent = ( h >> 10 ) & 0x1f;
+    unsigned int mantissa = h & 0x3ff;
+    unsigned int bits;
+
+    if ( exponent == 0x1f ) {
+        bits = sign | 0x7f800000 | ( mantissa << 13 );
+    } else if ( exponent != 0 ) {
+        bits = sign | ( ( exponent - 15 + 127 ) << 23 ) | ( mantissa << 13 );
+    } else if ( mantissa == 0 ) {
+        bits = sign;
+    } else {
+        // subnormal, so normalize it
+        exponent = 127 - 15 + 1;
+        while ( !( mantissa & 0x400 ) ) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        bits = sign | ( exponent << 23 ) | ( ( mantissa & 0x3ff ) << 13 );
+    }
+
+    float f;
+    memcpy( &f, &bits, sizeof f );
+    return f;
+}
+
+} /* _462 */
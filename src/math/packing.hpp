@@ -0,0 +1,36 @@
+/**
+ * @file packing.hpp
+ * @brief Compact encodings of unit vectors and floats.
+ */
+
+#ifndef _462_MATH_PACKING_HPP_
+#define _462_MATH_PACKING_HPP_
+
+#include "math/vector.hpp"
+
+namespace _462 {
+
+/**
+ * Packs a unit vector into 32 bits with the octahedral mapping: the vector
+ * is projected onto the octahedron |x| + |y| + |z| = 1, the lower half is
+ * folded over the upper, and the result stored as two 16-bit fixed point
+ * numbers. The error is below 1e-4 radians everywhere. Zero or invalid
+ * vectors are stored as +z.
+ */
+unsigned int pack_unit_vector( const Vector3& v );
+
+/// Unpacks a vector packed by pack_unit_vector, normalized.
+Vector3 unpack_unit_vector( unsigned int packed );
+
+/**
+ * Packs a number into an IEEE 754 half precision float, rounding to
+ * nearest. Numbers too large become infinite.
+ */
+unsigned short pack_half( float f );
+
+/// Unpacks a half precision float.
+float unpack_half( unsigned short h );
+
+} /* _462 */
+
+#endif /* _462_MATH_PACKING_HPP_ */
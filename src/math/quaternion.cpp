@@ -181,6 +181,38 @@ Quaternion conjugate( const Quaternion& q )
     return Quaternion( q.w, -q.x, -q.y, -q.z );
 }
 
+Quaternion slerp( const Quaternion& a, const Quaternion& b, real_t t )
+{
+    // below this angle, fall back to linear interpolation to avoid
+    // dividing by a tiny sine
+    static const real_t EPSILON = 1e-6;
+
+    real_t cosine = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+    Quaternion end = b;
+
+    // q and -q are the same rotation, so go the short way around
+    if ( cosine < 0.0 ) {
+        cosine = -cosine;
+        end = b * -1.0;
+    }
+
+    real_t wa, wb;
+    if ( 1.0 - cosine > EPSILON ) {
+        real_t angle = acos( cosine );
+        real_t inv_sine = 1.0 / sin( angle );
+        wa = sin( ( 1.0 - t ) * angle ) * inv_sine;
+        wb = sin( t * angle ) * inv_sine;
+    } else {
+        wa = 1.0 - t;
+        wb = t;
+    }
+
+    return normalize( Quaternion( wa * a.w + wb * end.w,
+                                  wa * a.x + wb * end.x,
+                                  wa * a.y + wb * end.y,
+                                  wa * a.z + wb * end.z ) );
+}
+
 std::ostream& operator <<( std::ostream& o, const Quaternion& q )
 {
     o << "Quaternion(" << q.w << ", " << q.x << ", " << q.y << ", " << q.z << ")";
@@ -137,6 +137,12 @@ Quaternion normalize( const Quaternion& q );
 
 Quaternion conjugate( const Quaternion& q );
 
+/**
+ * Spherical linear interpolation between two unit quaternions, taking the
+ * shortest path. Returns a when t is 0 and (a rotation equal to) b when t is 1.
+ */
+Quaternion slerp( const Quaternion& a, const Quaternion& b, real_t t );
+
 std::ostream& operator <<( std::ostream& o, const Quaternion& q );
 
 } /* _462 */
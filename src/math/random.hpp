@@ -0,0 +1,68 @@
+/**
+ * @file random.hpp
+ * @brief A small, fast pseudorandom number generator.
+ */
+
+#ifndef _462_MATH_RANDOM_HPP_
+#define _462_MATH_RANDOM_HPP_
+
+#include "math/math.hpp"
+
+namespace _462 {
+
+/**
+ * A xorshift128 generator. Cheap to seed and to copy, so each pixel can
+ * have its own generator seeded from its coordinates, which keeps images
+ * reproducible no matter the order pixels are traced in.
+ */
+class Random
+{
+public:
+
+    explicit Random( unsigned int seed = 0 ) { set_seed( seed ); }
+
+    /// Restarts the sequence from the given seed.
+    void set_seed( unsigned int seed ) {
+        // spread the seed over the state, which must not be all zero
+        x = hash( seed );
+        y = hash( x ^ 0x9e3779b9u );
+        z = hash( y ^ 0x9e3779b9u );
+        w = hash( z ^ 0x9e3779b9u ) | 1;
+    }
+
+    /// Returns a uniformly distributed 32-bit integer.
+    unsigned int next_uint() {
+        unsigned int t = x ^ ( x << 11 );
+        x = y;
+        y = z;
+        z = w;
+        w = w ^ ( w >> 19 ) ^ t ^ ( t >> 8 );
+        return w;
+    }
+
+    /// Returns a uniformly distributed number in [0, 1).
+    real_t next_real() {
+        return next_uint() * ( 1.0 / 4294967296.0 );
+    }
+
+    /**
+     * Mixes the bits of an integer, e.g. to combine pixel coordinates
+     * into a seed: hash( x ^ hash( y ) ).
+     */
+    static unsigned int hash( unsigned int v ) {
+        v ^= v >> 16;
+        v *= 0x7feb352du;
+        v ^= v >> 15;
+        v *= 0x846ca68bu;
+        v ^= v >> 16;
+        return v;
+    }
+
+private:
+
+    unsigned int x, y, z, w;
+};
+
+} /* _462 */
+
+#endif /* _462_MATH_RANDOM_HPP_ */
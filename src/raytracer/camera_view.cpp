@@ -0,0 +1,130 @@
+/**
+ * @file camera_view.cpp
+ * @brief The rays of a camera through an image, and back again.
+ */
+
+#include "raytracer/camera_view.hpp"
+#include "math/camera.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace _462 {
+
+CameraView::CameraView()
+    : width( 0 ), height( 0 ), near_distance( 0 ), alpha( 0 ), beta( 0 ) { }
+
+CameraView::CameraView( const Camera& camera, size_t width, size_t height )
+    : width( width ), height( height )
+{
+    eye = camera.get_position();
+    forward = camera.get_direction();
+    up = camera.get_up();
+    left = normalize( cross( up, forward ) );
+    near_distance = fabs( camera.get_near_clip() );
+    near_center = eye + ( forward * near_distance );
+    alpha = near_distance * tan( camera.get_fov_radians() / 2 );
+    beta = camera.get_aspect_ratio() * alpha;
+}
+
+ray_t CameraView::get_ray( real_t x, real_t y ) const
+{
+    // horizontal and vertical position on the near plane, from -1 to 1
+    real_t h = ( ( x / width ) - 0.5 ) * 2.0;
+    real_t v = ( ( y / height ) - 0.5 ) * 2.0;
+
+    Vector3 s = near_center + ( alpha * v * up ) - ( beta * h * left );
+
+    ray_t ray;
+    ray.eye = eye;
+    ray.direction = normalize( s - eye );
+    ray.end = s;
+    return ray;
+}
+
+bool CameraView::project( const Vector3& point, real_t* x, real_t* y ) const
+{
+    return project_direction( point - eye, x, y );
+}
+
+bool CameraView::project_direction( const Vector3& direction, real_t* x, real_t* y ) const
+{
+    real_t z = dot( direction, forward );
+    if ( z <= 0 )
+        return false;
+
+    // where the direction crosses the near plane, relative to the eye
+    Vector3 s = direction * ( near_distance / z );
+    real_t h = -dot( s, left ) / beta;
+    real_t v = dot( s, up ) / alpha;
+
+    *x = ( h * 0.5 + 0.5 ) * width;
+    *y = ( v * 0.5 + 0.5 ) * height;
+    return true;
+}
+
+void reproject_image( const CameraView& from, const unsigned char* colors, const float* depths,
+                      const CameraView& to, unsigned char* out, float* out_depths,
+                      const Color3& fill )
+{
+    const float infinity = std::numeric_limits< float >::infinity();
+    int out_width = int( to.get_width() );
+    int out_height = int( to.get_height() );
+
+    unsigned char fill_color[4];
+    fill.to_array( fill_color );
+    for ( int i = 0; i < out_width * out_height; ++i ) {
+        memcpy( &out[4 * i], fill_color, 4 );
+        out_depths[i] = infinity;
+    }
+
+    // the size of a pixel of from in the new image
+    real_t block_width = real_t( out_width ) / from.get_width();
+    real_t block_height = real_t( out_height ) / from.get_height();
+
+    for ( size_t y = 0; y < from.get_height(); ++y ) {
+        for ( size_t x = 0; x < from.get_width(); ++x ) {
+            size_t index = y * from.get_width() + x;
+            Vector3 direction = from.get_ray( x, y ).direction;
+
+            // the hit, relative to the new eye, or the direction of a miss
+            float depth = depths[index];
+            if ( depth < infinity ) {
+                direction = from.get_eye() + direction * depth - to.get_eye();
+            }
+
+            real_t new_x, new_y;
+            if ( !to.project_direction( direction, &new_x, &new_y ) )
+                continue;
+            if ( depth < infinity ) {
+                depth = float( length( direction ) );
+            }
+
+            // skip what lands off the image, which may be too far away
+            // to convert to int
+            if ( new_x < -block_width || new_x >= out_width || new_y < -block_height || new_y >= out_height )
+                continue;
+
+            // round to the nearest pixel, so that views differing only in
+            // resolution line up exactly
+            int x_begin = std::max( int( floor( new_x + 0.5 ) ), 0 );
+            int y_begin = std::max( int( floor( new_y + 0.5 ) ), 0 );
+            int x_end = std::min( std::max( int( floor( new_x + block_width + 0.5 ) ), x_begin + 1 ), out_width );
+            int y_end = std::min( std::max( int( floor( new_y + block_height + 0.5 ) ), y_begin + 1 ), out_height );
+
+            // the nearest wins. misses only cover fill and other misses.
+            for ( int j = y_begin; j < y_end; ++j ) {
+                for ( int i = x_begin; i < x_end; ++i ) {
+                    int out_index = j * out_width + i;
+                    if ( depth <= out_depths[out_index] ) {
+                        out_depths[out_index] = depth;
+                        memcpy( &out[4 * out_index], &colors[4 * index], 4 );
+                    }
+                }
+            }
+        }
+    }
+}
+
+} /* _462 */
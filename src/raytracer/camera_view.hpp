@@ -0,0 +1,85 @@
+/**
+ * @file camera_view.hpp
+ * @brief The rays of a camera through an image, and back again.
+ */
+
+#ifndef _462_RAYTRACER_CAMERA_VIEW_HPP_
+#define _462_RAYTRACER_CAMERA_VIEW_HPP_
+
+#include "math/color.hpp"
+#include "math/vector.hpp"
+#include "raytracer/ray.hpp"
+
+namespace _462 {
+
+class Camera;
+
+/**
+ * A camera fixed for an image of a given size. Image points are measured in
+ * pixels from the bottom left corner, and pixel (x, y) is traced through
+ * point (x, y). Captured once per raytrace so the camera basis is not
+ * rebuilt for every ray, and kept afterwards so that an image can be
+ * warped to the next view.
+ */
+class CameraView
+{
+public:
+
+    CameraView();
+    CameraView( const Camera& camera, size_t width, size_t height );
+
+    size_t get_width() const { return width; }
+    size_t get_height() const { return height; }
+    const Vector3& get_eye() const { return eye; }
+
+    /// Returns the ray through image point (x, y).
+    ray_t get_ray( real_t x, real_t y ) const;
+
+    /**
+     * Finds the image point at which a world space point is seen, the
+     * inverse of get_ray. The point may be outside the image.
+     * @return false if the point is not in front of the eye.
+     */
+    bool project( const Vector3& point, real_t* x, real_t* y ) const;
+
+    /**
+     * Finds the image point at which something infinitely far away in the
+     * given direction is seen.
+     * @return false if the direction does not point in front of the eye.
+     */
+    bool project_direction( const Vector3& direction, real_t* x, real_t* y ) const;
+
+private:
+
+    size_t width, height;
+    Vector3 eye;
+    Vector3 forward;
+    Vector3 up;
+    Vector3 left;
+    // distance from the eye to the near plane, and the center of the plane
+    real_t near_distance;
+    Vector3 near_center;
+    // half the height and width of the near plane
+    real_t alpha, beta;
+};
+
+/**
+ * Warps an image traced from one view into another, to show until the
+ * other is traced. Each pixel is moved to where its camera ray's hit is
+ * seen from the new view, nearest first, and pixels that saw nothing move
+ * with their direction, as the background does. A pixel lands as a block
+ * as large as it is in the new image, so enlarging leaves no gaps. Pixels
+ * nothing lands on are set to fill.
+ * @param colors The 32-bit RGBA image traced from view from.
+ * @param depths The distance to each pixel's hit, infinite for misses.
+ * @param out The 32-bit RGBA image of view to.
+ * @param out_depths Set to the distance from view to's eye to what each
+ *  pixel shows, infinite for misses and fill.
+ */
+void reproject_image( const CameraView& from, const unsigned char* colors, const float* depths,
+                      const CameraView& to, unsigned char* out, float* out_depths,
+                      const Color3& fill );
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_CAMERA_VIEW_HPP_ */
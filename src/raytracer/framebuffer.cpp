@@ -0,0 +1,58 @@
+/**
+ * @file framebuffer.cpp
+ * @brief High dynamic range accumulation buffer.
+ */
+
+#include "raytracer/framebuffer.hpp"
+
+#include <algorithm>
+
+namespace _462 {
+
+Framebuffer::Framebuffer()
+    : width( 0 ), height( 0 ) { }
+
+Framebuffer::~Framebuffer() { }
+
+void Framebuffer::resize( size_t width, size_t height )
+{
+    this->width = width;
+    this->height = height;
+    pixels.assign( 4 * width * height, 0.0f );
+}
+
+void Framebuffer::clear()
+{
+    std::fill( pixels.begin(), pixels.end(), 0.0f );
+}
+
+void Framebuffer::clear( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end )
+{
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        std::fill( pixels.begin() + 4 * ( y * width + x_begin ),
+                   pixels.begin() + 4 * ( y * width + x_end ), 0.0f );
+    }
+}
+
+void Framebuffer::tonemap( unsigned char* buffer, size_t x_begin, size_t x_end,
+                           size_t row_begin, size_t row_end ) const
+{
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x ) {
+            get_pixel( x, y ).to_array( &buffer[4 * ( y * width + x )] );
+        }
+    }
+}
+
+void Framebuffer::resolve( float* rgb, size_t x_begin, size_t x_end,
+                          size_t row_begin, size_t row_end ) const
+{
+    size_t block_width = x_end - x_begin;
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x ) {
+            get_pixel( x, y ).to_array( &rgb[3 * ( ( y - row_begin ) * block_width + x - x_begin )] );
+        }
+    }
+}
+
+} /* _462 */
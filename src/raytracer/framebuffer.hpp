@@ -0,0 +1,100 @@
+/**
+ * @file framebuffer.hpp
+ * @brief High dynamic range accumulation buffer.
+ */
+
+#ifndef _462_RAYTRACER_FRAMEBUFFER_HPP_
+#define _462_RAYTRACER_FRAMEBUFFER_HPP_
+
+#include "math/color.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/**
+ * An unclamped floating point image that accumulates any number of weighted
+ * samples per pixel. Rows are stored bottom to top, matching the 8-bit
+ * buffers used elsewhere.
+ *
+ * The raytracer writes samples here at full precision; quantizing to 8 bits
+ * is a separate pass (tonemap) so nothing is lost before output.
+ */
+class Framebuffer
+{
+public:
+
+    Framebuffer();
+    ~Framebuffer();
+
+    /// Resizes the buffer and clears it.
+    void resize( size_t width, size_t height );
+
+    /// Sets every pixel back to having no samples.
+    void clear();
+
+    /// Like clear() above, but only for columns [x_begin, x_end) of rows
+    /// [row_begin, row_end).
+    void clear( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end );
+
+    size_t get_width() const { return width; }
+    size_t get_height() const { return height; }
+
+    /// Adds a sample with the given weight to pixel (x, y).
+    void add_sample( size_t x, size_t y, const Color3& color, real_t weight = 1.0 ) {
+        float* p = &pixels[4 * ( y * width + x )];
+        p[0] += float( color.r * weight );
+        p[1] += float( color.g * weight );
+        p[2] += float( color.b * weight );
+        p[3] += float( weight );
+    }
+
+    /// Returns the weighted mean of the samples at (x, y), or black if none.
+    Color3 get_pixel( size_t x, size_t y ) const {
+        const float* p = &pixels[4 * ( y * width + x )];
+        if ( p[3] <= 0 )
+            return Color3::Black;
+        real_t inv = 1.0 / p[3];
+        return Color3( p[0] * inv, p[1] * inv, p[2] * inv );
+    }
+
+    /**
+     * Clamps and quantizes rows [row_begin, row_end) into a 32-bit RGBA
+     * buffer of the same dimensions, with alpha 1.
+     */
+    void tonemap( unsigned char* buffer, size_t row_begin, size_t row_end ) const {
+        tonemap( buffer, 0, width, row_begin, row_end );
+    }
+
+    /// Like tonemap() above, but only for columns [x_begin, x_end).
+    void tonemap( unsigned char* buffer, size_t x_begin, size_t x_end,
+                  size_t row_begin, size_t row_end ) const;
+
+    /**
+     * Writes the mean of each pixel as 3 floats (RGB) per pixel into
+     * rgb, which must have room for 3 * width * height floats.
+     */
+    void resolve( float* rgb ) const {
+        resolve( rgb, 0, width, 0, height );
+    }
+
+    /**
+     * Like resolve() above, but only for columns [x_begin, x_end) of rows
+     * [row_begin, row_end), written as a block of x_end - x_begin pixels
+     * per row.
+     */
+    void resolve( float* rgb, size_t x_begin, size_t x_end,
+                  size_t row_begin, size_t row_end ) const;
+
+private:
+
+    typedef std::vector< float > PixelList;
+
+    size_t width, height;
+    // per pixel: weighted sums of r, g, b followed by the sum of weights
+    PixelList pixels;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_FRAMEBUFFER_HPP_ */
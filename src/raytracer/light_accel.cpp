@@ -0,0 +1,99 @@
+/**
+ * @file light_accel.cpp
+ * @brief Finds the lights that can reach a point.
+ */
+
+#include "raytracer/light_accel.hpp"
+#include "scene/scene.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace _462 {
+
+const real_t LightAccel::CUTOFF = 1.0 / 1024;
+
+real_t LightAccel::attenuation( const PointLight& light, real_t distance )
+{
+    const PointLight::Attenuation& a = light.attenuation;
+    return a.constant + a.linear * distance + a.constant * distance * distance;
+}
+
+real_t LightAccel::influence_radius( const PointLight& light )
+{
+    // the diffuse term is color * dot( normal, to_light ) / attenuation,
+    // where to_light is not normalized, so a light adds at most
+    // intensity * d / attenuation( d ) at distance d. find where that
+    // drops below the cutoff for good, i.e. the larger root of
+    // c * CUTOFF * d^2 + ( l * CUTOFF - intensity ) * d + c * CUTOFF.
+    real_t intensity = std::max( light.color.r, std::max( light.color.g, light.color.b ) );
+    real_t a = light.attenuation.constant * CUTOFF;
+    real_t b = light.attenuation.linear * CUTOFF - intensity;
+
+    if ( intensity <= 0 )
+        return 0;
+
+    // without a quadratic term the contribution never falls off
+    if ( a <= 0 )
+        return b <= 0 ? std::numeric_limits< real_t >::infinity() : 0;
+
+    real_t disc = b * b - 4 * a * a;
+    if ( b >= 0 || disc < 0 )
+        return 0;
+    return ( -b + sqrt( disc ) ) / ( 2 * a );
+}
+
+void LightAccel::build( const Scene* scene )
+{
+    const PointLight* lights = scene->get_lights();
+    std::vector< BoundingBox > bounds;
+    std::vector< real_t > weights( scene->num_lights() );
+
+    unbounded_lights.clear();
+    bounded_lights.clear();
+    positions.clear();
+    radii_sq.clear();
+
+    for ( size_t i = 0; i < scene->num_lights(); ++i ) {
+        const PointLight& light = lights[i];
+        real_t intensity = std::max( light.color.r, std::max( light.color.g, light.color.b ) );
+        real_t atten = attenuation( light, 1 );
+        weights[i] = atten > 0 ? intensity / atten : intensity;
+
+        real_t radius = influence_radius( lights[i] );
+        if ( radius == std::numeric_limits< real_t >::infinity() ) {
+            unbounded_lights.push_back( i );
+        } else if ( radius > 0 ) {
+            Vector3 extent( radius, radius, radius );
+            bounds.push_back( BoundingBox( lights[i].position - extent, lights[i].position + extent ) );
+            bounded_lights.push_back( i );
+        }
+    }
+
+    if ( weights.empty() ) {
+        sampler.clear();
+    } else {
+        sampler.build( &weights[0], weights.size() );
+    }
+
+    if ( bounded_lights.empty() ) {
+        bvh.clear();
+        return;
+    }
+
+    bvh.build( &bounds[0], bounds.size() );
+
+    // store the lights in leaf order so each leaf is a contiguous range
+    IndexList ordered( bounded_lights.size() );
+    const unsigned int* order = bvh.get_indices();
+    for ( size_t i = 0; i < ordered.size(); ++i ) {
+        const PointLight& light = lights[bounded_lights[order[i]]];
+        real_t radius = influence_radius( light );
+        ordered[i] = bounded_lights[order[i]];
+        positions.push_back( light.position );
+        radii_sq.push_back( radius * radius );
+    }
+    bounded_lights.swap( ordered );
+}
+
+} /* _462 */
@@ -0,0 +1,133 @@
+/**
+ * @file light_accel.hpp
+ * @brief Finds the lights that can reach a point.
+ */
+
+#ifndef _462_RAYTRACER_LIGHT_ACCEL_HPP_
+#define _462_RAYTRACER_LIGHT_ACCEL_HPP_
+
+#include "math/vector.hpp"
+#include "math/alias_table.hpp"
+#include "scene/bvh.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+class Scene;
+struct PointLight;
+
+/**
+ * Culls point lights by distance. Each light is given an influence radius
+ * from its color and attenuation, beyond which it adds less than
+ * LightAccel::CUTOFF to any surface. Lights with a finite radius are kept
+ * in a hierarchy over the spheres they reach, so finding the lights that
+ * reach a point does not look at every light in the scene.
+ *
+ * For scenes with too many overlapping lights to shade them all, lights
+ * can instead be sampled at random with probability proportional to their
+ * estimated power.
+ */
+class LightAccel
+{
+public:
+
+    /**
+     * The largest contribution a light may have outside its radius: a
+     * quarter of one level of an 8-bit output channel.
+     */
+    static const real_t CUTOFF;
+
+    /**
+     * Returns the factor dividing a light's color at the given distance.
+     * The quadratic term scales with the constant coefficient, which
+     * existing scenes are tuned for.
+     */
+    static real_t attenuation( const PointLight& light, real_t distance );
+
+    /**
+     * Returns the distance past which the light adds less than CUTOFF,
+     * assuming surface colors of at most one. Infinite for lights whose
+     * attenuation does not grow with distance, and 0 for lights that never
+     * add more than CUTOFF.
+     */
+    static real_t influence_radius( const PointLight& light );
+
+    /// Rebuilds the structure over the scene's lights.
+    void build( const Scene* scene );
+
+    /**
+     * Invokes visitor( light_index ) for every light whose influence
+     * radius covers the point. Lights with infinite radius come first, in
+     * scene order.
+     */
+    template< typename Visitor >
+    void traverse( const Vector3& point, Visitor& visitor ) const;
+
+    /**
+     * Picks a light index at random, with probability proportional to the
+     * light's brightest channel over its attenuation at unit distance.
+     * Every light that can add anything has a nonzero chance.
+     * @param u A uniform random number in [0, 1).
+     * @param pdf Set to the probability of the light picked.
+     * @return The index of the light; there must be at least one.
+     */
+    unsigned int sample( real_t u, real_t* pdf ) const {
+        return (unsigned int) sampler.sample( u, pdf );
+    }
+
+    /// Returns true if there are any lights to sample.
+    bool can_sample() const { return !sampler.empty(); }
+
+private:
+
+    typedef std::vector< unsigned int > IndexList;
+
+    // adapts a per-light visitor to a per-leaf one, checking each light's
+    // actual sphere rather than its box
+    template< typename Visitor >
+    struct LeafVisitor
+    {
+        const LightAccel* accel;
+        const Vector3* point;
+        Visitor* visitor;
+
+        void operator()( unsigned int first, unsigned int count ) {
+            for ( unsigned int i = first; i < first + count; ++i ) {
+                if ( squared_distance( *point, accel->positions[i] ) <= accel->radii_sq[i] )
+                    ( *visitor )( accel->bounded_lights[i] );
+            }
+        }
+    };
+
+    // lights that reach everywhere
+    IndexList unbounded_lights;
+
+    // lights with a finite radius, in the leaf order of bvh
+    IndexList bounded_lights;
+    // position and squared radius of each of bounded_lights
+    std::vector< Vector3 > positions;
+    std::vector< real_t > radii_sq;
+    Bvh bvh;
+
+    // distribution over all lights for sampling
+    AliasTable sampler;
+};
+
+template< typename Visitor >
+void LightAccel::traverse( const Vector3& point, Visitor& visitor ) const
+{
+    for ( size_t i = 0; i < unbounded_lights.size(); ++i ) {
+        visitor( unbounded_lights[i] );
+    }
+
+    LeafVisitor< Visitor > leaf_visitor;
+    leaf_visitor.accel = this;
+    leaf_visitor.point = &point;
+    leaf_visitor.visitor = &visitor;
+    bvh.traverse_point( point, leaf_visitor );
+}
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_LIGHT_ACCEL_HPP_ */
@@ -9,18 +9,33 @@
 #include "application/application.hpp"
 #include "application/camera_roam.hpp"
 #include "application/imageio.hpp"
+#include "application/image_writer.hpp"
 #include "application/scene_loader.hpp"
+#include "application/scene_binary.hpp"
 #include "application/opengl.hpp"
 #include "scene/scene.hpp"
+#include "scene/mesh_clusters.hpp"
 #include "raytracer/raytracer.hpp"
+#include "raytracer/preview_controller.hpp"
+#include "raytracer/render_farm.hpp"
+
+#include <SDL/SDL_timer.h>
 
 #include <iostream>
+#include <cstdio>
 #include <cstring>
+#include <string>
+#include <vector>
 
 namespace _462 {
 
 #define DEFAULT_WIDTH 800
 #define DEFAULT_HEIGHT 600
+#define DEFAULT_FPS 30.0
+
+// the least fraction of the image a camera move must reuse from the last
+// raytrace to go on at full resolution rather than from a coarse preview
+#define MIN_REUSED_FRACTION 0.5
 
 #define BUFFER_SIZE(w,h) ( (size_t) ( 4 * (w) * (h) ) )
 
@@ -50,6 +65,32 @@ struct Options
     const char* output_filename;
     // window dimensions
     int width, height;
+    // number of frames of the camera path to render, 0 for a still image
+    int num_frames;
+    // zlib level for saved images, negative for the default
+    int compression_level;
+    // whether to convert the scene to a binary scene instead of rendering
+    bool convert;
+    // lights sampled per shading point, 0 to shade all of them
+    int light_samples;
+    // passes over each image, averaged together
+    int num_passes;
+    // whether to trace reflections breadth first
+    bool wavefront;
+    // whether to path trace instead of raytracing
+    bool path_tracing;
+    // whether to convert the input mesh to a cluster file instead of rendering
+    bool cluster;
+    // memory for the clusters of each out-of-core mesh, in megabytes
+    int cluster_budget;
+    // the only rectangle of the image to raytrace, in pixels from its top
+    // left corner, or 0 width for the whole image
+    int crop_x, crop_y, crop_width, crop_height;
+    // directory shared with the other processes of a distributed render,
+    // or null to render alone
+    const char* farm_directory;
+    // whether to trace tiles for a coordinator rather than be one
+    bool farm_worker;
 };
 
 class RaytracerApplication : public Application
@@ -57,7 +98,24 @@ class RaytracerApplication : public Application
 public:
 
     RaytracerApplication( const Options& opt )
-        : options( opt ), buffer( 0 ), buf_width( 0 ), buf_height( 0 ), raytracing( false ) { }
+        : options( opt ), buffer( 0 ), buf_width( 0 ), buf_height( 0 ),
+          raytrace_width( 0 ), raytrace_height( 0 ), preview_scale( 1 ),
+          frame_period( 1.0 / DEFAULT_FPS ), raytracing( false ) {
+        raytracer.set_light_samples( opt.light_samples );
+        raytracer.set_num_passes( opt.num_passes );
+        raytracer.set_wavefront( opt.wavefront );
+        raytracer.set_path_tracing( opt.path_tracing );
+        // only the interactive viewer moves the camera between raytraces
+        // of the same scene
+        raytracer.set_reprojection( opt.open_window );
+        if ( opt.crop_width > 0 ) {
+            // rows are counted from the bottom
+            int row = opt.height - opt.crop_y - opt.crop_height;
+            raytracer.set_crop_window( opt.crop_x, opt.crop_x + opt.crop_width,
+                                       row, row + opt.crop_height );
+        }
+        ClusteredMesh::cache_budget = size_t( opt.cluster_budget ) * 1024 * 1024;
+    }
     virtual ~RaytracerApplication() { free( buffer ); }
 
     virtual bool initialize();
@@ -68,8 +126,25 @@ public:
 
     // flips raytracing, does any necessary initialization
     void toggle_raytracing( int width, int height );
-    // writes the current raytrace buffer to the output file
-    void output_image();
+    // starts raytracing at 1 / scale of the full resolution
+    bool start_preview( int scale );
+    // allocates a full resolution image for tiles traced elsewhere, without
+    // loading the scene's meshes and textures
+    bool start_collecting( int width, int height );
+    // restarts the raytrace from the camera control's camera
+    void move_camera();
+    // writes the current raytrace buffer to the output file. images
+    // handed to the writer are only known to be saved after it finishes.
+    bool output_image();
+    // renders the scene's camera path to numbered images without a window
+    bool render_animation();
+    // writes the raytracer's unclamped image to the given file
+    bool output_hdr_image( const char* filename );
+    // writes the crop window to the given file, merged into the image
+    // already there if there is one
+    bool output_crop_image( const char* filename );
+    // prints how well the clusters of out-of-core meshes fit in memory
+    void print_cluster_stats() const;
 
     Raytracer raytracer;
 
@@ -82,10 +157,21 @@ public:
     // the camera
     CameraRoamControl camera_control;
 
+    // saves images in the background
+    ImageWriter writer;
+
     // the image buffer for raytracing
     unsigned char* buffer;
     // width and height of the buffer
     int buf_width, buf_height;
+    // width and height of the full resolution image being raytraced
+    int raytrace_width, raytrace_height;
+    // image pixels per buffer pixel along each side, 1 at full resolution
+    int preview_scale;
+    // picks preview resolutions that keep the window responsive
+    PreviewController preview;
+    // the time between frames, in seconds
+    real_t frame_period;
 // true if we are in raytrace mode.
     // if so, we raytrace and display the raytrace.
     // if false, we use normal gl rendering
@@ -161,16 +247,39 @@ bool RaytracerApplication::initialize()
 
 void RaytracerApplication::destroy()
 {
-
+    // don't exit with screenshots half written
+    writer.finish();
 }
 
 void RaytracerApplication::update( real_t delta_time )
 {
+    frame_period = delta_time;
+
     if ( raytracing ) {
-        // do part of the raytrace
+        // the camera can still be moved, and each move starts over with
+        // the coarsest preview that keeps up with the frame rate
+        camera_control.update( delta_time );
+        if ( camera_control.camera.position != scene.camera.position ||
+             camera_control.camera.orientation != scene.camera.orientation ) {
+            move_camera();
+        }
+
+        // do as much of the raytrace as fits in the frame
         if ( !raytrace_finished ) {
             assert( buffer );
-            raytrace_finished = raytracer.raytrace( buffer, &delta_time );
+            real_t budget = preview.get_budget( delta_time );
+            unsigned int start_time = SDL_GetTicks();
+            bool done = raytracer.raytrace( buffer, &budget );
+            preview.record_trace( raytracer.get_pixels_traced(), ( SDL_GetTicks() - start_time ) / 1000.0 );
+
+            // refine the preview until it is at full resolution
+            if ( done && preview_scale > 1 ) {
+                done = !start_preview( preview_scale / 2 );
+            }
+            if ( done ) {
+                raytrace_finished = true;
+                print_cluster_stats();
+            }
         }
     } else {
         // copy camera over from camera control (if not raytracing)
@@ -181,6 +290,7 @@ void RaytracerApplication::update( real_t delta_time )
 
 void RaytracerApplication::render()
 {
+    unsigned int start_time = SDL_GetTicks();
     int width, height;
 
     // query current window size, resize viewport
@@ -205,7 +315,10 @@ void RaytracerApplication::render()
         assert( buffer );
         glColor4d( 1.0, 1.0, 1.0, 1.0 );
         glRasterPos2f( -1.0f, -1.0f );
+        // previews are stretched to the size of the full image
+        glPixelZoom( float( raytrace_width ) / buf_width, float( raytrace_height ) / buf_height );
         glDrawPixels( buf_width, buf_height, GL_RGBA, GL_UNSIGNED_BYTE, &buffer[0] );
+        glPixelZoom( 1.0f, 1.0f );
 
     } else {
         // else, render the scene using opengl
@@ -213,15 +326,15 @@ void RaytracerApplication::render()
         render_scene( scene );
         glPopAttrib();
     }
+
+    preview.record_render( ( SDL_GetTicks() - start_time ) / 1000.0 );
 }
 
 void RaytracerApplication::handle_event( const SDL_Event& event )
 {
     int width, height;
 
-    if ( !raytracing ) {
-        camera_control.handle_event( this, event );
-    }
+    camera_control.handle_event( this, event );
 
     switch ( event.type )
     {
@@ -250,25 +363,19 @@ void RaytracerApplication::toggle_raytracing( int width, int height )
     // do setup if starting a new raytrace
     if ( !raytracing ) {
 
-        // only re-allocate if the dimensions changed
-        if ( buf_width != width || buf_height != height ) {
-            free( buffer );
-            buffer = (unsigned char*) malloc( BUFFER_SIZE( width, height ) );
-            if ( !buffer ) {
-                std::cout << "Unable to allocate buffer.\n";
-                return; // leave untoggled since we have no buffer.
-            }
-            buf_width = width;
-            buf_height = height;
-        }
-
-        // initialize the raytracer (first make sure camera aspect is correct)
+        // first make sure camera aspect is correct. previews keep the
+        // aspect of the full image.
+        raytrace_width = width;
+        raytrace_height = height;
         scene.camera.aspect = real_t( width ) / real_t( height );
 
-        if ( !raytracer.initialize( &scene, width, height ) ) {
-            std::cout << "Raytracer initialization failed.\n";
+        // in a window, start with a preview that can be traced in a frame
+        int scale = 1;
+        if ( options.open_window )
+            scale = preview.get_initial_scale( width, height, frame_period );
+
+        if ( !start_preview( scale ) )
             return; // leave untoggled since initialization failed.
-        }
 
         // reset flag that says we are done
         raytrace_finished = false;
@@ -277,7 +384,89 @@ void RaytracerApplication::toggle_raytracing( int width, int height )
     raytracing = !raytracing;
 }
 
-void RaytracerApplication::output_image()
+bool RaytracerApplication::start_preview( int scale )
+{
+    int width = std::max( raytrace_width / scale, 1 );
+    int height = std::max( raytrace_height / scale, 1 );
+
+    // keep the last image, to show in the new one until its tiles are
+    // traced. it is warped to the new view, so it still lines up if the
+    // camera moved, and scaled up for finer previews.
+    CameraView old_view = raytracer.get_view();
+    std::vector< unsigned char > old_image;
+    std::vector< float > old_depths;
+    if ( buffer ) {
+        assert( old_view.get_width() == size_t( buf_width ) && old_view.get_height() == size_t( buf_height ) );
+        old_image.assign( buffer, buffer + BUFFER_SIZE( buf_width, buf_height ) );
+        old_depths.assign( raytracer.get_depths(), raytracer.get_depths() + buf_width * buf_height );
+    }
+
+    // only re-allocate if the dimensions changed
+    if ( buf_width != width || buf_height != height ) {
+        unsigned char* old_buffer = buffer;
+        buffer = (unsigned char*) malloc( BUFFER_SIZE( width, height ) );
+        if ( !buffer ) {
+            buffer = old_buffer;
+            std::cout << "Unable to allocate buffer.\n";
+            return false;
+        }
+        free( old_buffer );
+        buf_width = width;
+        buf_height = height;
+    }
+
+    // previews are only glimpses, so they get a single pass
+    raytracer.set_num_passes( scale > 1 ? 1 : options.num_passes );
+    if ( !raytracer.initialize( &scene, width, height ) ) {
+        std::cout << "Raytracer initialization failed.\n";
+        return false;
+    }
+
+    if ( !old_image.empty() )
+        raytracer.reproject( old_view, &old_image[0], &old_depths[0], buffer );
+
+    preview_scale = scale;
+    return true;
+}
+
+bool RaytracerApplication::start_collecting( int width, int height )
+{
+    assert( width > 0 && height > 0 && !buffer );
+
+    buffer = (unsigned char*) malloc( BUFFER_SIZE( width, height ) );
+    if ( !buffer ) {
+        std::cout << "Unable to allocate buffer.\n";
+        return false;
+    }
+    buf_width = raytrace_width = width;
+    buf_height = raytrace_height = height;
+    preview_scale = 1;
+    raytracer.initialize_image( width, height );
+    return true;
+}
+
+void RaytracerApplication::move_camera()
+{
+    // previews keep the aspect of the full image
+    scene.camera = camera_control.camera;
+    scene.camera.aspect = real_t( raytrace_width ) / real_t( raytrace_height );
+
+    // a small move reuses most of a full resolution image, leaving only
+    // what it uncovered to trace. otherwise, start over with the coarsest
+    // preview that keeps up. if this fails, the last raytrace is left to
+    // finish at the old view.
+    int scale = preview.get_initial_scale( raytrace_width, raytrace_height, frame_period );
+    if ( preview_scale == 1 && start_preview( 1 ) ) {
+        raytrace_finished = false;
+        real_t pixels = real_t( raytrace_width ) * real_t( raytrace_height );
+        if ( scale == 1 || raytracer.get_pixels_reused() >= MIN_REUSED_FRACTION * pixels )
+            return;
+    }
+    if ( start_preview( scale ) )
+        raytrace_finished = false;
+}
+
+bool RaytracerApplication::output_image()
 {
     static const size_t MAX_LEN = 256;
     const char* filename;
@@ -285,7 +474,7 @@ void RaytracerApplication::output_image()
 
     if ( !buffer ) {
         std::cout << "No image to output.\n";
-        return;
+        return false;
     }
 
     assert( buf_width > 0 && buf_height > 0 );
@@ -298,13 +487,235 @@ void RaytracerApplication::output_image()
         filename = buf;
     }
 
-    if ( imageio_save_image( filename, buffer, buf_width, buf_height ) ) {
+    if ( options.crop_width > 0 ) {
+        return output_crop_image( filename );
+    }
+
+    if ( imageio_is_hdr_name( filename ) ) {
+        return output_hdr_image( filename );
+    }
+
+    // the display buffer may be overwritten by the next raytrace, so hand
+    // the writer a copy
+    unsigned char* copy = writer.acquire_buffer( buf_width, buf_height );
+    if ( !copy ) {
+        std::cout << "Unable to allocate buffer.\n";
+        return false;
+    }
+    memcpy( copy, buffer, BUFFER_SIZE( buf_width, buf_height ) );
+    writer.submit( filename, copy, buf_width, buf_height );
+    return true;
+}
+
+bool RaytracerApplication::output_hdr_image( const char* filename )
+{
+    // uncompressed, so written right away rather than by the writer
+    const Framebuffer& framebuffer = raytracer.get_framebuffer();
+    int width = framebuffer.get_width();
+    int height = framebuffer.get_height();
+    std::vector< float > rgb( 3 * width * height );
+
+    if ( rgb.empty() ) {
+        std::cout << "No image to output.\n";
+        return false;
+    }
+
+    framebuffer.resolve( &rgb[0] );
+
+    if ( imageio_save_hdr_image( filename, &rgb[0], width, height ) ) {
         std::cout << "Saved raytraced image to '" << filename << "'.\n";
+        return true;
     } else {
         std::cout << "Error saving raytraced image to '" << filename << "'.\n";
+        return false;
+    }
+}
+
+/**
+ * Copies a width by height block of pixels, each pixel_size bytes, from
+ * (src_x, src_row) of an image src_width pixels wide to (dst_x, dst_row) of
+ * one dst_width pixels wide.
+ */
+static void copy_block( const void* src, int src_width, int src_x, int src_row,
+                        void* dst, int dst_width, int dst_x, int dst_row,
+                        int width, int height, size_t pixel_size )
+{
+    for ( int y = 0; y < height; ++y ) {
+        memcpy( (char*) dst + pixel_size * ( size_t( dst_row + y ) * dst_width + dst_x ),
+                (const char*) src + pixel_size * ( size_t( src_row + y ) * src_width + src_x ),
+                pixel_size * width );
+    }
+}
+
+bool RaytracerApplication::output_crop_image( const char* filename )
+{
+    int x = options.crop_x;
+    int row = buf_height - options.crop_y - options.crop_height;
+    int width = options.crop_width;
+    int height = options.crop_height;
+    bool hdr = imageio_is_hdr_name( filename );
+
+    // only merge into a file that exists, never one that failed to load
+    FILE* existing = fopen( filename, "rb" );
+    bool merge = existing != 0;
+    if ( existing )
+        fclose( existing );
+
+    int out_width = width;
+    int out_height = height;
+    int out_x = 0;
+    int out_row = 0;
+    void* loaded = 0;
+    if ( merge ) {
+        if ( hdr ) {
+            loaded = imageio_load_hdr_image( filename, &out_width, &out_height );
+        } else {
+            loaded = imageio_load_image( filename, &out_width, &out_height );
+        }
+        if ( !loaded || out_width != buf_width || out_height != buf_height ) {
+            std::cout << "Cannot merge the crop window into '" << filename
+                      << "', which is not a " << buf_width << "x" << buf_height << " image.\n";
+            free( loaded );
+            return false;
+        }
+        out_x = x;
+        out_row = row;
+        std::cout << "Merging the crop window into '" << filename << "'.\n";
+    }
+
+    if ( hdr ) {
+        const Framebuffer& framebuffer = raytracer.get_framebuffer();
+        std::vector< float > rgb( 3 * buf_width * buf_height );
+        framebuffer.resolve( &rgb[0] );
+
+        float* out = merge ? (float*) loaded : (float*) malloc( 3 * sizeof( float ) * width * height );
+        if ( !out ) {
+            std::cout << "Unable to allocate buffer.\n";
+            return false;
+        }
+        copy_block( &rgb[0], buf_width, x, row, out, out_width, out_x, out_row,
+                    width, height, 3 * sizeof( float ) );
+
+        bool result = imageio_save_hdr_image( filename, out, out_width, out_height );
+        free( out );
+        if ( result ) {
+            std::cout << "Saved raytraced image to '" << filename << "'.\n";
+        } else {
+            std::cout << "Error saving raytraced image to '" << filename << "'.\n";
+        }
+        return result;
+    }
+
+    unsigned char* out = writer.acquire_buffer( out_width, out_height );
+    if ( !out ) {
+        std::cout << "Unable to allocate buffer.\n";
+        free( loaded );
+        return false;
+    }
+    if ( merge ) {
+        memcpy( out, loaded, BUFFER_SIZE( out_width, out_height ) );
+        free( loaded );
     }
+    copy_block( buffer, buf_width, x, row, out, out_width, out_x, out_row, width, height, 4 );
+    writer.submit( filename, out, out_width, out_height );
+    return true;
+}
+
+void RaytracerApplication::print_cluster_stats() const
+{
+    Mesh* const* meshes = scene.get_meshes();
+    for ( size_t i = 0; i < scene.num_meshes(); ++i ) {
+        const ClusteredMesh* clusters = meshes[i]->get_clusters();
+        if ( !clusters )
+            continue;
+        const ClusterStats& stats = clusters->get_stats();
+        real_t hit_rate = stats.lookups > 0
+            ? 100.0 * real_t( stats.lookups - stats.page_ins ) / real_t( stats.lookups )
+            : 100.0;
+        printf( "Mesh '%s': %lu cluster lookups, %lu page ins (%.2f%% hit rate), "
+                "%lu evictions, %.1f MB peak\n",
+                meshes[i]->filename.c_str(), (unsigned long) stats.lookups,
+                (unsigned long) stats.page_ins, hit_rate, (unsigned long) stats.evictions,
+                stats.peak_bytes / ( 1024.0 * 1024.0 ) );
+    }
+}
+
+// puts the name of the given frame in filename, inserting the frame number
+// before the extension of base (e.g. anim.png becomes anim_0007.png)
+static void gen_frame_name( char* filename, size_t len, const char* base, int frame )
+{
+    const char* ext = strrchr( base, '.' );
+    const char* slash = strrchr( base, '/' );
+    if ( !ext || ( slash && slash > ext ) )
+        ext = base + strlen( base );
+
+    int stem_len = int( ext - base );
+    snprintf( filename, len, "%.*s_%04d%s", stem_len, base, frame, ext );
 }
 
+bool RaytracerApplication::render_animation()
+{
+    static const size_t MAX_LEN = 256;
+    char base_buf[MAX_LEN];
+    char filename[MAX_LEN];
+    const char* base;
+    const CameraPath& path = scene.camera_path;
+    int width = options.width;
+    int height = options.height;
+    int num_frames = options.num_frames;
+
+    assert( num_frames > 0 && width > 0 && height > 0 );
+
+    if ( path.empty() ) {
+        std::cout << "Scene has no camera path to animate.\n";
+        return false;
+    }
+
+    base = options.output_filename;
+    if ( !base ) {
+        imageio_gen_name( base_buf, MAX_LEN );
+        base = base_buf;
+    }
+
+    scene.camera.aspect = real_t( width ) / real_t( height );
+    bool hdr = imageio_is_hdr_name( base );
+    bool success = true;
+
+    for ( int frame = 0; frame < num_frames; ++frame ) {
+        real_t t = num_frames > 1 ? real_t( frame ) / real_t( num_frames - 1 ) : 0;
+        path.evaluate( path.start_time() + t * ( path.end_time() - path.start_time() ), &scene.camera );
+
+        // geometry does not move between frames, so this reuses the
+        // acceleration structure built for the first frame
+        if ( !raytracer.initialize( &scene, width, height ) ) {
+            std::cout << "Raytracer initialization failed.\n";
+            writer.finish();
+            return false;
+        }
+
+        // waits for the frame before last to be written if the writer
+        // has fallen behind
+        unsigned char* frame_buffer = writer.acquire_buffer( width, height );
+        if ( !frame_buffer ) {
+            std::cout << "Unable to allocate buffer.\n";
+            writer.finish();
+            return false;
+        }
+
+        raytracer.raytrace( frame_buffer, 0 );
+
+        gen_frame_name( filename, MAX_LEN, base, frame );
+        if ( hdr ) {
+            success = output_hdr_image( filename ) && success;
+            writer.release_buffer( frame_buffer );
+        } else {
+            writer.submit( filename, frame_buffer, width, height );
+        }
+    }
+
+    print_cluster_stats();
+    return writer.finish() && success;
+}
 
 static void render_scene( const Scene& scene )
 {
@@ -401,7 +812,8 @@ using namespace _462;
  */
 static void print_usage( const char* progname )
 {
-    std::cout << "Usage: " << progname << " [-r] [-d width height] input_scene [output_file]\n"
+    std::cout << "Usage: " << progname << " [-r] [-d width height] [-z level] [-a frames] [-l lights] [-p passes] [-w] [-i integrator] [-b megabytes] [-x left top width height] [-s directory] [-c] [-k] input_scene [output_file]\n"
+        "       " << progname << " -j directory\n"
         "\n" \
         "Options:\n" \
         "\n" \
@@ -411,11 +823,64 @@ static void print_usage( const char* progname )
         "\t-d width height\n" \
         "\t\tThe dimensions of image to raytrace (and window if using\n" \
         "\t\tand opengl context. Defaults to width=800, height=600.\n" \
+        "\t-z level\n" \
+        "\t\tThe zlib compression level of saved images, from 0 (fastest)\n" \
+        "\t\tto 9 (smallest). Defaults to the zlib default.\n" \
+        "\t-a frames\n" \
+        "\t\tRenders the given number of frames evenly spaced along the\n" \
+        "\t\tscene's camera path, without a window. Frames are numbered\n" \
+        "\t\tby inserting _0000, _0001, ... before the output extension.\n" \
+        "\t-l lights\n" \
+        "\t\tShades each point with the given number of lights picked at\n" \
+        "\t\trandom, weighted by their brightness, instead of every light.\n" \
+        "\t\tFor scenes with many lights; use with -p to reduce noise.\n" \
+        "\t-p passes\n" \
+        "\t\tRaytraces each image the given number of times and averages\n" \
+        "\t\tthe passes. Defaults to 1.\n" \
+        "\t-w\n" \
+        "\t\tTraces reflections breadth first: all the reflection rays of\n" \
+        "\t\ta group of rows are sorted by direction and origin and traced\n" \
+        "\t\ttogether. Faster on scenes with many mirrors.\n" \
+        "\t-i integrator\n" \
+        "\t\tHow to light the scene: 'whitted' (the default) raytraces\n" \
+        "\t\tdirect light and mirror reflections; 'path' path traces\n" \
+        "\t\tglobal illumination on every processor. Path traced images\n" \
+        "\t\tare noisy; use with -p to average many passes.\n" \
+        "\t-b megabytes\n" \
+        "\t\tThe memory kept for the clusters of each out-of-core mesh.\n" \
+        "\t\tDefaults to 256.\n" \
+        "\t-x left top width height\n" \
+        "\t\tRaytraces only the given rectangle of the image, in pixels\n" \
+        "\t\tfrom its top left corner, without a window. If the output\n" \
+        "\t\tfile holds an image of the full size, the rectangle is merged\n" \
+        "\t\tinto it; otherwise just the rectangle is saved. For touching\n" \
+        "\t\tup part of a finished image.\n" \
+        "\t-s directory\n" \
+        "\t\tRenders the image without a window by handing out its tiles\n" \
+        "\t\tto workers started with -j in the same directory, which may\n" \
+        "\t\tbe shared with other machines of the same kind. Workers must\n" \
+        "\t\tfind the scene's meshes and textures under the same paths.\n" \
+        "\t\tTiles of dead workers are handed out again, and the last\n" \
+        "\t\ttiles to finish are raced by idle workers.\n" \
+        "\t-j directory\n" \
+        "\t\tWaits for a render started with -s in the given directory,\n" \
+        "\t\tthen traces its tiles until it is finished. Each worker uses\n" \
+        "\t\tevery processor, so start one per machine.\n" \
+        "\t-c\n" \
+        "\t\tConverts the input scene to a binary scene saved to the output\n" \
+        "\t\tfile, without rendering. Binary scenes load much faster than\n" \
+        "\t\tXML ones, and are read back on machines of the same kind.\n" \
+        "\t-k\n" \
+        "\t\tConverts the input OBJ mesh to a cluster file saved to the\n" \
+        "\t\toutput file, without rendering. Scenes may use cluster files\n" \
+        "\t\tin place of OBJ meshes; they are read as rays reach them,\n" \
+        "\t\tso they need not fit in memory.\n" \
         "\tinput_scene:\n" \
         "\t\tThe scene file to load and raytrace.\n" \
         "\toutput_file:\n" \
         "\t\tThe output file in which to write the rendered images.\n" \
         "\t\tIf not specified, default timestamped filenames are used.\n" \
+        "\t\tNames ending in .pfm save the unclamped floating point image.\n" \
         "\n" \
         "Instructions:\n" \
         "\n" \
@@ -438,65 +903,265 @@ static void print_usage( const char* progname )
  */
 static bool parse_args( Options* opt, int argc, char* argv[] )
 {
-    int input_index = 1;
+    int index = 1;
+
+    opt->open_window = true;
+    opt->width = DEFAULT_WIDTH;
+    opt->height = DEFAULT_HEIGHT;
+    opt->num_frames = 0;
+    opt->compression_level = -1;
+    opt->convert = false;
+    opt->light_samples = 0;
+    opt->num_passes = 1;
+    opt->wavefront = false;
+    opt->path_tracing = false;
+    opt->cluster = false;
+    opt->cluster_budget = 256;
+    opt->crop_x = 0;
+    opt->crop_y = 0;
+    opt->crop_width = 0;
+    opt->crop_height = 0;
+    opt->farm_directory = 0;
+    opt->farm_worker = false;
+    opt->input_filename = 0;
+    opt->output_filename = 0;
+
+    // options come before the file names
+    while ( index < argc && argv[index][0] == '-' ) {
+        if ( strcmp( argv[index], "-r" ) == 0 ) {
+            opt->open_window = false;
+            index += 1;
+        } else if ( strcmp( argv[index], "-d" ) == 0 ) {
+            if ( argc <= index + 2 ) {
+                print_usage( argv[0] );
+                return false;
+            }
 
-    if ( argc < 2 ) {
-        print_usage( argv[0] );
-        return false;
-    }
+            // parse window dimensions
+            opt->width = -1;
+            opt->height = -1;
+            sscanf( argv[index + 1], "%d", &opt->width );
+            sscanf( argv[index + 2], "%d", &opt->height );
+            // check for valid width/height
+            if ( opt->width < 1 || opt->height < 1 ) {
+                std::cout << "Invalid window dimensions\n";
+                return false;
+            }
+            index += 3;
+        } else if ( strcmp( argv[index], "-z" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
 
-    if ( strcmp( argv[1], "-r" ) == 0 ) {
-        opt->open_window = false;
-        ++input_index;
-    } else {
-        opt->open_window = true;
-    }
+            opt->compression_level = -1;
+            sscanf( argv[index + 1], "%d", &opt->compression_level );
+            if ( opt->compression_level < 0 || opt->compression_level > 9 ) {
+                std::cout << "Invalid compression level\n";
+                return false;
+            }
+            index += 2;
+        } else if ( strcmp( argv[index], "-a" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
 
-    if ( argc <= input_index ) {
-        print_usage( argv[0] );
-        return false;
-    }
+            opt->num_frames = -1;
+            sscanf( argv[index + 1], "%d", &opt->num_frames );
+            if ( opt->num_frames < 1 ) {
+                std::cout << "Invalid number of frames\n";
+                return false;
+            }
+            // animations are always rendered offline
+            opt->open_window = false;
+            index += 2;
+        } else if ( strcmp( argv[index], "-l" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+
+            opt->light_samples = -1;
+            sscanf( argv[index + 1], "%d", &opt->light_samples );
+            if ( opt->light_samples < 1 ) {
+                std::cout << "Invalid number of light samples\n";
+                return false;
+            }
+            index += 2;
+        } else if ( strcmp( argv[index], "-p" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+
+            opt->num_passes = -1;
+            sscanf( argv[index + 1], "%d", &opt->num_passes );
+            if ( opt->num_passes < 1 ) {
+                std::cout << "Invalid number of passes\n";
+                return false;
+            }
+            index += 2;
+        } else if ( strcmp( argv[index], "-w" ) == 0 ) {
+            opt->wavefront = true;
+            index += 1;
+        } else if ( strcmp( argv[index], "-i" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
 
-    // check if it's a -d, if so then get window dimensions
-    if ( strcmp( argv[input_index], "-d" ) == 0 ) {
-        if ( argc <= input_index + 3 ) {
+            if ( strcmp( argv[index + 1], "path" ) == 0 ) {
+                opt->path_tracing = true;
+            } else if ( strcmp( argv[index + 1], "whitted" ) == 0 ) {
+                opt->path_tracing = false;
+            } else {
+                std::cout << "Unknown integrator '" << argv[index + 1] << "'.\n";
+                return false;
+            }
+            index += 2;
+        } else if ( strcmp( argv[index], "-b" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+
+            opt->cluster_budget = -1;
+            sscanf( argv[index + 1], "%d", &opt->cluster_budget );
+            if ( opt->cluster_budget < 1 ) {
+                std::cout << "Invalid cluster memory\n";
+                return false;
+            }
+            index += 2;
+        } else if ( strcmp( argv[index], "-x" ) == 0 ) {
+            if ( argc <= index + 4 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+
+            opt->crop_x = -1;
+            opt->crop_y = -1;
+            opt->crop_width = -1;
+            opt->crop_height = -1;
+            sscanf( argv[index + 1], "%d", &opt->crop_x );
+            sscanf( argv[index + 2], "%d", &opt->crop_y );
+            sscanf( argv[index + 3], "%d", &opt->crop_width );
+            sscanf( argv[index + 4], "%d", &opt->crop_height );
+            if ( opt->crop_x < 0 || opt->crop_y < 0 || opt->crop_width < 1 || opt->crop_height < 1 ) {
+                std::cout << "Invalid crop window\n";
+                return false;
+            }
+            // crops are always rendered offline
+            opt->open_window = false;
+            index += 5;
+        } else if ( strcmp( argv[index], "-s" ) == 0 || strcmp( argv[index], "-j" ) == 0 ) {
+            if ( argc <= index + 1 ) {
+                print_usage( argv[0] );
+                return false;
+            }
+
+            opt->farm_directory = argv[index + 1];
+            opt->farm_worker = argv[index][1] == 'j';
+            // distributed renders are always offline
+            opt->open_window = false;
+            index += 2;
+        } else if ( strcmp( argv[index], "-k" ) == 0 ) {
+            opt->cluster = true;
+            opt->open_window = false;
+            index += 1;
+        } else if ( strcmp( argv[index], "-c" ) == 0 ) {
+            opt->convert = true;
+            opt->open_window = false;
+            index += 1;
+        } else {
+            std::cout << "Unknown option '" << argv[index] << "'.\n";
             print_usage( argv[0] );
             return false;
         }
+    }
 
-        // parse window dimensions
-        opt->width = -1;
-        opt->height = -1;
-        sscanf( argv[input_index + 1], "%d", &opt->width );
-        sscanf( argv[input_index + 2], "%d", &opt->height );
-        // check for valid width/height
-        if ( opt->width < 1 || opt->height < 1 ) {
-            std::cout << "Invalid window dimensions\n";
+    // workers get their scene from the coordinator
+    if ( opt->farm_worker ) {
+        if ( argc > index ) {
+            std::cout << "Too many arguments.\n";
             return false;
         }
+        return true;
+    }
 
-        input_index += 3;
-    } else {
-        opt->width = DEFAULT_WIDTH;
-        opt->height = DEFAULT_HEIGHT;
+    if ( argc <= index ) {
+        print_usage( argv[0] );
+        return false;
     }
 
-    opt->input_filename = argv[input_index];
+    opt->input_filename = argv[index];
 
-    if ( argc > input_index + 1 ) {
-        opt->output_filename = argv[input_index + 1];
-    } else {
-        opt->output_filename = 0;
+    if ( argc > index + 1 ) {
+        opt->output_filename = argv[index + 1];
     }
 
-    if ( argc > input_index + 2 ) {
+    if ( argc > index + 2 ) {
         std::cout << "Too many arguments.\n";
         return false;
     }
 
+    if ( opt->convert && !opt->output_filename ) {
+        std::cout << "No output file given for the binary scene.\n";
+        return false;
+    }
+
+    if ( opt->cluster && !opt->output_filename ) {
+        std::cout << "No output file given for the cluster file.\n";
+        return false;
+    }
+
+    if ( opt->crop_width > 0 ) {
+        if ( opt->crop_x + opt->crop_width > opt->width || opt->crop_y + opt->crop_height > opt->height ) {
+            std::cout << "Crop window is outside the image.\n";
+            return false;
+        }
+        if ( opt->num_frames > 0 ) {
+            std::cout << "Crop windows are only for still images.\n";
+            return false;
+        }
+    }
+
+    if ( opt->farm_directory ) {
+        if ( opt->num_frames > 0 || opt->crop_width > 0 || opt->convert || opt->cluster ) {
+            std::cout << "Distributed renders are only for whole still images.\n";
+            return false;
+        }
+    }
+
     return true;
 }
 
+/**
+ * Joins a distributed render as a worker, tracing tiles until its job is
+ * finished. Returns the exit code.
+ */
+static int run_farm_worker( Options opt )
+{
+    FarmWorker worker( opt.farm_directory );
+    FarmJob job;
+    worker.wait_for_job( &job );
+
+    // the job sets how to raytrace, the app just loads the scene
+    std::string scene_filename = worker.get_path( job.scene_filename );
+    opt.input_filename = scene_filename.c_str();
+    RaytracerApplication app( opt );
+    if ( !load_scene( &app.scene, opt.input_filename ) ) {
+        std::cout << "Error loading scene " << opt.input_filename << ". Aborting.\n";
+        return 1;
+    }
+    if ( !app.initialize() ) {
+        return 1;
+    }
+
+    worker.run( &app.scene, &app.raytracer );
+    return 0;
+}
+
 int main( int argc, char* argv[] )
 {
     Options opt;
@@ -511,8 +1176,31 @@ int main( int argc, char* argv[] )
         return 1;
     }
 
+    if ( opt.farm_worker ) {
+        return run_farm_worker( opt );
+    }
+
     RaytracerApplication app( opt );
 
+    // two buffers, so one image can render while the last is written
+    if ( !app.writer.initialize( 2, opt.compression_level ) ) {
+        std::cout << "Unable to start image writer. Aborting.\n";
+        return 1;
+    }
+
+    // the input is a mesh rather than a scene
+    if ( opt.cluster ) {
+        // clusters of about this many triangles, a few hundred kilobytes
+        static const size_t MAX_CLUSTER_SIZE = 4096;
+        Mesh mesh;
+        mesh.filename = opt.input_filename;
+        if ( !mesh.load() ) {
+            std::cout << "Error loading mesh " << opt.input_filename << ". Aborting.\n";
+            return 1;
+        }
+        return save_mesh_clusters( mesh, opt.output_filename, MAX_CLUSTER_SIZE ) ? 0 : 1;
+    }
+
     // load the given scene
     if ( !load_scene( &app.scene, opt.input_filename ) ) {
         std::cout << "Error loading scene " << opt.input_filename << ". Aborting.\n";
@@ -520,13 +1208,49 @@ int main( int argc, char* argv[] )
     }
 
     // either launch a window or do a full raytrace without one, depending on the option
-    if ( opt.open_window ) {
+    if ( opt.convert ) {
+
+        return save_binary_scene( app.scene, opt.output_filename ) ? 0 : 1;
+
+    } else if ( opt.open_window ) {
 
         real_t fps = 30.0;
         const char* title = "15462 Project 2 - Raytracer";
         // start a new application
         return Application::start_application( &app, opt.width, opt.height, fps, title );
 
+    } else if ( opt.num_frames > 0 ) {
+
+        // textures and meshes are loaded once for the whole animation
+        if ( !app.initialize() ) {
+            return 1;
+        }
+        return app.render_animation() ? 0 : 1;
+
+    } else if ( opt.farm_directory ) {
+
+        // the workers load the meshes and textures they trace, so the
+        // coordinator only needs an image to collect tiles in
+        if ( !app.start_collecting( opt.width, opt.height ) ) {
+            return 1;
+        }
+
+        FarmCoordinator coordinator( opt.farm_directory );
+        FarmJob job;
+        job.width = opt.width;
+        job.height = opt.height;
+        job.num_passes = opt.num_passes;
+        job.light_samples = opt.light_samples;
+        job.wavefront = opt.wavefront;
+        job.path_tracing = opt.path_tracing;
+        if ( !coordinator.start( app.scene, &job ) ) {
+            return 1;
+        }
+        // workers do the tracing
+        coordinator.run( &app.raytracer, app.buffer );
+        bool success = app.output_image();
+        return app.writer.finish() && success ? 0 : 1;
+
     } else {
 
         app.initialize();
@@ -537,9 +1261,10 @@ int main( int argc, char* argv[] )
         assert( app.buffer );
         // raytrace until done
         app.raytracer.raytrace( app.buffer, 0 );
+        app.print_cluster_stats();
         // output result
-        app.output_image();
-        return 0;
+        bool success = app.output_image();
+        return app.writer.finish() && success ? 0 : 1;
 
     }
 }
@@ -0,0 +1,386 @@
+/**
+ * @file path_tracer.cpp
+ * @brief A wavefront path tracer, the alternative to Raytracer's recursion.
+ */
+
+#include "raytracer/path_tracer.hpp"
+#include "raytracer/scene_accel.hpp"
+#include "raytracer/light_accel.hpp"
+#include "raytracer/framebuffer.hpp"
+#include "application/parallel.hpp"
+#include "scene/scene.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace _462 {
+
+// paths handed to a thread at a time
+#define PATH_GRAIN (256)
+// bounces before paths may be ended at random
+#define ROULETTE_BOUNCES (3)
+// the farthest a bounced ray may travel, as for reflections
+#define MAX_BOUNCE_TIME (100)
+
+static real_t max_channel( const Color3& c )
+{
+    return std::max( c.r, std::max( c.g, c.b ) );
+}
+
+// returns a direction about the unit normal n, with density proportional
+// to its cosine with n
+static Vector3 sample_cosine( const Vector3& n, real_t u, real_t v )
+{
+    // any vector not parallel to n gives a basis
+    Vector3 t = fabs( n.x ) > 0.5 ? Vector3( 0, 1, 0 ) : Vector3( 1, 0, 0 );
+    Vector3 b = normalize( cross( n, t ) );
+    t = cross( b, n );
+
+    real_t r = sqrt( u );
+    real_t phi = 2 * PI * v;
+    return normalize( r * cos( phi ) * t + r * sin( phi ) * b + sqrt( std::max( real_t( 0 ), 1 - u ) ) * n );
+}
+
+// the light from a point light of the given color and attenuation reflected
+// by a diffuse surface, before shadowing. the surface reflects by the
+// lambertian brdf diffuse / PI, as bounces do, where the cosine and the PI
+// cancel against the density of sample_cosine.
+static Color3 point_light( const PointLight& light, const Vector3& position,
+                           const Vector3& normal, const Color3& diffuse )
+{
+    Vector3 to_light = light.position - position;
+    real_t distance = length( to_light );
+    real_t cosine = distance > 0 ? dot( normal, to_light ) / distance : 0;
+    if ( cosine <= 0 )
+        return Color3::Black;
+    return light.color * diffuse * ( cosine / ( PI * LightAccel::attenuation( light, distance ) ) );
+}
+
+struct PathTracer::ExtendStage
+{
+    PathTracer* tracer;
+
+    void operator()( size_t begin, size_t end ) {
+        PathTracer& t = *tracer;
+        for ( size_t i = begin; i < end; ++i ) {
+            ray_t ray;
+            ray.eye = t.origins[i];
+            ray.direction = t.directions[i];
+            ray.end = ray.eye + ray.direction;
+
+            // camera rays start at the eye, others leave a surface
+            bool camera = t.from_geoms[i] < 0;
+            real_t time;
+            Hit hit;
+            t.hit_geoms[i] = t.accel->intersect( ray, camera ? 0 : SLOP_FACTOR,
+                                                 camera ? std::numeric_limits< real_t >::infinity() : MAX_BOUNCE_TIME,
+                                                 t.from_geoms[i], &time, &hit );
+            t.hit_times[i] = time;
+            t.hit_primitives[i] = hit.primitive;
+            t.hit_betas[i] = hit.beta;
+            t.hit_gammas[i] = hit.gamma;
+        }
+    }
+};
+
+struct PathTracer::ShadeStage
+{
+    PathTracer* tracer;
+
+    void operator()( size_t begin, size_t end ) {
+        PathTracer& t = *tracer;
+        const Scene& scene = *t.scene;
+        const PointLight* lights = scene.get_lights();
+        const AreaLight* area_lights = scene.get_area_lights();
+
+        for ( size_t i = begin; i < end; ++i ) {
+            Color3* contributions = &t.shadow_contributions[i * t.shadows_per_path];
+            std::fill( contributions, contributions + t.shadows_per_path, Color3::Black );
+            t.alive[i] = false;
+
+            // paths only ever write their own pixel, so this needs no lock
+            int geom = t.hit_geoms[i];
+            if ( geom < 0 ) {
+                t.radiance[t.pixels[i]] += t.throughputs[i] * scene.background_color;
+                continue;
+            }
+
+            ray_t ray;
+            ray.eye = t.origins[i];
+            ray.direction = t.directions[i];
+            ray.end = ray.eye + ray.direction;
+            Hit hit;
+            hit.primitive = t.hit_primitives[i];
+            hit.beta = t.hit_betas[i];
+            hit.gamma = t.hit_gammas[i];
+            SurfacePoint surface;
+            t.accel->get_surface_point( ray, geom, t.hit_times[i], hit, &surface );
+
+            // surfaces are two sided, facing the ray
+            Vector3 normal = normalize( surface.normal );
+            if ( dot( normal, ray.direction ) > 0 )
+                normal = -normal;
+            Color3 diffuse = surface.diffuse * surface.texture;
+            Color3 specular = surface.specular * surface.texture;
+            Color3 throughput = t.throughputs[i];
+            Random& rng = t.rngs[i];
+
+            // queue shadow rays for the connect stage
+            size_t slot = i * t.shadows_per_path;
+            if ( t.light_accel->can_sample() ) {
+                real_t pdf;
+                const PointLight& light = lights[t.light_accel->sample( rng.next_real(), &pdf )];
+                t.shadow_origins[slot] = surface.position;
+                t.shadow_targets[slot] = light.position;
+                t.shadow_geoms[slot] = geom;
+                t.shadow_contributions[slot] = throughput * point_light( light, surface.position, normal, diffuse ) * ( 1.0 / pdf );
+                ++slot;
+            }
+            for ( size_t j = 0; j < scene.num_area_lights(); ++j, ++slot ) {
+                // a point of the light, shining with its whole color
+                PointLight sample;
+                sample.color = area_lights[j].color;
+                sample.attenuation = area_lights[j].attenuation;
+                real_t u = rng.next_real();
+                real_t v = rng.next_real();
+                sample.position = area_lights[j].sample( u, v, surface.position );
+                t.shadow_origins[slot] = surface.position;
+                t.shadow_targets[slot] = sample.position;
+                t.shadow_geoms[slot] = geom;
+                t.shadow_contributions[slot] = throughput * point_light( sample, surface.position, normal, diffuse );
+            }
+
+            // pick the next bounce, diffuse or mirror, by reflectance
+            ++t.bounces[i];
+            real_t diffuse_weight = max_channel( diffuse );
+            real_t specular_weight = max_channel( specular );
+            if ( t.bounces[i] > t.max_bounces || diffuse_weight + specular_weight <= 0 )
+                continue;
+
+            real_t specular_chance = specular_weight / ( diffuse_weight + specular_weight );
+            Vector3 direction;
+            if ( rng.next_real() < specular_chance ) {
+                direction = ray.direction - 2 * dot( ray.direction, normal ) * normal;
+                throughput = throughput * specular * ( 1.0 / specular_chance );
+            } else {
+                real_t u = rng.next_real();
+                real_t v = rng.next_real();
+                direction = sample_cosine( normal, u, v );
+                throughput = throughput * diffuse * ( 1.0 / ( 1 - specular_chance ) );
+            }
+
+            // end dim paths at random, scaling up the survivors to make up
+            // for the ones that end
+            if ( t.bounces[i] >= ROULETTE_BOUNCES ) {
+                real_t survive = std::min( max_channel( throughput ), real_t( 0.95 ) );
+                if ( rng.next_real() >= survive )
+                    continue;
+                throughput *= 1.0 / survive;
+            }
+
+            t.origins[i] = surface.position;
+            t.directions[i] = direction;
+            t.throughputs[i] = throughput;
+            t.from_geoms[i] = geom;
+            t.alive[i] = true;
+        }
+    }
+};
+
+struct PathTracer::ConnectStage
+{
+    PathTracer* tracer;
+
+    void operator()( size_t begin, size_t end ) {
+        PathTracer& t = *tracer;
+        for ( size_t i = begin; i < end; ++i ) {
+            t.shadow_visible[i] = false;
+            if ( t.shadow_contributions[i] == Color3::Black )
+                continue;
+
+            Vector3 to_light = t.shadow_targets[i] - t.shadow_origins[i];
+            real_t distance = length( to_light );
+            ray_t ray;
+            ray.eye = t.shadow_origins[i];
+            ray.direction = to_light * ( 1.0 / distance );
+            ray.end = t.shadow_targets[i];
+            t.shadow_visible[i] = !t.accel->is_occluded( ray, SLOP_FACTOR, distance, t.shadow_geoms[i] );
+        }
+    }
+};
+
+PathTracer::PathTracer()
+    : scene( 0 ), accel( 0 ), light_accel( 0 ), width( 0 ), height( 0 ),
+      max_bounces( 8 ), threaded( true ), num_paths( 0 ), shadows_per_path( 0 ) { }
+
+PathTracer::~PathTracer() { }
+
+void PathTracer::initialize( const Scene* scene, const SceneAccel* accel, const LightAccel* light_accel,
+                             size_t width, size_t height )
+{
+    this->scene = scene;
+    this->accel = accel;
+    this->light_accel = light_accel;
+    this->width = width;
+    this->height = height;
+
+    threaded = accel->is_thread_safe();
+
+    shadows_per_path = ( light_accel->can_sample() ? 1 : 0 ) + scene->num_area_lights();
+}
+
+template< typename Body >
+void PathTracer::run_stage( size_t count, Body& body )
+{
+    if ( threaded ) {
+        parallel_for( count, PATH_GRAIN, body );
+    } else {
+        body( 0, count );
+    }
+}
+
+void PathTracer::resize( size_t count )
+{
+    origins.resize( count );
+    directions.resize( count );
+    throughputs.resize( count );
+    rngs.resize( count );
+    pixels.resize( count );
+    from_geoms.resize( count );
+    bounces.resize( count );
+    hit_geoms.resize( count );
+    hit_times.resize( count );
+    hit_primitives.resize( count );
+    hit_betas.resize( count );
+    hit_gammas.resize( count );
+    alive.resize( count );
+    shadow_origins.resize( count * shadows_per_path );
+    shadow_targets.resize( count * shadows_per_path );
+    shadow_geoms.resize( count * shadows_per_path );
+    shadow_contributions.resize( count * shadows_per_path );
+    shadow_visible.resize( count * shadows_per_path );
+}
+
+void PathTracer::generate( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end, size_t pass )
+{
+    // the same camera as Raytracer::getRay
+    const Camera& camera = scene->camera;
+    real_t near_clip = fabs( camera.get_near_clip() );
+    real_t alpha = near_clip * tan( camera.get_fov_radians() / 2 );
+    real_t beta = camera.get_aspect_ratio() * alpha;
+    Vector3 right = -normalize( cross( camera.get_up(), camera.get_direction() ) );
+    eye = camera.get_position();
+    near_center = eye + camera.get_direction() * near_clip;
+    up_extent = alpha * camera.get_up();
+    right_extent = beta * right;
+
+    num_paths = ( x_end - x_begin ) * ( row_end - row_begin );
+    resize( num_paths );
+    radiance.assign( num_paths, Color3::Black );
+
+    size_t i = 0;
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x, ++i ) {
+            // seeded by pixel and pass, like the raytracer's
+            Random& rng = rngs[i];
+            rng.set_seed( Random::hash( x ^ Random::hash( y ^ Random::hash( pass ) ) ) );
+
+            // a random point in the pixel, for antialiasing
+            real_t h = ( ( x + rng.next_real() ) / width - 0.5 ) * 2.0;
+            real_t v = ( ( y + rng.next_real() ) / height - 0.5 ) * 2.0;
+            Vector3 target = near_center + v * up_extent + h * right_extent;
+
+            origins[i] = eye;
+            directions[i] = normalize( target - eye );
+            throughputs[i] = Color3::White;
+            pixels[i] = i;
+            from_geoms[i] = -1;
+            bounces[i] = 0;
+        }
+    }
+}
+
+void PathTracer::extend()
+{
+    ExtendStage stage;
+    stage.tracer = this;
+    run_stage( num_paths, stage );
+}
+
+void PathTracer::shade()
+{
+    ShadeStage stage;
+    stage.tracer = this;
+    run_stage( num_paths, stage );
+}
+
+void PathTracer::connect()
+{
+    ConnectStage stage;
+    stage.tracer = this;
+    run_stage( num_paths * shadows_per_path, stage );
+
+    // several shadow rays may light one pixel, so add them up here
+    for ( size_t i = 0; i < num_paths * shadows_per_path; ++i ) {
+        if ( shadow_visible[i] )
+            radiance[pixels[i / shadows_per_path]] += shadow_contributions[i];
+    }
+}
+
+size_t PathTracer::compact()
+{
+    size_t count = 0;
+    for ( size_t i = 0; i < num_paths; ++i ) {
+        if ( !alive[i] )
+            continue;
+        if ( count != i ) {
+            origins[count] = origins[i];
+            directions[count] = directions[i];
+            throughputs[count] = throughputs[i];
+            rngs[count] = rngs[i];
+            pixels[count] = pixels[i];
+            from_geoms[count] = from_geoms[i];
+            bounces[count] = bounces[i];
+        }
+        ++count;
+    }
+    return count;
+}
+
+void PathTracer::trace_tile( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end,
+                             size_t pass, Framebuffer* framebuffer, float* depths )
+{
+    assert( scene && x_begin < x_end && x_end <= width );
+    assert( row_begin < row_end && row_end <= height );
+
+    generate( x_begin, x_end, row_begin, row_end, pass );
+    bool camera_rays = true;
+    while ( num_paths > 0 ) {
+        extend();
+
+        // every path is still in pixel order after the first extend
+        if ( camera_rays && depths ) {
+            size_t tile_width = x_end - x_begin;
+            for ( size_t i = 0; i < num_paths; ++i ) {
+                size_t x = x_begin + i % tile_width;
+                size_t y = row_begin + i / tile_width;
+                depths[y * width + x] = hit_geoms[i] >= 0 ?
+                    float( hit_times[i] ) : std::numeric_limits< float >::infinity();
+            }
+        }
+        camera_rays = false;
+
+        shade();
+        connect();
+        num_paths = compact();
+    }
+
+    size_t i = 0;
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x, ++i ) {
+            framebuffer->add_sample( x, y, radiance[i] );
+        }
+    }
+}
+
+} /* _462 */
@@ -0,0 +1,149 @@
+/**
+ * @file path_tracer.hpp
+ * @brief A wavefront path tracer, the alternative to Raytracer's recursion.
+ */
+
+#ifndef _462_RAYTRACER_PATH_TRACER_HPP_
+#define _462_RAYTRACER_PATH_TRACER_HPP_
+
+#include "math/color.hpp"
+#include "math/random.hpp"
+#include "math/vector.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+class Scene;
+class SceneAccel;
+class LightAccel;
+class Framebuffer;
+
+/**
+ * Traces one path per pixel through a tile of the image, breadth first, for
+ * global illumination. Every live path moves through the same stages
+ * together:
+ *  - generate: a jittered camera ray per pixel.
+ *  - extend: finds what each path's ray hits.
+ *  - shade: adds the background to paths that missed, queues a shadow ray
+ *    to a light sampled by power and one to each area light, and picks the
+ *    next bounce from the surface's diffuse and mirror reflectance.
+ *  - connect: traces the shadow rays and adds the light of those that are
+ *    unblocked.
+ * Dead paths are then compacted away and the stages repeat until none
+ * are left. Each stage is a small loop over arrays of one field per path,
+ * run on every processor.
+ *
+ * Lights are attenuated as in the raytracer, but a surface's diffuse light
+ * is scaled by the cosine to the light alone, where the raytracer also
+ * scales it by the distance. Surfaces reflect diffuse light by the
+ * lambertian brdf, diffuse / PI, for lights and bounces alike, so a light's
+ * color is its intensity and images are darker than raytraced ones. The
+ * scene's ambient light is left out, as bounced light replaces it, and the
+ * background lights the scene as a uniform sky of that radiance.
+ */
+class PathTracer
+{
+public:
+
+    PathTracer();
+    ~PathTracer();
+
+    /**
+     * Sets the scene to trace, with structures already built over it. They
+     * must not change while tracing.
+     */
+    void initialize( const Scene* scene, const SceneAccel* accel, const LightAccel* light_accel,
+                     size_t width, size_t height );
+
+    /// Sets the most surfaces a path may bounce off.
+    void set_max_bounces( size_t bounces ) { max_bounces = bounces; }
+
+    /**
+     * Traces a path through each pixel of columns [x_begin, x_end) of
+     * rows [row_begin, row_end), adding its light to the pixel as one
+     * sample.
+     * @param pass Selects the random numbers, so passes differ but traces
+     *  are reproducible.
+     * @param depths If non-null, an array of a float per pixel of the
+     *  image, in row-major order, set to the distance to each traced
+     *  pixel's first hit, or infinity if it has none.
+     */
+    void trace_tile( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end,
+                     size_t pass, Framebuffer* framebuffer, float* depths );
+
+private:
+
+    // the stages run by parallel_for
+    struct ExtendStage;
+    struct ShadeStage;
+    struct ConnectStage;
+
+    void generate( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end, size_t pass );
+    void extend();
+    void shade();
+    void connect();
+    // moves the live paths to the front, returning how many there are
+    size_t compact();
+    // resizes every per-path array
+    void resize( size_t count );
+
+    // runs body over [0, count) on every processor, if the scene allows it
+    template< typename Body >
+    void run_stage( size_t count, Body& body );
+
+    const Scene* scene;
+    const SceneAccel* accel;
+    const LightAccel* light_accel;
+    size_t width, height;
+    size_t max_bounces;
+    // false if tracing from several threads is unsafe, e.g. for meshes
+    // streamed from disk
+    bool threaded;
+
+    // the live paths, one element of each array per path
+    size_t num_paths;
+    std::vector< Vector3 > origins;
+    std::vector< Vector3 > directions;
+    // how much of the light found next reaches the pixel
+    std::vector< Color3 > throughputs;
+    std::vector< Random > rngs;
+    // index of the pixel in radiance
+    std::vector< unsigned int > pixels;
+    // the geometry each ray leaves, or -1 for camera rays
+    std::vector< int > from_geoms;
+    std::vector< unsigned int > bounces;
+
+    // what each path's ray hit, filled in by extend
+    std::vector< int > hit_geoms;
+    std::vector< real_t > hit_times;
+    std::vector< unsigned int > hit_primitives;
+    std::vector< real_t > hit_betas;
+    std::vector< real_t > hit_gammas;
+
+    // whether each path goes on after shade
+    std::vector< unsigned char > alive;
+
+    // shadow rays, shadows_per_path for each path in order. unused ones
+    // have a black contribution.
+    size_t shadows_per_path;
+    std::vector< Vector3 > shadow_origins;
+    std::vector< Vector3 > shadow_targets;
+    std::vector< int > shadow_geoms;
+    // the light added if the ray is unblocked
+    std::vector< Color3 > shadow_contributions;
+    std::vector< unsigned char > shadow_visible;
+
+    // the light found for each pixel of the tile being traced
+    std::vector< Color3 > radiance;
+
+    // camera basis for the tile being traced
+    Vector3 eye;
+    Vector3 near_center;
+    Vector3 up_extent;
+    Vector3 right_extent;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_PATH_TRACER_HPP_ */
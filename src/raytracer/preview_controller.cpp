@@ -0,0 +1,71 @@
+/**
+ * @file preview_controller.cpp
+ * @brief Picks the resolution of interactive raytraces.
+ */
+
+#include "raytracer/preview_controller.hpp"
+
+#include <algorithm>
+
+namespace _462 {
+
+// weight of the newest measurement in the running averages
+#define AVERAGE_WEIGHT (0.25)
+// the least time to measure before averaging it in. the timer counts
+// milliseconds, so shorter spans are mostly rounding.
+#define MIN_MEASURED_TIME (0.02)
+// time kept free each frame for events and swapping buffers
+#define FRAME_MARGIN (0.002)
+// the least fraction of a frame given to raytracing, however slow drawing is
+#define MIN_BUDGET_FRACTION (0.25)
+
+const int PreviewController::MAX_SCALE;
+
+PreviewController::PreviewController()
+    : pixel_cost( -1 ), render_cost( 0 ), pending_pixels( 0 ), pending_seconds( 0 ) { }
+
+real_t PreviewController::get_budget( real_t period ) const
+{
+    return std::max( period - render_cost - FRAME_MARGIN, period * MIN_BUDGET_FRACTION );
+}
+
+int PreviewController::get_initial_scale( int width, int height, real_t period ) const
+{
+    // nothing measured yet, so start as cheaply as possible
+    if ( pixel_cost < 0 )
+        return MAX_SCALE;
+
+    real_t budget = get_budget( period );
+    int scale = 1;
+    while ( scale < MAX_SCALE ) {
+        real_t pixels = real_t( std::max( width / scale, 1 ) ) * real_t( std::max( height / scale, 1 ) );
+        if ( pixels * pixel_cost <= budget )
+            break;
+        scale *= 2;
+    }
+    return scale;
+}
+
+void PreviewController::record_trace( size_t pixels, real_t seconds )
+{
+    pending_pixels += pixels;
+    pending_seconds += seconds;
+    if ( pending_seconds < MIN_MEASURED_TIME || pending_pixels == 0 )
+        return;
+
+    real_t cost = pending_seconds / pending_pixels;
+    if ( pixel_cost < 0 ) {
+        pixel_cost = cost;
+    } else {
+        pixel_cost += AVERAGE_WEIGHT * ( cost - pixel_cost );
+    }
+    pending_pixels = 0;
+    pending_seconds = 0;
+}
+
+void PreviewController::record_render( real_t seconds )
+{
+    render_cost += AVERAGE_WEIGHT * ( seconds - render_cost );
+}
+
+} /* _462 */
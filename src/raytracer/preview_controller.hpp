@@ -0,0 +1,65 @@
+/**
+ * @file preview_controller.hpp
+ * @brief Picks the resolution of interactive raytraces.
+ */
+
+#ifndef _462_RAYTRACER_PREVIEW_CONTROLLER_HPP_
+#define _462_RAYTRACER_PREVIEW_CONTROLLER_HPP_
+
+#include "math/math.hpp"
+
+namespace _462 {
+
+/**
+ * Keeps an interactive raytrace at the window's frame rate. Each frame, the
+ * raytracer is given what is left of the frame period once drawing is paid
+ * for, and stops at the first tile past it. The controller learns the
+ * recent cost of a pixel from how much each frame traced, and uses it to
+ * pick the coarsest preview worth showing: the finest resolution that can
+ * be traced in a single frame. Previews are then refined by halving the
+ * scale until the image is at full resolution.
+ */
+class PreviewController
+{
+public:
+
+    /// The coarsest scale, in window pixels per traced pixel.
+    static const int MAX_SCALE = 16;
+
+    PreviewController();
+
+    /**
+     * Returns the seconds the raytracer may take in a frame of the given
+     * period, leaving time to draw it.
+     */
+    real_t get_budget( real_t period ) const;
+
+    /**
+     * Returns the scale of the first preview of a width by height image,
+     * a power of two: the smallest whose whole image is expected to take
+     * at most one frame's budget.
+     */
+    int get_initial_scale( int width, int height, real_t period ) const;
+
+    /// Records that a frame traced the given number of pixels.
+    void record_trace( size_t pixels, real_t seconds );
+
+    /// Records the time taken to draw a frame.
+    void record_render( real_t seconds );
+
+private:
+
+    // recent seconds per traced pixel, negative until measured
+    real_t pixel_cost;
+    // recent seconds to draw a frame
+    real_t render_cost;
+
+    // traced but not yet averaged in, as frames may be shorter than the
+    // timer can measure
+    size_t pending_pixels;
+    real_t pending_seconds;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_PREVIEW_CONTROLLER_HPP_ */
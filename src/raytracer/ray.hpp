@@ -0,0 +1,23 @@
+/**
+ * @file ray.hpp
+ * @brief Ray type shared by the raytracer and geometries.
+ */
+
+#ifndef _462_RAYTRACER_RAY_HPP_
+#define _462_RAYTRACER_RAY_HPP_
+
+#include "math/vector.hpp"
+
+#define SLOP_FACTOR (0.000001)
+
+namespace _462 {
+
+	typedef struct{
+		Vector3 eye;
+		Vector3 direction;
+		Vector3 end;
+	}ray_t;
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_RAY_HPP_ */
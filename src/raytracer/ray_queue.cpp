@@ -0,0 +1,69 @@
+/**
+ * @file ray_queue.cpp
+ * @brief Rays waiting to be traced breadth first.
+ */
+
+#include "raytracer/ray_queue.hpp"
+#include "scene/bvh.hpp"
+
+#include <algorithm>
+
+namespace _462 {
+
+// bits of each coordinate in the Morton code, leaving 3 for the octant
+#define MORTON_BITS 9
+
+// spreads the low MORTON_BITS bits of v out to every third bit
+static unsigned int spread_bits( unsigned int v )
+{
+    v &= 0x1ff;
+    v = ( v | ( v << 16 ) ) & 0x030000ff;
+    v = ( v | ( v << 8 ) ) & 0x0300f00f;
+    v = ( v | ( v << 4 ) ) & 0x030c30c3;
+    v = ( v | ( v << 2 ) ) & 0x09249249;
+    return v;
+}
+
+// quantizes x in [min, min + 1 / scale] to MORTON_BITS bits
+static unsigned int quantize( real_t x, real_t min, real_t scale )
+{
+    static const real_t MAX = ( 1 << MORTON_BITS ) - 1;
+    real_t q = ( x - min ) * scale * MAX;
+    return (unsigned int) clamp( q, real_t( 0 ), MAX );
+}
+
+void RayQueue::sort()
+{
+    BoundingBox bounds;
+    for ( size_t i = 0; i < rays.size(); ++i ) {
+        bounds.expand( rays[i].ray.eye );
+    }
+
+    // scale the largest side to [0, 1], keeping the cells cubes
+    Vector3 size = bounds.max - bounds.min;
+    real_t extent = std::max( size.x, std::max( size.y, size.z ) );
+    real_t scale = extent > 0 ? 1.0 / extent : 0;
+
+    keys.resize( rays.size() );
+    for ( size_t i = 0; i < rays.size(); ++i ) {
+        const ray_t& ray = rays[i].ray;
+        unsigned int octant = ( ray.direction.x < 0 ? 4 : 0 )
+                            | ( ray.direction.y < 0 ? 2 : 0 )
+                            | ( ray.direction.z < 0 ? 1 : 0 );
+        unsigned int morton = ( spread_bits( quantize( ray.eye.x, bounds.min.x, scale ) ) << 2 )
+                            | ( spread_bits( quantize( ray.eye.y, bounds.min.y, scale ) ) << 1 )
+                            | spread_bits( quantize( ray.eye.z, bounds.min.z, scale ) );
+        keys[i].first = ( octant << ( 3 * MORTON_BITS ) ) | morton;
+        // ties are broken by index, so the sort is stable
+        keys[i].second = i;
+    }
+    std::sort( keys.begin(), keys.end() );
+
+    sorted.resize( rays.size() );
+    for ( size_t i = 0; i < keys.size(); ++i ) {
+        sorted[i] = rays[keys[i].second];
+    }
+    rays.swap( sorted );
+}
+
+} /* _462 */
@@ -0,0 +1,75 @@
+/**
+ * @file ray_queue.hpp
+ * @brief Rays waiting to be traced breadth first.
+ */
+
+#ifndef _462_RAYTRACER_RAY_QUEUE_HPP_
+#define _462_RAYTRACER_RAY_QUEUE_HPP_
+
+#include "math/color.hpp"
+#include "math/random.hpp"
+#include "raytracer/ray.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/// A ray along with everything needed to add what it finds to its pixel.
+struct QueuedRay
+{
+    ray_t ray;
+    // how much of what the ray finds reaches the pixel
+    Color3 weight;
+    // the pixel's generator, carried along so each pixel draws the same
+    // numbers in the same order as when traced depth first
+    Random rng;
+    // the pixel
+    unsigned int x, y;
+    // bounces left at what the ray hits
+    int depth;
+    // the geometry the ray leaves, or -1 for camera rays
+    int geom;
+};
+
+/**
+ * A generation of rays, e.g. all the reflection rays of a group of rows.
+ * Sorting the queue before tracing it puts rays that are likely to visit
+ * the same nodes and geometries next to each other, so they find them
+ * still in cache.
+ */
+class RayQueue
+{
+public:
+
+    void push( const QueuedRay& ray ) { rays.push_back( ray ); }
+    void clear() { rays.clear(); }
+    bool empty() const { return rays.empty(); }
+    size_t size() const { return rays.size(); }
+
+    QueuedRay& operator[]( size_t index ) { return rays[index]; }
+    const QueuedRay& operator[]( size_t index ) const { return rays[index]; }
+
+    /**
+     * Sorts the rays by the octant of their direction, then along a Morton
+     * curve through the bounds of their origins. Rays with equal keys keep
+     * their order.
+     */
+    void sort();
+
+    void swap( RayQueue& other ) { rays.swap( other.rays ); }
+
+private:
+
+    typedef std::vector< QueuedRay > RayList;
+    // sort key and index of each ray
+    typedef std::vector< std::pair< unsigned int, unsigned int > > KeyList;
+
+    RayList rays;
+    // kept between sorts to reuse the memory
+    KeyList keys;
+    RayList sorted;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_RAY_QUEUE_HPP_ */
@@ -9,25 +9,108 @@
  */
 
 #include "raytracer.hpp"
+#include "math/random.hpp"
 #include "scene/scene.hpp"
+#include "application/parallel.hpp"
 
 #include <SDL/SDL_timer.h>
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 
 namespace _462 {
 
-Color3 calcColor(real_t time, ray_t ray, int bestGeom, const Scene* scene, int depth);
-real_t lastLength;
+// the farthest a reflected ray may travel
+#define MAX_REFLECTION_TIME (100)
+
+// the widest tile traced between checks of the time
+#define TILE_WIDTH (64)
+
+// rows of a tile when tracing breadth first
+#define WAVEFRONT_ROWS (8)
+
+// rows of a tile when path tracing. more paths per stage keep more
+// threads busy.
+#define PATH_TRACING_ROWS (32)
+
+// rows of a tile when tracing pixels one at a time on several threads, and
+// the pixels given to a thread at once
+#define PARALLEL_ROWS (8)
+#define PIXEL_GRAIN (64)
+
+/**
+ * Traces pixels [begin, end) of a tile in scanline order, each on its own,
+ * so chunks of pixels may run on different threads.
+ */
+struct Raytracer::PixelStage
+{
+    Raytracer* raytracer;
+    size_t x_begin;
+    size_t row_begin;
+    size_t tile_width;
+
+    void operator()( size_t begin, size_t end ) {
+        for ( size_t i = begin; i < end; ++i ) {
+            size_t x = x_begin + i % tile_width;
+            size_t y = row_begin + i / tile_width;
+            size_t index = y * raytracer->width + x;
+            if ( raytracer->states[index] == PIXEL_REUSED )
+                continue;
+            Color3 color = raytracer->trace_pixel( x, y, &raytracer->depths[index], &raytracer->states[index] );
+            raytracer->framebuffer.add_sample( x, y, color );
+        }
+    }
+};
+
+/**
+ * Checks pixels [begin, end) of the image that were reused from the last
+ * raytrace by finding their first hit, without shading it. Those whose
+ * hit is not where the reused one was are covered by something the cache
+ * did not know of, so they are cleared to be traced.
+ */
+struct Raytracer::VisibilityStage
+{
+    Raytracer* raytracer;
+
+    void operator()( size_t begin, size_t end ) {
+        Raytracer& r = *raytracer;
+        for ( size_t i = begin; i < end; ++i ) {
+            if ( r.states[i] != PIXEL_REUSED )
+                continue;
+
+            size_t x = i % r.width;
+            size_t y = i / r.width;
+            real_t time;
+            Hit hit;
+            float depth = std::numeric_limits< float >::infinity();
+            if ( r.accel.intersect( r.getRay( x, y ), 0, std::numeric_limits< real_t >::infinity(), -1, &time, &hit ) >= 0 )
+                depth = float( time );
+            if ( is_same_depth( depth, r.depths[i] ) )
+                continue;
+
+            r.framebuffer.clear( x, x + 1, y, y + 1 );
+            r.depths[i] = std::numeric_limits< float >::infinity();
+            r.states[i] = PIXEL_UNTRACED;
+        }
+    }
+};
 
 Raytracer::Raytracer()
-    : scene( 0 ), width( 0 ), height( 0 ) { }
+    : scene( 0 ), width( 0 ), height( 0 ), threaded( false ), reprojection( false ),
+      pixels_reused( 0 ), light_samples( 0 ), wavefront( false ), path_tracing( false ),
+      num_passes( 1 ), crop_x_begin( 0 ), crop_x_end( 0 ), crop_row_begin( 0 ),
+      crop_row_end( 0 ), pixels_traced( 0 ) { }
 
 Raytracer::~Raytracer() { }
 
 /**
  * Initializes the raytracer for the given scene. Overrides any previous
  * initializations. May be invoked before a previous raytrace completes.
+ * If the scene still holds the same geometries as the last initialization,
+ * the acceleration structure is only refit to their current transforms
+ * rather than rebuilt. If reprojection is enabled, what the last raytrace
+ * of the scene found is kept, and the pixels it can fill in are not traced.
  * @param scene The scene to raytrace.
  * @param width The width of the image being raytraced.
  * @param height The height of the image being raytraced.
@@ -36,244 +119,522 @@ Raytracer::~Raytracer() { }
  */
 bool Raytracer::initialize( Scene* scene, size_t width, size_t height )
 {
+    if ( reprojection && !path_tracing && scene == this->scene && !states.empty() ) {
+        cache.store( view, framebuffer, &depths[0], &states[0] );
+    } else {
+        cache.clear();
+    }
+
     this->scene = scene;
     this->width = width;
     this->height = height;
 
-    current_row = 0;
-
-    // TODO any initialization or precompuation before the trace
+    clip_window();
+    current_pass = 0;
+    current_row = window_row_begin;
+    current_column = window_x_begin;
+    framebuffer.resize( width, height );
+    view = CameraView( scene->camera, width, height );
+    depths.assign( width * height, std::numeric_limits< float >::infinity() );
+    states.assign( width * height, PIXEL_UNTRACED );
+
+    if ( accel.is_valid_for( scene ) ) {
+        accel.refit();
+    } else {
+        accel.build( scene );
+    }
+    light_accel.build( scene );
+    threaded = accel.is_thread_safe() && parallel_num_threads() > 1;
+    path_tracer.initialize( scene, &accel, &light_accel, width, height );
+
+    pixels_reused = 0;
+    if ( reprojection && !path_tracing && cache.reproject( view, &framebuffer, &depths[0], &states[0] ) > 0 ) {
+        VisibilityStage stage;
+        stage.raytracer = this;
+        if ( threaded ) {
+            parallel_for( states.size(), PIXEL_GRAIN, stage );
+        } else {
+            stage( 0, states.size() );
+        }
+        pixels_reused = std::count( states.begin(), states.end(), (unsigned char) PIXEL_REUSED );
+    }
 
     return true;
 }
 
-ray_t transform(ray_t curRay, const Geometry& geom){
-
-	Matrix4 transform;
-	Vector4 eye;
-	Vector4 direction;
-	Vector4 end;
-
-	eye = Vector4(curRay.eye.x, curRay.eye.y, curRay.eye.z, 1.0);
-	end = Vector4(curRay.end.x, curRay.end.y, curRay.end.z, 1.0);
+void Raytracer::initialize_image( size_t width, size_t height )
+{
+    cache.clear();
+    scene = 0;
+    this->width = width;
+    this->height = height;
 
-	make_inverse_transformation_matrix(&transform, geom.position, geom.orientation, geom.scale);
+    clip_window();
+    current_pass = 0;
+    current_row = window_row_begin;
+    current_column = window_x_begin;
+    framebuffer.resize( width, height );
+    depths.assign( width * height, std::numeric_limits< float >::infinity() );
+    states.assign( width * height, PIXEL_UNTRACED );
+    pixels_reused = 0;
+}
 
-	eye = transform * eye;
-	end = transform * end;
+void Raytracer::set_crop_window( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end )
+{
+    crop_x_begin = x_begin;
+    crop_x_end = x_end;
+    crop_row_begin = row_begin;
+    crop_row_end = row_end;
+}
 
-	curRay.eye = Vector3(eye.x, eye.y, eye.z);
-	direction = end - eye;
-	lastLength = length(direction);
-	direction = normalize(direction);
-	curRay.end = Vector3(end.x, end.y, end.z);
-	curRay.direction = Vector3(direction.x, direction.y, direction.z);
+void Raytracer::clip_window()
+{
+    window_x_begin = 0;
+    window_x_end = width;
+    window_row_begin = 0;
+    window_row_end = height;
+    if ( crop_x_begin < crop_x_end && crop_row_begin < crop_row_end ) {
+        window_x_end = std::min( crop_x_end, width );
+        window_x_begin = std::min( crop_x_begin, window_x_end );
+        window_row_end = std::min( crop_row_end, height );
+        window_row_begin = std::min( crop_row_begin, window_row_end );
+        // a window with no columns has no rows to trace either
+        if ( window_x_begin == window_x_end )
+            window_row_end = window_row_begin;
+    }
+}
 
-	return curRay;
+void Raytracer::restart()
+{
+    assert( scene );
+
+    clip_window();
+    current_pass = 0;
+    current_row = window_row_begin;
+    current_column = window_x_begin;
+
+    framebuffer.clear( window_x_begin, window_x_end, window_row_begin, window_row_end );
+    for ( size_t y = window_row_begin; y < window_row_end; ++y ) {
+        size_t begin = y * width + window_x_begin;
+        size_t end = y * width + window_x_end;
+        std::fill( depths.begin() + begin, depths.begin() + end, std::numeric_limits< float >::infinity() );
+        std::fill( states.begin() + begin, states.begin() + end, (unsigned char) PIXEL_UNTRACED );
+    }
+    pixels_reused = 0;
 }
 
+void Raytracer::add_samples( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end,
+                             const float* rgb, unsigned char* buffer )
+{
+    assert( x_begin <= x_end && x_end <= width );
+    assert( row_begin <= row_end && row_end <= height );
+
+    size_t block_width = x_end - x_begin;
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x ) {
+            const float* p = &rgb[3 * ( ( y - row_begin ) * block_width + x - x_begin )];
+            framebuffer.add_sample( x, y, Color3( p[0], p[1], p[2] ) );
+        }
+    }
+    framebuffer.tonemap( buffer, x_begin, x_end, row_begin, row_end );
+}
 
-ray_t getRay( const Scene* scene, size_t x, size_t y, size_t width, size_t height){
+ray_t Raytracer::getRay( size_t x, size_t y ) const
+{
+	return view.get_ray(x, y);
+}
 
-	ray_t returnRay;
-	real_t alpha;	//near plane height / 2
-	real_t beta;	//near plane width / 2
-	real_t hPercent; // horizontal position from -1.0 to 1.0
-	real_t vPercent; // vertical position from -1.0 to 1.0
-	Vector3 s;
-	Vector3 e;
-	Vector3 npc; //near plane center point
-	Vector3 leftVector;
+bool Raytracer::hitLight( const ray_t& shadowRay, const PointLight& light, int thisGeom ) const
+{
+	real_t maxTime = length(light.position - shadowRay.eye);
+	return !accel.is_occluded( shadowRay, SLOP_FACTOR, maxTime, thisGeom );
+}
 
-	Camera cam = scene->camera;
-	
-	hPercent = ((1.0 * x / width) - 0.5) * 2.0;
-	vPercent = ((1.0 * y / height) - 0.5) * 2.0;
+Color3 Raytracer::traceSpecularColor( const ray_t& reflectedRay, int depth, int thisGeom, Random* rng ) const
+{
+	real_t bestTime;
+	Hit hit;
+	int bestGeom = accel.intersect( reflectedRay, SLOP_FACTOR, MAX_REFLECTION_TIME, thisGeom, &bestTime, &hit );
 
-	alpha = fabs(cam.get_near_clip()) * tan( cam.get_fov_radians() / 2 );
-	beta = cam.get_aspect_ratio() * alpha;
+	if(bestGeom >= 0)
+		return calcColor(reflectedRay, bestGeom, bestTime, hit, depth, rng);
+	else
+		return scene->background_color;
+}
 
-	e = cam.get_position();
-	npc = e + (cam.get_direction() * fabs(cam.get_near_clip()));
+bool Raytracer::lightVisible( const PointLight& light, const Vector3& ptIntersection, int thisGeom ) const
+{
+	Vector3 lPos = light.position;
+	Vector3 vLight = lPos - ptIntersection;
+	//normalized vLight at one point...
+	// matters?
+	ray_t shadowRay;
+	shadowRay.eye = ptIntersection;
+	shadowRay.direction = normalize(vLight);
+	shadowRay.end = lPos;
+	return hitLight(shadowRay, light, thisGeom);
+}
 
-	leftVector = normalize(cross(cam.get_up(),cam.get_direction()));
+Color3 Raytracer::unshadowedLight( const PointLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k ) const
+{
+	Vector3 vLight = light.position - ptIntersection;
+	real_t d = length(vLight);
+	real_t a = dot(normal,vLight);
+	real_t b = 0;
 
-	s = npc + (alpha * vPercent * cam.get_up()) - (beta * hPercent * leftVector);
+	real_t max = (a > b) ? a : b;
 
-	returnRay.eye = e;
-	returnRay.direction = normalize(s - e);
-	returnRay.end = s;
+	real_t atten = LightAccel::attenuation(light, d);
+	Color3 c = Color3(light.color.r / atten, light.color.g / atten, light.color.b / atten);
 
-	return returnRay;
+	return c * k * max;
 }
 
-bool hitLight(ray_t shadowRay, PointLight light, const Scene* scene, int thisGeom){
-
-	ray_t tRay;
-	real_t time;
-
-	Geometry* const* geometries = scene->get_geometries();
-	Material* const* materials = scene->get_materials();
-
-	real_t maxTime = length(light.position - shadowRay.eye);
+Color3 Raytracer::directLight( const PointLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom ) const
+{
+	if(!lightVisible(light, ptIntersection, thisGeom))
+		return Color3::Black;
+	return unshadowedLight(light, ptIntersection, normal, k);
+}
 
-    for ( size_t i = 0; i < scene->num_geometries(); i++ ) {	
-        Geometry& geom = *geometries[i];
-		tRay = transform(shadowRay, geom);
-		time = geom.intersect(tRay);
-		if( (time > SLOP_FACTOR) && (time < maxTime) && (i != thisGeom) )
-			return false;
+Color3 Raytracer::areaLight( const AreaLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom, Random* rng ) const
+{
+	// each sample is a point light of the whole light's color, so the
+	// average of the samples shades like the whole light
+	PointLight sample;
+	sample.color = light.color;
+	sample.attenuation = light.attenuation;
+
+	// one jittered sample per quadrant. if they all agree the point is
+	// fully lit or fully in shadow, and these are all the samples it gets
+	Color3 color = Color3::Black;
+	int numLit = 0;
+	for(int i = 0; i < 4; i++){
+		real_t u = ((i % 2) + rng->next_real()) / 2;
+		real_t v = ((i / 2) + rng->next_real()) / 2;
+		sample.position = light.sample(u, v, ptIntersection);
+		if(lightVisible(sample, ptIntersection, thisGeom)){
+			color += unshadowedLight(sample, ptIntersection, normal, k);
+			numLit++;
+		}
 	}
-
-	return true;
-
+	if(numLit == 0)
+		return Color3::Black;
+	if(numLit == 4)
+		return color * 0.25;
+
+	// in a penumbra, so take a jittered sample in every cell of the grid
+	unsigned int n = std::max(light.num_samples, 2u);
+	for(unsigned int y = 0; y < n; y++){
+		for(unsigned int x = 0; x < n; x++){
+			real_t u = (x + rng->next_real()) / n;
+			real_t v = (y + rng->next_real()) / n;
+			sample.position = light.sample(u, v, ptIntersection);
+			if(lightVisible(sample, ptIntersection, thisGeom))
+				color += unshadowedLight(sample, ptIntersection, normal, k);
+		}
+	}
+	return color * (1.0 / (4 + n * n));
 }
 
-Color3 traceSpecularColor(ray_t reflectedRay, const Scene* scene, int depth, int thisGeom){
+Color3 Raytracer::sampleLights( const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom, Random* rng ) const
+{
+	// each light picked stands in for all of them: weighting by one over
+	// its chance of being picked makes the expected sum the full sum
+	const PointLight* lights = scene->get_lights();
+	Color3 color = Color3::Black;
+	for(size_t i = 0; i < light_samples; i++){
+		real_t pdf;
+		unsigned int index = light_accel.sample(rng->next_real(), &pdf);
+		color += directLight(lights[index], ptIntersection, normal, k, thisGeom) * (1.0 / (light_samples * pdf));
+	}
+	return color;
+}
 
-	ray_t tRay;
-	real_t time;
-	real_t bestTime = 100;
+struct Raytracer::LightVisitor
+{
+	const Raytracer* raytracer;
+	const PointLight* lights;
+	const Vector3* ptIntersection;
+	const Vector3* normal;
 	int bestGeom;
+	// diffuse color of the surface
+	Color3 k;
+	// the light so far, to which each light's diffuse light is added
+	Color3 color;
 
-	Geometry* const* geometries = scene->get_geometries();
-	Material* const* materials = scene->get_materials();
+	void operator()( unsigned int index ) {
+		color += raytracer->directLight(lights[index], *ptIntersection, *normal, k, bestGeom);
+	}
+};
 
-    for ( size_t i = 0; i < scene->num_geometries(); i++ ) {	
-        Geometry& geom = *geometries[i];
-		tRay = transform(reflectedRay, geom);
-		time = geom.intersect(tRay);
-		if( (time > SLOP_FACTOR) && (time < bestTime) && (i != thisGeom) ){
-			bestTime = time;
-			bestGeom = i;
-		}
+Color3 Raytracer::shadeSurface( const SurfacePoint& surface, int bestGeom, Random* rng ) const
+{
+	const Vector3& ptIntersection = surface.position;
+	const Vector3& normal = surface.normal;
+	Color3 color = surface.ambient * scene->ambient_light;
+	Color3 k = surface.diffuse;
+
+	if(light_samples > 0){
+		if(light_accel.can_sample())
+			color += sampleLights(ptIntersection, normal, k, bestGeom, rng);
+	}
+	else{
+		// only lights that reach this point are shaded, before any shadow rays
+		LightVisitor visitor;
+		visitor.raytracer = this;
+		visitor.lights = scene->get_lights();
+		visitor.ptIntersection = &ptIntersection;
+		visitor.normal = &normal;
+		visitor.bestGeom = bestGeom;
+		visitor.k = k;
+		visitor.color = color;
+		light_accel.traverse( ptIntersection, visitor );
+		color = visitor.color;
 	}
 
-	if(bestTime < 100)
-		return calcColor(bestTime, reflectedRay, bestGeom, scene, depth);
-	//	return (*geometries[bestGeom]).getAmbientColor();
-	else
-		return scene->background_color;
+	const AreaLight* areaLights = scene->get_area_lights();
+	for(size_t i = 0; i < scene->num_area_lights(); i++)
+		color += areaLight(areaLights[i], ptIntersection, normal, k, bestGeom, rng);
 
+	return color * surface.texture;
 }
 
-Color3 calcColor(real_t time, ray_t ray, int bestGeom, const Scene* scene, int depth){
-
-	Geometry* const* geometries = scene->get_geometries();
-	Geometry& geom = *geometries[bestGeom];
-	Vector3 ptIntersection;
-	Vector3 normal;
-	Vector4 temp;
-	Matrix4 transform;
-	Color3 color = geom.getAmbientColor() * scene->ambient_light;
-	Color3 k = geom.getDiffuseColor();
-	Matrix3 normalMatrix;
-
-	make_transformation_matrix(&transform, geom.position, geom.orientation, geom.scale);
-
-	make_normal_matrix(&normalMatrix,transform);
-
-	normal = geom.getNormal();
-	normal = normalMatrix * normal;
-	normal = normalize(normal);
-
-	Vector3 testIntersect = geom.getIntersectionPt();
-	Vector4 test = Vector4(testIntersect.x, testIntersect.y, testIntersect.z, 1.0);
-	test = transform * test;
-	ptIntersection = Vector3(test.x, test.y, test.z);
-	//ptIntersection = ray.eye + (time * ray.direction);
-
-	const PointLight* lights = scene->get_lights();
+ray_t Raytracer::reflectRay( const ray_t& ray, const SurfacePoint& surface ) const
+{
+	real_t dDotn = dot(ray.direction, surface.normal);
+	ray_t reflectedRay;
+	reflectedRay.eye = surface.position;
+	reflectedRay.direction = ray.direction - (2 * dDotn * surface.normal);
+	reflectedRay.end = surface.position + reflectedRay.direction;
+	return reflectedRay;
+}
 
-	for( size_t i = 0; i < scene->num_lights(); i++){
-		PointLight light = lights[i];
-		Vector3 lPos = light.position;
-		Vector3 vLight = lPos - ptIntersection;
-		real_t d = length(vLight);
-		//normalized vLight at one point...
-		// matters?
-		ray_t shadowRay;
-		shadowRay.eye = ptIntersection;
-		shadowRay.direction = normalize(vLight);
-		shadowRay.end = lPos;
-		if(hitLight(shadowRay, light, scene, bestGeom)){
-			real_t a = dot(normal,vLight);
-			real_t b = 0;
-
-			real_t max = (a > b) ? a : b;
-
-			real_t atten = light.attenuation.constant + (light.attenuation.linear * d) + (light.attenuation.constant * d * d);
-			Color3 c = Color3(light.color.r / atten, light.color.g / atten, light.color.b / atten);
-		//Color3 c = light.color;
-
-			color += c * k * max;
-		}
-	}
+Color3 Raytracer::calcColor( const ray_t& ray, int bestGeom, real_t time, const Hit& hit, int depth, Random* rng ) const
+{
+	SurfacePoint surface;
+	accel.get_surface_point( ray, bestGeom, time, hit, &surface );
 
-	color = color * geom.getTextureColor();
+	Color3 color = shadeSurface(surface, bestGeom, rng);
 
-	if(depth > 0){
-		real_t dDotn = dot(ray.direction, normal);
-		ray_t reflectedRay;
-		reflectedRay.eye = ptIntersection;
-		reflectedRay.direction = ray.direction - (2 * dDotn * normal);
-		reflectedRay.end = ptIntersection + reflectedRay.direction;
-		color += geom.getTextureColor() * geom.getSpecularColor() * traceSpecularColor(reflectedRay, scene, depth - 1, bestGeom);
-	}
+	if(depth > 0)
+		color += surface.texture * surface.specular * traceSpecularColor(reflectRay(ray, surface), depth - 1, bestGeom, rng);
 	return color;
 }
 
+/**
+ * Returns the generator for the given pixel in the current pass. Seeded by
+ * pixel and pass, so images do not depend on trace order.
+ */
+Random Raytracer::pixelRandom( size_t x, size_t y ) const
+{
+    return Random( Random::hash( x ^ Random::hash( y ^ Random::hash( current_pass ) ) ) );
+}
+
 /**
  * Performs a raytrace on the given pixel on the current scene.
  * The pixel is relative to the bottom-left corner of the image.
- * @param scene The scene to trace.
  * @param x The x-coordinate of the pixel to trace.
  * @param y The y-coordinate of the pixel to trace.
- * @param width The width of the screen in pixels.
- * @param height The height of the screen in pixels.
+ * @param depth Set to the distance to the first hit, or infinity if none.
+ * @param state Set to the PixelState of the traced pixel.
  * @return The color of that pixel in the final image.
  */
-static Color3 trace_pixel( const Scene* scene, size_t x, size_t y, size_t width, size_t height )
+Color3 Raytracer::trace_pixel( size_t x, size_t y, float* depth, unsigned char* state ) const
 {
-	ray_t tRay;
-	real_t time;
-	real_t bestTime = 100000;
-	ray_t bestRay;
-	int bestGeom;
-
     assert( 0 <= x && x < width );
     assert( 0 <= y && y < height );
-    
-	ray_t curRay = getRay(scene, x, y, width, height);
-
-	Geometry* const* geometries = scene->get_geometries();
-	Material* const* materials = scene->get_materials();
-
-    for ( size_t i = 0; i < scene->num_geometries(); i++ ) {	
-        Geometry& geom = *geometries[i];
-		tRay = transform(curRay, geom);
-		time = geom.intersect(tRay);
-		real_t lastTime = time;
-		time = time / lastLength;
-		if( (time > 0) && (time < bestTime) ){
-			bestTime = time;
-			bestGeom = i;
-		}
-	}
 
-	if(bestTime < 100000)
-		return calcColor(bestTime, curRay, bestGeom, scene, MAX_DEPTH);
-	else
-		return scene->background_color;
+    ray_t curRay = getRay( x, y );
+    Random rng = pixelRandom( x, y );
+
+    real_t bestTime;
+    Hit hit;
+    int bestGeom = accel.intersect( curRay, 0, std::numeric_limits< real_t >::infinity(), -1, &bestTime, &hit );
+    *depth = bestGeom >= 0 ? float( bestTime ) : std::numeric_limits< float >::infinity();
+
+    if ( bestGeom < 0 ) {
+        *state = PIXEL_REUSABLE;
+        return scene->background_color;
+    }
+
+    // as calcColor, but noting whether the surface reflects anything, as
+    // only then does its color depend on where it is seen from
+    SurfacePoint surface;
+    accel.get_surface_point( curRay, bestGeom, bestTime, hit, &surface );
+    Color3 color = shadeSurface( surface, bestGeom, &rng );
+    Color3 reflectance = surface.texture * surface.specular;
+    if ( reflectance == Color3::Black ) {
+        *state = PIXEL_REUSABLE;
+    } else {
+        *state = PIXEL_VIEW_DEPENDENT;
+        color += reflectance * traceSpecularColor( reflectRay( curRay, surface ), MAX_DEPTH - 1, bestGeom, &rng );
+    }
+    return color;
 }
 
 
+/**
+ * Raytraces columns [x_begin, x_end) of rows [row_begin, row_end), adding a
+ * sample to each of their pixels. Pixels are traced one at a time, spread
+ * over every processor if the scene allows, unless tracing breadth first
+ * or path tracing.
+ *
+ * When tracing breadth first, each generation of rays is traced in full
+ * before the next. First the camera rays, already coherent in scanline order,
+ * then their reflections, sorted by direction and origin. Each hit adds
+ * its surface's light to the pixel, weighted by the product of the
+ * reflectances along the way, which sums to what calcColor finds
+ * recursively. Rays whose weight has dropped to zero are not traced.
+ *
+ * Pixels reused from the last raytrace are skipped.
+ * @return The number of pixels traced.
+ */
+size_t Raytracer::trace_tile( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end )
+{
+    assert( x_begin < x_end && x_end <= width );
+    assert( row_begin < row_end && row_end <= height );
+
+    size_t traced = ( x_end - x_begin ) * ( row_end - row_begin );
+    if ( pixels_reused > 0 ) {
+        for ( size_t y = row_begin; y < row_end; ++y ) {
+            for ( size_t x = x_begin; x < x_end; ++x ) {
+                if ( states[y * width + x] == PIXEL_REUSED )
+                    --traced;
+            }
+        }
+    }
+
+    if ( path_tracing ) {
+        path_tracer.trace_tile( x_begin, x_end, row_begin, row_end, current_pass, &framebuffer, &depths[0] );
+        return traced;
+    }
+
+    if ( !wavefront ) {
+        PixelStage stage;
+        stage.raytracer = this;
+        stage.x_begin = x_begin;
+        stage.row_begin = row_begin;
+        stage.tile_width = x_end - x_begin;
+        size_t count = stage.tile_width * ( row_end - row_begin );
+        if ( threaded ) {
+            parallel_for( count, PIXEL_GRAIN, stage );
+        } else {
+            stage( 0, count );
+        }
+        return traced;
+    }
+
+    size_t tile_width = x_end - x_begin;
+    tile_colors.assign( tile_width * ( row_end - row_begin ), Color3::Black );
+
+    queue.clear();
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x ) {
+            if ( states[y * width + x] == PIXEL_REUSED )
+                continue;
+            QueuedRay camera_ray;
+            camera_ray.ray = getRay( x, y );
+            camera_ray.weight = Color3::White;
+            camera_ray.rng = pixelRandom( x, y );
+            camera_ray.x = x;
+            camera_ray.y = y;
+            camera_ray.depth = MAX_DEPTH;
+            camera_ray.geom = -1;
+            queue.push( camera_ray );
+        }
+    }
+
+    while ( !queue.empty() ) {
+        next_queue.clear();
+
+        for ( size_t i = 0; i < queue.size(); ++i ) {
+            QueuedRay& queued = queue[i];
+            Color3& color = tile_colors[( queued.y - row_begin ) * tile_width + queued.x - x_begin];
+
+            real_t time;
+            Hit hit;
+            int geom;
+            if ( queued.geom < 0 ) {
+                geom = accel.intersect( queued.ray, 0, std::numeric_limits< real_t >::infinity(), -1, &time, &hit );
+            } else {
+                geom = accel.intersect( queued.ray, SLOP_FACTOR, MAX_REFLECTION_TIME, queued.geom, &time, &hit );
+            }
+
+            if ( queued.geom < 0 ) {
+                depths[queued.y * width + queued.x] = geom >= 0 ?
+                    float( time ) : std::numeric_limits< float >::infinity();
+                states[queued.y * width + queued.x] = PIXEL_REUSABLE;
+            }
+
+            if ( geom < 0 ) {
+                color += queued.weight * scene->background_color;
+                continue;
+            }
+
+            SurfacePoint surface;
+            accel.get_surface_point( queued.ray, geom, time, hit, &surface );
+            color += queued.weight * shadeSurface( surface, geom, &queued.rng );
+
+            Color3 weight = queued.weight * surface.texture * surface.specular;
+            if ( queued.geom < 0 && surface.texture * surface.specular != Color3::Black )
+                states[queued.y * width + queued.x] = PIXEL_VIEW_DEPENDENT;
+            if ( queued.depth > 0 && weight != Color3::Black ) {
+                QueuedRay reflected = queued;
+                reflected.ray = reflectRay( queued.ray, surface );
+                reflected.weight = weight;
+                reflected.depth = queued.depth - 1;
+                reflected.geom = geom;
+                next_queue.push( reflected );
+            }
+        }
+
+        next_queue.sort();
+        queue.swap( next_queue );
+    }
+
+    for ( size_t y = row_begin; y < row_end; ++y ) {
+        for ( size_t x = x_begin; x < x_end; ++x ) {
+            if ( states[y * width + x] != PIXEL_REUSED )
+                framebuffer.add_sample( x, y, tile_colors[( y - row_begin ) * tile_width + x - x_begin] );
+        }
+    }
+    return traced;
+}
+
+// returns the number of rows in a tile
+size_t Raytracer::tile_height() const
+{
+    if ( path_tracing )
+        return PATH_TRACING_ROWS;
+    if ( wavefront )
+        return WAVEFRONT_ROWS;
+    if ( threaded )
+        return PARALLEL_ROWS;
+    return 1;
+}
+
+void Raytracer::reproject( const CameraView& from, const unsigned char* colors, const float* from_depths,
+                           unsigned char* buffer )
+{
+    std::vector< float > warped_depths( depths.size() );
+    reproject_image( from, colors, from_depths, view, buffer, &warped_depths[0], scene->background_color );
+
+    // pixels filled in from the cache keep the depth of their own hit
+    for ( size_t i = 0; i < depths.size(); ++i ) {
+        if ( states[i] == PIXEL_UNTRACED )
+            depths[i] = warped_depths[i];
+    }
+}
+
 /**
  * Raytraces some portion of the scene. Should raytrace for about
  * max_time duration and then return, even if the raytrace is not copmlete.
  * The results should be placed in the given buffer.
  * @param buffer The buffer into which to place the color data. It is
- *  32-bit RGBA (4 bytes per pixel), in row-major order.
+ *  32-bit RGBA (4 bytes per pixel), in row-major order. The unclamped
+ *  colors are kept in the framebuffer, and only kept there if buffer is
+ *  null.
  * @param max_time, If non-null, the maximum suggested time this
  *  function raytrace before returning, in seconds. If null, the raytrace
  *  should run to completion.
@@ -288,7 +649,7 @@ bool Raytracer::raytrace( unsigned char *buffer, real_t* max_time )
 
     // the time in milliseconds that we should stop
     unsigned int end_time = 0;
-    bool is_done;
+    bool is_done = false;
 
     if ( max_time ) {
         // convert duration to milliseconds
@@ -296,26 +657,49 @@ bool Raytracer::raytrace( unsigned char *buffer, real_t* max_time )
         end_time = SDL_GetTicks() + duration;
     }
 
-    // until time is up, run the raytrace. we render an entire row at once
-    // for simplicity and efficiency.
-    for ( ; !max_time || end_time > SDL_GetTicks(); ++current_row ) {
+    pixels_traced = 0;
+
+    // until time is up, run the raytrace. we render a tile at a time,
+    // checking the time between tiles so that one slow row cannot take
+    // much longer than max_time. tiles go left to right along a band of
+    // rows of the crop window, then on to the next band.
+    while ( !max_time || end_time > SDL_GetTicks() ) {
+
+        // move on to the next band after its last tile
+        if ( current_column == window_x_end ) {
+            current_row = std::min( current_row + tile_height(), window_row_end );
+            current_column = window_x_begin;
+        }
+
+        // start the next pass after the last row, if there is one
+        if ( current_row == window_row_end && current_pass + 1 < num_passes ) {
+            ++current_pass;
+            current_row = window_row_begin;
+            printf( "Raytracing pass %u of %u...\n", (unsigned int) current_pass + 1, (unsigned int) num_passes );
+        }
 
-        if ( current_row % PRINT_INTERVAL == 0 ) {
+        // bands start on multiples of their height into the window, so
+        // every PRINT_INTERVAL'th row of it starts one
+        if ( current_column == window_x_begin && ( current_row - window_row_begin ) % PRINT_INTERVAL == 0 ) {
             printf( "Raytracing (row %u)...\n", current_row );
         }
 
         // we're done if we finish the last row
-        is_done = current_row == height;
+        is_done = current_row == window_row_end;
         // break if we finish
         if ( is_done )
             break;
 
-        for ( size_t x = 0; x < width; ++x ) {
-            // trace a pixel
-            Color3 color = trace_pixel( scene, x, current_row, width, height );
-            // write the result to the buffer, always use 1.0 as the alpha
-            color.to_array( &buffer[4 * ( current_row * width + x )] );
+        size_t rows = std::min( tile_height(), window_row_end - current_row );
+        size_t columns = std::min< size_t >( TILE_WIDTH, window_x_end - current_column );
+        pixels_traced += trace_tile( current_column, current_column + columns, current_row, current_row + rows );
+        // write the finished tile to the buffer, always use 1.0 as the alpha
+        if ( buffer ) {
+            framebuffer.tonemap( buffer, current_column, current_column + columns,
+                                 current_row, current_row + rows );
         }
+
+        current_column += columns;
     }
 
     if ( is_done ) {
@@ -13,19 +13,27 @@
 
 #include "math/color.hpp"
 #include "math/vector.hpp"
+#include "raytracer/ray.hpp"
+#include "raytracer/scene_accel.hpp"
+#include "raytracer/light_accel.hpp"
+#include "raytracer/framebuffer.hpp"
+#include "raytracer/ray_queue.hpp"
+#include "raytracer/path_tracer.hpp"
+#include "raytracer/camera_view.hpp"
+#include "raytracer/reprojection_cache.hpp"
+
+#include <vector>
 
-#define SLOP_FACTOR (0.000001)
 #define MAX_DEPTH (20)
 
 namespace _462 {
 
 class Scene;
-
-	typedef struct{
-		Vector3 eye;
-		Vector3 direction;
-		Vector3 end;
-	}ray_t;
+class Random;
+struct PointLight;
+struct AreaLight;
+struct Hit;
+struct SurfacePoint;
 
 class Raytracer
 {
@@ -38,18 +46,194 @@ public:
 
     bool initialize( Scene* scene, size_t width, size_t height );
 
+    /**
+     * Sets up only the image, for collecting samples traced elsewhere with
+     * add_samples. No scene is needed, so the accelerators are not built
+     * and meshes need not be loaded. The raytracer cannot trace until it
+     * is initialized with a scene.
+     */
+    void initialize_image( size_t width, size_t height );
+
     bool raytrace( unsigned char* buffer, real_t* max_time );
 
+    /**
+     * Sets the number of lights sampled at random per shading point, or 0
+     * to shade every light that reaches the point.
+     */
+    void set_light_samples( size_t count ) { light_samples = count; }
+
+    /**
+     * Sets the number of passes over the image. Each pass adds one sample
+     * per pixel, so sampled lighting converges as passes accumulate.
+     */
+    void set_num_passes( size_t passes ) { num_passes = passes; }
+
+    /**
+     * Sets whether to trace breadth first. Instead of following each
+     * pixel's reflections to the end before the next pixel, the camera
+     * rays of a tile are traced together, then all of their
+     * reflection rays, sorted so that similar rays are traced one after
+     * another, and so on. The image is the same either way.
+     */
+    void set_wavefront( bool enabled ) { wavefront = enabled; }
+
+    /**
+     * Sets whether to path trace with PathTracer instead of raytracing, for
+     * global illumination. Each pass traces one path per pixel, so images
+     * need many passes to converge.
+     */
+    void set_path_tracing( bool enabled ) { path_tracing = enabled; }
+
+    /**
+     * Sets whether to reuse pixels of the last raytrace of the same scene
+     * and image size, from a different camera, through a ReprojectionCache.
+     * Only pixels the cache cannot fill in are traced, so small camera moves
+     * cost a fraction of a full raytrace. Reused pixels are approximate,
+     * and nothing is reused when path tracing.
+     */
+    void set_reprojection( bool enabled ) { reprojection = enabled; }
+
+    /**
+     * Limits raytraces to columns [x_begin, x_end) of rows [row_begin,
+     * row_end) of the image, clipped to it at initialization. Pixels in the
+     * window come out exactly as in a raytrace of the whole image, and
+     * those outside it are left untouched. An empty window, the default,
+     * covers the whole image.
+     */
+    void set_crop_window( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end );
+
+    /**
+     * Starts the raytrace over within the crop window, clipped to the
+     * image, without the setup initialize does for a new scene or camera.
+     * Clears the samples of the window's pixels and goes back to the first
+     * pass. For tracing one image a window at a time; the raytracer must be
+     * initialized.
+     */
+    void restart();
+
+    // the unclamped result of the raytrace so far
+    const Framebuffer& get_framebuffer() const { return framebuffer; }
+
+    /**
+     * Adds a sample to each pixel of columns [x_begin, x_end) of rows
+     * [row_begin, row_end), as traced by another raytracer of the same
+     * scene, and writes them to the buffer as raytrace does.
+     * @param rgb 3 floats per pixel of the block, as from
+     *  Framebuffer::resolve.
+     */
+    void add_samples( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end,
+                      const float* rgb, unsigned char* buffer );
+
+    // the number of pixels traced by the last call to raytrace
+    size_t get_pixels_traced() const { return pixels_traced; }
+
+    // the number of pixels reused from the last raytrace at initialization
+    size_t get_pixels_reused() const { return pixels_reused; }
+
+    // the camera as it was at initialization
+    const CameraView& get_view() const { return view; }
+
+    /**
+     * Returns the distance along each pixel's camera ray to what it hit,
+     * in row-major order, or infinity for pixels that hit nothing or are
+     * not yet traced.
+     */
+    const float* get_depths() const { return &depths[0]; }
+
+    /**
+     * Fills the buffer with an image traced from another view, warped to
+     * this one with reproject_image, to show until each pixel is traced.
+     * Depths of the warped pixels are kept, so the result can be warped
+     * again if the view changes before the trace is done. Pixels reused
+     * from the last raytrace keep their own depths.
+     */
+    void reproject( const CameraView& from, const unsigned char* colors, const float* from_depths,
+                    unsigned char* buffer );
+
 private:
 
+    ray_t getRay( size_t x, size_t y ) const;
+    Color3 trace_pixel( size_t x, size_t y, float* depth, unsigned char* state ) const;
+    size_t trace_tile( size_t x_begin, size_t x_end, size_t row_begin, size_t row_end );
+    size_t tile_height() const;
+    // sets the window the raytrace covers from the crop window
+    void clip_window();
+    Random pixelRandom( size_t x, size_t y ) const;
+    Color3 shadeSurface( const SurfacePoint& surface, int thisGeom, Random* rng ) const;
+    ray_t reflectRay( const ray_t& ray, const SurfacePoint& surface ) const;
+    Color3 calcColor( const ray_t& ray, int bestGeom, real_t time, const Hit& hit, int depth, Random* rng ) const;
+    Color3 traceSpecularColor( const ray_t& reflectedRay, int depth, int thisGeom, Random* rng ) const;
+    bool hitLight( const ray_t& shadowRay, const PointLight& light, int thisGeom ) const;
+    bool lightVisible( const PointLight& light, const Vector3& ptIntersection, int thisGeom ) const;
+    Color3 unshadowedLight( const PointLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k ) const;
+    Color3 directLight( const PointLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom ) const;
+    Color3 areaLight( const AreaLight& light, const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom, Random* rng ) const;
+    Color3 sampleLights( const Vector3& ptIntersection, const Vector3& normal, const Color3& k, int thisGeom, Random* rng ) const;
+
+    // adds the diffuse light from each light visited to a surface point
+    struct LightVisitor;
+    // traces pixels of a tile one at a time, run by parallel_for
+    struct PixelStage;
+    // checks that reused pixels are not covered, run by parallel_for
+    struct VisibilityStage;
+
     // the scene to trace
     Scene* scene;
 
+    // acceleration structure over the scene's geometries
+    SceneAccel accel;
+
+    // the lights that reach each point
+    LightAccel light_accel;
+
     // the dimensions of the image to trace
     size_t width, height;
 
-    // the next row to raytrace
+    // the camera, and the distance to the first hit of each pixel
+    CameraView view;
+    std::vector< float > depths;
+
+    // whether to trace the pixels of a tile on every processor
+    bool threaded;
+
+    // whether to reuse pixels of the last raytrace, the pixels kept to do
+    // so, and the PixelState of each pixel of this one
+    bool reprojection;
+    ReprojectionCache cache;
+    std::vector< unsigned char > states;
+    size_t pixels_reused;
+
+    // full precision samples, quantized into the output buffer per row
+    Framebuffer framebuffer;
+
+    // lights sampled per shading point, 0 for all of them
+    size_t light_samples;
+
+    // whether to trace breadth first, and the queues of rays to do so
+    bool wavefront;
+    RayQueue queue;
+    RayQueue next_queue;
+    // the color of each pixel of the tile being traced breadth first
+    std::vector< Color3 > tile_colors;
+
+    // whether to path trace, and the tracer to do it
+    bool path_tracing;
+    PathTracer path_tracer;
+
+    // passes over the image, and the pass in progress
+    size_t num_passes;
+    size_t current_pass;
+
+    // the first row and column of the next tile to raytrace
     size_t current_row;
+    size_t current_column;
+
+    // the crop window as set, and as clipped to the image being traced
+    size_t crop_x_begin, crop_x_end, crop_row_begin, crop_row_end;
+    size_t window_x_begin, window_x_end, window_row_begin, window_row_end;
+
+    // pixels traced by the last call to raytrace
+    size_t pixels_traced;
 };
 
 } /* _462 */
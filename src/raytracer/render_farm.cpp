@@ -0,0 +1,593 @@
+/**
+ * @file render_farm.cpp
+ * @brief Renders one image with several processes sharing a directory.
+ */
+
+#include "raytracer/render_farm.hpp"
+#include "raytracer/raytracer.hpp"
+#include "raytracer/framebuffer.hpp"
+#include "application/scene_binary.hpp"
+#include "scene/scene.hpp"
+#include "math/random.hpp"
+
+#include <SDL/SDL_timer.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace _462 {
+
+#define FARM_VERSION 1
+// side of the tiles handed out, in pixels
+#define TILE_SIZE 64
+// milliseconds between looks at the directory when there is nothing to do
+#define POLL_INTERVAL 50
+// seconds a worker traces between renewals of its lease
+#define LEASE_RENEWAL 1.0
+// milliseconds without a renewal after which a worker is taken for dead
+#define LEASE_TIMEOUT 10000
+// milliseconds a tile must have been leased before it is offered again to
+// finish it sooner
+#define STEAL_DELAY 1000
+
+static std::string join_path( const std::string& directory, const std::string& name )
+{
+    return directory + "/" + name;
+}
+
+// the name of the file of a tile's offer, lease or result
+static std::string tile_filename( unsigned int id, const char* kind, size_t tile, unsigned int issue )
+{
+    char name[128];
+    if ( kind[0] == 'o' ) {
+        sprintf( name, "%u.%s.%lu", id, kind, (unsigned long) tile );
+    } else {
+        sprintf( name, "%u.%s.%lu.%u", id, kind, (unsigned long) tile, issue );
+    }
+    return name;
+}
+
+// reads a small file, returning false if it cannot be opened
+static bool read_file( const std::string& filename, std::string* contents )
+{
+    FILE* file = fopen( filename.c_str(), "rb" );
+    if ( !file )
+        return false;
+
+    contents->clear();
+    char chunk[256];
+    size_t count;
+    while ( ( count = fread( chunk, 1, sizeof chunk, file ) ) > 0 ) {
+        contents->append( chunk, count );
+    }
+    fclose( file );
+    return true;
+}
+
+// writes a file under a temporary name, then renames it, so that other
+// processes only ever see it complete
+static bool write_file( const std::string& filename, const void* data, size_t size )
+{
+    std::string temporary = filename + ".tmp";
+    FILE* file = fopen( temporary.c_str(), "wb" );
+    if ( !file ) {
+        std::cout << "Cannot write '" << temporary << "'.\n";
+        return false;
+    }
+
+    bool ok = fwrite( data, 1, size, file ) == size;
+    ok = fclose( file ) == 0 && ok;
+    // rename does not replace files on windows
+    remove( filename.c_str() );
+    if ( !ok || rename( temporary.c_str(), filename.c_str() ) != 0 ) {
+        std::cout << "Cannot write '" << filename << "'.\n";
+        remove( temporary.c_str() );
+        return false;
+    }
+    return true;
+}
+
+static bool write_file( const std::string& filename, const std::string& contents )
+{
+    return write_file( filename, contents.data(), contents.size() );
+}
+
+static bool read_number( const std::string& filename, unsigned int* number )
+{
+    std::string contents;
+    return read_file( filename, &contents ) && sscanf( contents.c_str(), "%u", number ) == 1;
+}
+
+static bool write_number( const std::string& filename, unsigned int number )
+{
+    char contents[16];
+    sprintf( contents, "%u\n", number );
+    return write_file( filename, contents );
+}
+
+// gets the names of the files in a directory, returning false if it
+// cannot be listed
+static bool list_directory( const std::string& directory, std::set< std::string >* names )
+{
+#ifndef _WIN32
+    DIR* dir = opendir( directory.c_str() );
+    if ( !dir )
+        return false;
+
+    names->clear();
+    while ( struct dirent* entry = readdir( dir ) ) {
+        names->insert( entry->d_name );
+    }
+    closedir( dir );
+    return true;
+#else
+    return false;
+#endif
+}
+
+FarmJob::FarmJob()
+    : id( 0 ), width( 0 ), height( 0 ), tile_size( TILE_SIZE ),
+      num_passes( 1 ), light_samples( 0 ), wavefront( false ), path_tracing( false ) { }
+
+size_t FarmJob::num_tiles() const
+{
+    size_t columns = ( width + tile_size - 1 ) / tile_size;
+    size_t rows = ( height + tile_size - 1 ) / tile_size;
+    return columns * rows;
+}
+
+void FarmJob::get_tile( size_t tile, size_t* x_begin, size_t* x_end,
+                        size_t* row_begin, size_t* row_end ) const
+{
+    size_t columns = ( width + tile_size - 1 ) / tile_size;
+    *x_begin = ( tile % columns ) * tile_size;
+    *x_end = std::min< size_t >( *x_begin + tile_size, width );
+    *row_begin = ( tile / columns ) * tile_size;
+    *row_end = std::min< size_t >( *row_begin + tile_size, height );
+}
+
+void FarmJob::configure( Raytracer* raytracer ) const
+{
+    raytracer->set_num_passes( num_passes );
+    raytracer->set_light_samples( light_samples );
+    raytracer->set_wavefront( wavefront );
+    raytracer->set_path_tracing( path_tracing );
+}
+
+// writes a job as the contents of the directory's job file
+static std::string format_job( const FarmJob& job )
+{
+    char contents[512];
+    sprintf( contents,
+             "P4FARM %d\nid %u\nscene %s\nsize %d %d\ntile %d\npasses %d\nlights %d\nwavefront %d\npath %d\n",
+             FARM_VERSION, job.id, job.scene_filename.c_str(), job.width, job.height, job.tile_size,
+             job.num_passes, job.light_samples, int( job.wavefront ), int( job.path_tracing ) );
+    return contents;
+}
+
+// reads a job file, returning false if it is missing or malformed
+static bool parse_job( const std::string& contents, FarmJob* job )
+{
+    int version, wavefront, path_tracing;
+    char scene_filename[128];
+    int count = sscanf( contents.c_str(),
+                        "P4FARM %d id %u scene %127s size %d %d tile %d passes %d lights %d wavefront %d path %d",
+                        &version, &job->id, scene_filename, &job->width, &job->height, &job->tile_size,
+                        &job->num_passes, &job->light_samples, &wavefront, &path_tracing );
+    if ( count != 10 || version != FARM_VERSION )
+        return false;
+    if ( job->width <= 0 || job->height <= 0 || job->tile_size <= 0 )
+        return false;
+
+    job->scene_filename = scene_filename;
+    job->wavefront = wavefront != 0;
+    job->path_tracing = path_tracing != 0;
+    return true;
+}
+
+FarmCoordinator::FarmCoordinator( const char* directory )
+    : directory( directory ), is_listed( false ) { }
+
+FarmCoordinator::~FarmCoordinator() { }
+
+bool FarmCoordinator::start( const Scene& scene, FarmJob* job )
+{
+    // ids must differ from those of earlier jobs in the directory, even
+    // jobs started in the same second by another process
+    job->id = (unsigned int) time( 0 ) ^ Random::hash( SDL_GetTicks() );
+#ifndef _WIN32
+    job->id ^= Random::hash( (unsigned int) getpid() );
+#endif
+    unsigned int finished_id;
+    bool is_finished = read_number( join_path( directory, "finished" ), &finished_id );
+    char scene_filename[32];
+    while ( true ) {
+        sprintf( scene_filename, "%u.scene", job->id );
+        if ( !( is_finished && job->id == finished_id ) && !exists( scene_filename ) )
+            break;
+        ++job->id;
+    }
+    job->scene_filename = scene_filename;
+    this->job = *job;
+
+    if ( !save_binary_scene( scene, join_path( directory, job->scene_filename ).c_str() ) )
+        return false;
+
+    size_t num_tiles = job->num_tiles();
+    leases.clear();
+    num_issues.assign( num_tiles, 0 );
+    done.assign( num_tiles, 0 );
+    for ( size_t i = 0; i < num_tiles; ++i ) {
+        if ( !offer( i ) )
+            return false;
+    }
+
+    if ( !write_file( join_path( directory, "job" ), format_job( *job ) ) )
+        return false;
+
+    printf( "Offering %lu tiles in '%s'.\n", (unsigned long) num_tiles, directory.c_str() );
+    return true;
+}
+
+bool FarmCoordinator::offer( size_t tile )
+{
+    for ( size_t i = 0; i < leases.size(); ++i ) {
+        if ( leases[i].tile == tile && leases[i].state == LEASE_OFFERED )
+            return true;
+    }
+
+    Lease lease;
+    lease.tile = tile;
+    lease.issue = num_issues[tile];
+    lease.state = LEASE_OFFERED;
+    lease.taken_time = 0;
+    lease.renewal_time = 0;
+    std::string name = tile_filename( job.id, "offer", tile, 0 );
+    if ( !write_number( join_path( directory, name ), lease.issue ) )
+        return false;
+
+    ++num_issues[tile];
+    leases.push_back( lease );
+    // so the offer is not mistaken for taken before the next listing
+    names.insert( name );
+    return true;
+}
+
+bool FarmCoordinator::exists( const std::string& name ) const
+{
+    if ( is_listed )
+        return names.count( name ) > 0;
+
+    FILE* file = fopen( join_path( directory, name ).c_str(), "rb" );
+    if ( !file )
+        return false;
+    fclose( file );
+    return true;
+}
+
+void FarmCoordinator::close( Lease* lease )
+{
+    if ( lease->state == LEASE_CLOSED )
+        return;
+
+    // an offer may be taken as it is withdrawn, so remove the lease too,
+    // which tells its worker to stop
+    if ( lease->state == LEASE_OFFERED ) {
+        remove( join_path( directory, tile_filename( job.id, "offer", lease->tile, 0 ) ).c_str() );
+    }
+    remove( join_path( directory, tile_filename( job.id, "lease", lease->tile, lease->issue ) ).c_str() );
+    lease->state = LEASE_CLOSED;
+}
+
+bool FarmCoordinator::collect( const Lease& lease, Raytracer* raytracer, unsigned char* buffer )
+{
+    std::string name = tile_filename( job.id, "result", lease.tile, lease.issue );
+    if ( !exists( name ) )
+        return false;
+
+    std::string filename = join_path( directory, name );
+    FILE* file = fopen( filename.c_str(), "rb" );
+    if ( !file )
+        return false;
+
+    size_t x_begin, x_end, row_begin, row_end;
+    job.get_tile( lease.tile, &x_begin, &x_end, &row_begin, &row_end );
+
+    unsigned long header[4];
+    bool ok = fscanf( file, "P4TILE %lu %lu %lu %lu", &header[0], &header[1], &header[2], &header[3] ) == 4 &&
+              fgetc( file ) == '\n' &&
+              header[0] == x_begin && header[1] == x_end && header[2] == row_begin && header[3] == row_end;
+    if ( ok ) {
+        rgb.resize( 3 * ( x_end - x_begin ) * ( row_end - row_begin ) );
+        ok = fread( &rgb[0], sizeof( float ), rgb.size(), file ) == rgb.size();
+    }
+    fclose( file );
+    remove( filename.c_str() );
+
+    // offer the tile again if the result was damaged
+    if ( !ok ) {
+        std::cout << "Bad result '" << filename << "'.\n";
+        return false;
+    }
+
+    raytracer->add_samples( x_begin, x_end, row_begin, row_end, &rgb[0], buffer );
+    return true;
+}
+
+void FarmCoordinator::run( Raytracer* raytracer, unsigned char* buffer )
+{
+    size_t num_tiles = done.size();
+    size_t num_done = 0;
+
+    while ( num_done < num_tiles ) {
+        unsigned int now = SDL_GetTicks();
+        bool is_offering = false;
+        bool is_busy = false;
+
+        // one listing answers which offers are left and which results are
+        // in, rather than a look for each file. only leases are opened.
+        is_listed = list_directory( directory, &names );
+
+        for ( size_t i = 0; i < leases.size(); ++i ) {
+            Lease& lease = leases[i];
+
+            if ( lease.state == LEASE_OFFERED ) {
+                if ( exists( tile_filename( job.id, "offer", lease.tile, 0 ) ) ) {
+                    is_offering = true;
+                    continue;
+                }
+                // a worker took it
+                lease.state = LEASE_TAKEN;
+                lease.taken_time = now;
+                lease.renewal_time = now;
+                lease.renewal.clear();
+            }
+            if ( lease.state != LEASE_TAKEN )
+                continue;
+
+            if ( collect( lease, raytracer, buffer ) ) {
+                done[lease.tile] = 1;
+                ++num_done;
+                printf( "Collected tile %lu (%lu of %lu).\n", (unsigned long) lease.tile,
+                        (unsigned long) num_done, (unsigned long) num_tiles );
+                // stop any other worker on the tile
+                for ( size_t j = 0; j < leases.size(); ++j ) {
+                    if ( leases[j].tile == lease.tile ) {
+                        close( &leases[j] );
+                    }
+                }
+                is_busy = true;
+                continue;
+            }
+
+            // a lease whose file does not change for LEASE_TIMEOUT belongs
+            // to a dead worker. a missing file means a worker is renaming a
+            // result into place, or gave up, so it gets the same time.
+            std::string renewal;
+            read_file( join_path( directory, tile_filename( job.id, "lease", lease.tile, lease.issue ) ), &renewal );
+            if ( renewal != lease.renewal ) {
+                lease.renewal = renewal;
+                lease.renewal_time = now;
+            } else if ( now - lease.renewal_time > LEASE_TIMEOUT ) {
+                printf( "Lease on tile %lu expired, offering it again.\n", (unsigned long) lease.tile );
+                // the sweep below offers it again unless another worker has it
+                close( &lease );
+            }
+        }
+
+        // a tile whose offer could not be written has nothing out on it, so
+        // keep trying until one is
+        std::vector< unsigned int > num_leases( num_tiles, 0 );
+        std::vector< unsigned char > is_out( num_tiles, 0 );
+        for ( size_t i = 0; i < leases.size(); ++i ) {
+            if ( leases[i].state == LEASE_TAKEN ) {
+                ++num_leases[leases[i].tile];
+            }
+            if ( leases[i].state != LEASE_CLOSED ) {
+                is_out[leases[i].tile] = 1;
+            }
+        }
+        for ( size_t tile = 0; tile < num_tiles; ++tile ) {
+            if ( !done[tile] && !is_out[tile] && offer( tile ) ) {
+                is_offering = true;
+            }
+        }
+
+        // when every tile is leased, idle workers would wait on the slowest.
+        // offer the tile leased longest again, so another worker can race
+        // the first.
+        if ( !is_offering ) {
+
+            const Lease* oldest = 0;
+            for ( size_t i = 0; i < leases.size(); ++i ) {
+                const Lease& lease = leases[i];
+                if ( lease.state == LEASE_TAKEN && num_leases[lease.tile] == 1 &&
+                     now - lease.taken_time >= STEAL_DELAY &&
+                     ( !oldest || now - lease.taken_time > now - oldest->taken_time ) ) {
+                    oldest = &lease;
+                }
+            }
+            if ( oldest ) {
+                offer( oldest->tile );
+            }
+        }
+
+        // forget leases that are done with, so scans do not grow
+        size_t kept = 0;
+        for ( size_t i = 0; i < leases.size(); ++i ) {
+            if ( leases[i].state != LEASE_CLOSED ) {
+                leases[kept++] = leases[i];
+            }
+        }
+        leases.resize( kept );
+
+        if ( !is_busy && num_done < num_tiles ) {
+            SDL_Delay( POLL_INTERVAL );
+        }
+    }
+
+    // tell the workers, then clean up after them. a worker may hand in a
+    // duplicate after this, which is left behind.
+    char id[16];
+    sprintf( id, "%u\n", job.id );
+    write_file( join_path( directory, "finished" ), id );
+    remove( join_path( directory, "job" ).c_str() );
+    remove( join_path( directory, job.scene_filename ).c_str() );
+    for ( size_t tile = 0; tile < num_tiles; ++tile ) {
+        remove( join_path( directory, tile_filename( job.id, "offer", tile, 0 ) ).c_str() );
+        for ( unsigned int issue = 0; issue < num_issues[tile]; ++issue ) {
+            remove( join_path( directory, tile_filename( job.id, "lease", tile, issue ) ).c_str() );
+            remove( join_path( directory, tile_filename( job.id, "result", tile, issue ) ).c_str() );
+        }
+    }
+    printf( "Collected all tiles.\n" );
+}
+
+FarmWorker::FarmWorker( const char* directory ) : directory( directory ) { }
+
+FarmWorker::~FarmWorker() { }
+
+std::string FarmWorker::get_path( const std::string& name ) const
+{
+    return join_path( directory, name );
+}
+
+void FarmWorker::wait_for_job( FarmJob* job )
+{
+    printf( "Waiting for a job in '%s'...\n", directory.c_str() );
+    while ( true ) {
+        std::string contents;
+        if ( read_file( get_path( "job" ), &contents ) && parse_job( contents, job ) ) {
+            this->job = *job;
+            if ( !is_finished() )
+                break;
+        }
+        SDL_Delay( POLL_INTERVAL );
+    }
+    printf( "Joined job %u.\n", job->id );
+}
+
+bool FarmWorker::is_finished() const
+{
+    unsigned int id;
+    if ( read_number( get_path( "finished" ), &id ) && id == job.id )
+        return true;
+
+    // a coordinator that died leaves its job unfinished, until another
+    // publishes a new one
+    std::string contents;
+    FarmJob current;
+    return read_file( get_path( "job" ), &contents ) && parse_job( contents, &current ) &&
+           current.id != job.id;
+}
+
+bool FarmWorker::claim( size_t tile, unsigned int* issue )
+{
+    std::string offer_filename = get_path( tile_filename( job.id, "offer", tile, 0 ) );
+    if ( !read_number( offer_filename, issue ) )
+        return false;
+    // only one worker can rename the offer. if the coordinator offered the
+    // tile again since it was read, the rename takes the new offer under
+    // the old lease, which the coordinator times out.
+    std::string lease_filename = get_path( tile_filename( job.id, "lease", tile, *issue ) );
+    return rename( offer_filename.c_str(), lease_filename.c_str() ) == 0;
+}
+
+// rewrites a lease to show its worker is alive, returning false if the
+// coordinator has taken it away
+static bool renew_lease( const std::string& filename, unsigned int count )
+{
+    FILE* file = fopen( filename.c_str(), "r+b" );
+    if ( !file )
+        return false;
+    fprintf( file, "%010u\n", count );
+    fclose( file );
+    return true;
+}
+
+bool FarmWorker::render( Raytracer* raytracer, size_t tile, unsigned int issue )
+{
+    std::string lease_filename = get_path( tile_filename( job.id, "lease", tile, issue ) );
+    size_t x_begin, x_end, row_begin, row_end;
+    job.get_tile( tile, &x_begin, &x_end, &row_begin, &row_end );
+
+    // only the tile's pixels are cleared and traced
+    raytracer->set_crop_window( x_begin, x_end, row_begin, row_end );
+    raytracer->restart();
+
+    unsigned int count = 0;
+    while ( true ) {
+        real_t max_time = LEASE_RENEWAL;
+        // the coordinator tonemaps, so only the framebuffer is written
+        bool is_done = raytracer->raytrace( 0, &max_time );
+        if ( !renew_lease( lease_filename, ++count ) ) {
+            printf( "Lost the lease on tile %lu.\n", (unsigned long) tile );
+            return false;
+        }
+        if ( is_done )
+            break;
+    }
+
+    rgb.resize( 3 * ( x_end - x_begin ) * ( row_end - row_begin ) );
+    raytracer->get_framebuffer().resolve( &rgb[0], x_begin, x_end, row_begin, row_end );
+
+    char header[128];
+    sprintf( header, "P4TILE %lu %lu %lu %lu\n", (unsigned long) x_begin, (unsigned long) x_end,
+             (unsigned long) row_begin, (unsigned long) row_end );
+    std::string contents = header;
+    contents.append( (const char*) &rgb[0], rgb.size() * sizeof( float ) );
+
+    bool ok = write_file( get_path( tile_filename( job.id, "result", tile, issue ) ), contents );
+    remove( lease_filename.c_str() );
+    return ok;
+}
+
+void FarmWorker::run( Scene* scene, Raytracer* raytracer )
+{
+    size_t num_tiles = job.num_tiles();
+    job.configure( raytracer );
+    scene->camera.aspect = real_t( job.width ) / real_t( job.height );
+
+    // set up once for the whole image, each tile then only restarts it
+    raytracer->set_crop_window( 0, 0, 0, 0 );
+    if ( !raytracer->initialize( scene, job.width, job.height ) ) {
+        std::cout << "Cannot initialize the raytracer. Aborting.\n";
+        return;
+    }
+
+    size_t num_rendered = 0;
+    size_t next = 0;
+    while ( true ) {
+        // look for offers after the last tile taken, so workers spread out
+        bool is_claimed = false;
+        for ( size_t i = 0; i < num_tiles && !is_claimed; ++i ) {
+            size_t tile = ( next + i ) % num_tiles;
+            unsigned int issue;
+            if ( claim( tile, &issue ) ) {
+                is_claimed = true;
+                next = tile + 1;
+                printf( "Leased tile %lu.\n", (unsigned long) tile );
+                if ( render( raytracer, tile, issue ) ) {
+                    ++num_rendered;
+                }
+            }
+        }
+
+        if ( !is_claimed ) {
+            if ( is_finished() )
+                break;
+            SDL_Delay( POLL_INTERVAL );
+        }
+    }
+
+    raytracer->set_crop_window( 0, 0, 0, 0 );
+    printf( "Job finished, rendered %lu tiles.\n", (unsigned long) num_rendered );
+}
+
+} /* _462 */
@@ -0,0 +1,193 @@
+/**
+ * @file render_farm.hpp
+ * @brief Renders one image with several processes sharing a directory.
+ */
+
+#ifndef _462_RAYTRACER_RENDER_FARM_HPP_
+#define _462_RAYTRACER_RENDER_FARM_HPP_
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace _462 {
+
+class Scene;
+class Raytracer;
+
+/// What every process of a distributed render must agree on.
+struct FarmJob
+{
+    // tells the files of this job from those of earlier ones
+    unsigned int id;
+    // name of the binary scene in the shared directory
+    std::string scene_filename;
+    // dimensions of the whole image
+    int width, height;
+    // the side of a tile, in pixels
+    int tile_size;
+    // how to raytrace, as for Raytracer's setters
+    int num_passes;
+    int light_samples;
+    bool wavefront;
+    bool path_tracing;
+
+    FarmJob();
+
+    /// Returns the number of tiles covering the image.
+    size_t num_tiles() const;
+
+    /**
+     * Gets columns [x_begin, x_end) and rows [row_begin, row_end) of a tile,
+     * with rows counted from the bottom of the image.
+     */
+    void get_tile( size_t tile, size_t* x_begin, size_t* x_end,
+                   size_t* row_begin, size_t* row_end ) const;
+
+    /// Sets a raytracer to trace as this job does.
+    void configure( Raytracer* raytracer ) const;
+};
+
+/**
+ * Hands out the tiles of an image to worker processes and collects what
+ * they trace. Processes talk only through files in a shared directory, so
+ * workers may run on the same machine or any machine that mounts it, as
+ * long as they have the same byte order and see the scene's meshes and
+ * textures under the same paths.
+ *
+ * The coordinator saves the scene to the directory as a binary scene,
+ * describes the job in a file named "job", and offers each tile in a file
+ * of its own. A worker leases a tile by renaming its offer, which only one
+ * worker can do. It then renews the lease by rewriting the file every
+ * second while tracing, and hands the tile back as a result file that is
+ * written under a temporary name first, so it is only seen complete.
+ *
+ * Leases not renewed for ten seconds belong to dead workers, and
+ * their tiles are offered again. Once every tile is leased, workers that
+ * run out of tiles would wait on the slowest, so the tile held longest is
+ * offered a second time, and whichever copy finishes first is used. The
+ * lease of the other copy is removed, which tells its worker to stop.
+ * Finally the coordinator writes a file named "finished" holding the job's
+ * id, at which workers exit.
+ */
+class FarmCoordinator
+{
+public:
+
+    explicit FarmCoordinator( const char* directory );
+    ~FarmCoordinator();
+
+    /**
+     * Publishes a job for workers: saves the scene to the directory and
+     * offers every tile. Sets the job's id and scene filename.
+     * Prints a message to stdout if an error occurs.
+     * @return True on success, false on error.
+     */
+    bool start( const Scene& scene, FarmJob* job );
+
+    /**
+     * Collects tiles from workers until every tile is traced, adding each
+     * to the raytracer's image and writing it to the buffer. The raytracer
+     * must be initialized for the job's image. Then tells the workers the
+     * job is finished and removes its files.
+     */
+    void run( Raytracer* raytracer, unsigned char* buffer );
+
+private:
+
+    enum LeaseState
+    {
+        LEASE_OFFERED,
+        LEASE_TAKEN,
+        LEASE_CLOSED
+    };
+
+    // an offer of a tile, and the lease a worker takes on it
+    struct Lease
+    {
+        size_t tile;
+        // how many times the tile was offered before this
+        unsigned int issue;
+        int state;
+        // the time the lease was taken, and its last renewal as seen here
+        unsigned int taken_time;
+        unsigned int renewal_time;
+        std::string renewal;
+    };
+
+    // offers the tile, unless an offer of it is already waiting, returning
+    // false if the offer could not be written
+    bool offer( size_t tile );
+    // withdraws an offer or lease, removing its files
+    void close( Lease* lease );
+    // reads a lease's result into the image, returning false if it has none
+    bool collect( const Lease& lease, Raytracer* raytracer, unsigned char* buffer );
+    // returns true if the directory has a file of the given name, going by
+    // the last listing if there is one
+    bool exists( const std::string& name ) const;
+
+    std::string directory;
+    FarmJob job;
+
+    // the files in the directory as of the last listing, if it could be
+    // listed
+    std::set< std::string > names;
+    bool is_listed;
+
+    // every offer made, in order
+    std::vector< Lease > leases;
+    // offers made of each tile
+    std::vector< unsigned int > num_issues;
+    // whether each tile is done
+    std::vector< unsigned char > done;
+    // a tile read from a result
+    std::vector< float > rgb;
+};
+
+/**
+ * Traces tiles offered by a FarmCoordinator until its job is finished.
+ */
+class FarmWorker
+{
+public:
+
+    explicit FarmWorker( const char* directory );
+    ~FarmWorker();
+
+    /**
+     * Waits until a job is published in the directory, then reads it. The
+     * scene to load is the directory's file named job->scene_filename.
+     */
+    void wait_for_job( FarmJob* job );
+
+    /// Returns the path of a file named name in the shared directory.
+    std::string get_path( const std::string& name ) const;
+
+    /**
+     * Leases and traces tiles of the job until it is finished. The scene
+     * must be loaded from the job's scene file, and its meshes and
+     * textures loaded.
+     */
+    void run( Scene* scene, Raytracer* raytracer );
+
+private:
+
+    // leases the tile, if it is offered, setting which offer it was
+    bool claim( size_t tile, unsigned int* issue );
+    // traces a leased tile and hands it in, returning false if the lease
+    // was taken away first
+    bool render( Raytracer* raytracer, size_t tile, unsigned int issue );
+    // returns true if the coordinator has finished the job
+    bool is_finished() const;
+
+    std::string directory;
+    FarmJob job;
+
+    // the tile being handed in
+    std::vector< float > rgb;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_RENDER_FARM_HPP_ */
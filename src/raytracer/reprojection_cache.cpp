@@ -0,0 +1,159 @@
+/**
+ * @file reprojection_cache.cpp
+ * @brief Pixels of the last raytrace, kept for the next view to reuse.
+ */
+
+#include "raytracer/reprojection_cache.hpp"
+#include "raytracer/framebuffer.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace _462 {
+
+// the most two neighbouring hits may differ in depth, relative to the
+// nearer, to be taken as the same surface
+#define DEPTH_TOLERANCE (0.1)
+
+bool is_same_depth( float a, float b )
+{
+    const float infinity = std::numeric_limits< float >::infinity();
+    if ( a == infinity || b == infinity )
+        return a == b;
+    return fabs( a - b ) <= DEPTH_TOLERANCE * std::min( a, b );
+}
+
+// returns true if two neighbouring pixels of these depths may be on
+// different surfaces
+static bool is_depth_edge( float a, float b )
+{
+    return !is_same_depth( a, b );
+}
+
+ReprojectionCache::ReprojectionCache() : width( 0 ), height( 0 ) { }
+
+ReprojectionCache::~ReprojectionCache() { }
+
+void ReprojectionCache::clear()
+{
+    width = 0;
+    height = 0;
+    points.clear();
+    hits.clear();
+    colors.clear();
+    valid.clear();
+    has_color.clear();
+    reused_points.clear();
+    reused_hits.clear();
+}
+
+void ReprojectionCache::store( const CameraView& view, const Framebuffer& framebuffer,
+                               const float* depths, const unsigned char* states )
+{
+    width = view.get_width();
+    height = view.get_height();
+    size_t count = width * height;
+    points.resize( count );
+    hits.resize( count );
+    colors.resize( count );
+    valid.assign( count, 0 );
+    has_color.assign( count, 0 );
+
+    for ( size_t y = 0; y < height; ++y ) {
+        for ( size_t x = 0; x < width; ++x ) {
+            size_t i = y * width + x;
+
+            if ( states[i] == PIXEL_REUSED ) {
+                assert( reused_points.size() == count );
+                points[i] = reused_points[i];
+                hits[i] = reused_hits[i];
+            } else if ( states[i] == PIXEL_REUSABLE ) {
+                Vector3 direction = view.get_ray( x, y ).direction;
+                hits[i] = depths[i] < std::numeric_limits< float >::infinity();
+                points[i] = hits[i] ? view.get_eye() + direction * depths[i] : direction;
+            } else if ( states[i] == PIXEL_VIEW_DEPENDENT && depths[i] < std::numeric_limits< float >::infinity() ) {
+                // its color cannot be reused, but its hit still hides what
+                // was behind it, silhouette or not
+                points[i] = view.get_eye() + view.get_ray( x, y ).direction * depths[i];
+                hits[i] = 1;
+                valid[i] = 1;
+                continue;
+            } else {
+                continue;
+            }
+
+            // drop pixels on silhouettes, where what is behind may show
+            // through from elsewhere
+            if ( ( x > 0 && is_depth_edge( depths[i], depths[i - 1] ) ) ||
+                 ( x + 1 < width && is_depth_edge( depths[i], depths[i + 1] ) ) ||
+                 ( y > 0 && is_depth_edge( depths[i], depths[i - width] ) ) ||
+                 ( y + 1 < height && is_depth_edge( depths[i], depths[i + width] ) ) )
+                continue;
+
+            colors[i] = framebuffer.get_pixel( x, y );
+            valid[i] = 1;
+            has_color[i] = 1;
+        }
+    }
+}
+
+size_t ReprojectionCache::reproject( const CameraView& view, Framebuffer* framebuffer,
+                                     float* depths, unsigned char* states )
+{
+    const float infinity = std::numeric_limits< float >::infinity();
+
+    reused_points.clear();
+    reused_hits.clear();
+    if ( view.get_width() != width || view.get_height() != height || valid.empty() )
+        return 0;
+
+    size_t count = width * height;
+    sources.assign( count, -1 );
+    source_depths.assign( count, infinity );
+
+    // move each kept pixel to the pixel nearest its hit, nearest hit first
+    for ( size_t i = 0; i < count; ++i ) {
+        if ( !valid[i] )
+            continue;
+
+        Vector3 direction = hits[i] ? points[i] - view.get_eye() : points[i];
+        real_t x, y;
+        if ( !view.project_direction( direction, &x, &y ) )
+            continue;
+        if ( x < -0.5 || x >= width - 0.5 || y < -0.5 || y >= height - 0.5 )
+            continue;
+
+        size_t j = size_t( floor( y + 0.5 ) ) * width + size_t( floor( x + 0.5 ) );
+        float depth = hits[i] ? float( length( direction ) ) : infinity;
+        if ( sources[j] < 0 || depth < source_depths[j] ) {
+            sources[j] = int( i );
+            source_depths[j] = depth;
+        }
+    }
+
+    reused_points.resize( count );
+    reused_hits.resize( count );
+    size_t reused = 0;
+    for ( size_t y = 0; y < height; ++y ) {
+        for ( size_t x = 0; x < width; ++x ) {
+            size_t j = y * width + x;
+            if ( sources[j] < 0 )
+                continue;
+
+            // a hit without a color hides what is behind it, but the pixel
+            // must still be traced
+            size_t i = sources[j];
+            if ( !has_color[i] )
+                continue;
+            framebuffer->add_sample( x, y, colors[i] );
+            depths[j] = source_depths[j];
+            states[j] = PIXEL_REUSED;
+            reused_points[j] = points[i];
+            reused_hits[j] = hits[i];
+            ++reused;
+        }
+    }
+    return reused;
+}
+
+} /* _462 */
@@ -0,0 +1,115 @@
+/**
+ * @file reprojection_cache.hpp
+ * @brief Pixels of the last raytrace, kept for the next view to reuse.
+ */
+
+#ifndef _462_RAYTRACER_REPROJECTION_CACHE_HPP_
+#define _462_RAYTRACER_REPROJECTION_CACHE_HPP_
+
+#include "math/color.hpp"
+#include "math/vector.hpp"
+#include "raytracer/camera_view.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+class Framebuffer;
+
+/// What the raytracer knows of each pixel of the image it is tracing.
+enum PixelState
+{
+    // not traced yet
+    PIXEL_UNTRACED,
+    // traced, but its color depends on where it is seen from, as for
+    // mirrors
+    PIXEL_VIEW_DEPENDENT,
+    // traced, and its color is the same from anywhere its hit is seen
+    PIXEL_REUSABLE,
+    // filled in by ReprojectionCache instead of traced
+    PIXEL_REUSED
+};
+
+/**
+ * Returns true if two depths, of neighbouring pixels or of one pixel found
+ * two ways, are close enough to be taken as the same surface.
+ */
+bool is_same_depth( float a, float b );
+
+/**
+ * Keeps the world space hit and color of each pixel of a raytrace, so
+ * that a raytrace from a nearby camera only traces what the cache cannot
+ * fill in. Only the colors of pixels that do not depend on the view are
+ * kept: misses, and hits on surfaces that reflect nothing, whose light
+ * depends only on the lights and what blocks them. Hits on other surfaces
+ * are kept without a color, only to hide what is behind them.
+ *
+ * Each kept hit is projected into the new view and lands on the nearest
+ * pixel, with the nearest hit winning. Pixels nothing lands on were hidden
+ * or out of view before, and must be traced, as must those a colorless hit
+ * lands on. Hits next to a jump in depth are not kept, as from a new view
+ * they may be in front of what should show through. Reused pixels carry
+ * their hit along, so the hits kept over many small moves do not drift,
+ * though each pixel shows a point up to half a pixel from its center.
+ *
+ * Something that was out of view or hidden before may still cover a
+ * reused pixel, so the raytracer checks the first hit of each one before
+ * relying on it.
+ */
+class ReprojectionCache
+{
+public:
+
+    ReprojectionCache();
+    ~ReprojectionCache();
+
+    /// Forgets every kept pixel.
+    void clear();
+
+    /**
+     * Keeps the pixels of an image, replacing those kept before.
+     * @param view The camera the image was traced with.
+     * @param framebuffer The colors of the image.
+     * @param depths The distance to each pixel's hit, infinite for misses.
+     * @param states The PixelState of each pixel. Pixels reused by the last
+     *  call to reproject keep the hit they were reused from.
+     */
+    void store( const CameraView& view, const Framebuffer& framebuffer,
+                const float* depths, const unsigned char* states );
+
+    /**
+     * Fills in the pixels of a new image that the kept pixels can, if it has
+     * the dimensions of the kept image. Each filled pixel gets its color as
+     * a sample, the distance to its hit, and the state PIXEL_REUSED.
+     * @return The number of pixels filled in.
+     */
+    size_t reproject( const CameraView& view, Framebuffer* framebuffer,
+                      float* depths, unsigned char* states );
+
+private:
+
+    size_t width, height;
+
+    // for each kept pixel, the world space hit, or the direction of a miss
+    std::vector< Vector3 > points;
+    std::vector< unsigned char > hits;
+    std::vector< Color3 > colors;
+    // whether each pixel is kept, and whether its color is
+    std::vector< unsigned char > valid;
+    std::vector< unsigned char > has_color;
+
+    // for each pixel of the last image filled in by reproject, the kept
+    // pixel it was filled from, or -1
+    std::vector< int > sources;
+    // depth of each source in the new view
+    std::vector< float > source_depths;
+
+    // the hits and misses of the last reprojected image's sources, for
+    // store to carry along
+    std::vector< Vector3 > reused_points;
+    std::vector< unsigned char > reused_hits;
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_REPROJECTION_CACHE_HPP_ */
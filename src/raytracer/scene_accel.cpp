@@ -0,0 +1,490 @@
+/**
+ * @file scene_accel.cpp
+ * @brief Two-level acceleration structure over the geometries of a scene.
+ */
+
+#include "raytracer/scene_accel.hpp"
+#include "scene/scene.hpp"
+#include "scene/model.hpp"
+#include "scene/sphere.hpp"
+#include "scene/triangle.hpp"
+
+#include <limits>
+
+namespace _462 {
+
+/**
+ * Transforms a world space ray into the local space of a geometry. The
+ * local direction is normalized, and scale is set to the factor that
+ * converts world times into local times.
+ */
+static ray_t to_local( const ray_t& ray, const GeometryTransform& xform, real_t* scale )
+{
+    ray_t local;
+    Vector3 dir = xform.inverse.transform_vector( ray.direction );
+    *scale = length( dir );
+    local.eye = xform.inverse.transform_point( ray.eye );
+    local.direction = dir / *scale;
+    local.end = local.eye + local.direction;
+    return local;
+}
+
+/**
+ * Returns the geometry as a sphere if its world space shape is another
+ * sphere, i.e. it has uniform positive scale. Orientation does not change
+ * the shape, only the shading, which still goes through the transform.
+ * Mirrored spheres keep the full transform, which turns their normals.
+ */
+static const Sphere* as_world_sphere( const Geometry* geom )
+{
+    const Sphere* sphere = dynamic_cast< const Sphere* >( geom );
+    if ( sphere && geom->scale.x > 0 &&
+         geom->scale.x == geom->scale.y && geom->scale.x == geom->scale.z )
+        return sphere;
+    return 0;
+}
+
+// moves a list of geometries into the leaf order of a hierarchy built over it
+static void sort_by_leaves( const Bvh& bvh, std::vector< unsigned int >* geoms )
+{
+    std::vector< unsigned int > ordered( geoms->size() );
+    const unsigned int* order = bvh.get_indices();
+    for ( size_t i = 0; i < ordered.size(); ++i ) {
+        ordered[i] = ( *geoms )[order[i]];
+    }
+    geoms->swap( ordered );
+}
+
+namespace {
+
+// intersects a geometry with a ray in its local space
+static real_t intersect_local( const LocalGeometry& entry, const Geometry* const* geometries,
+                               const ray_t& ray, Hit* hit )
+{
+    switch ( entry.kind ) {
+    case KIND_MODEL:
+        return Model::intersect_mesh( *entry.mesh, ray, hit );
+    case KIND_ELLIPSOID: {
+        real_t t = intersect_sphere( ray.eye, ray.direction, Vector3::Zero,
+                                     entry.radius_sq, SLOP_FACTOR );
+        hit->primitive = 0;
+        return t < std::numeric_limits< real_t >::infinity() ? t : -1;
+    }
+    default:
+        return geometries[entry.geom]->intersect( ray, hit );
+    }
+}
+
+// finds the closest geometry along a ray
+struct ClosestHitVisitor
+{
+    const Geometry* const* geometries;
+    const GeometryTransform* transforms;
+    const LocalGeometry* entries;
+    const ray_t* ray;
+    real_t tmin;
+    int exclude;
+
+    // closest geometry so far, or -1
+    int best;
+    Hit best_hit;
+
+    bool operator()( unsigned int prim, real_t* tmax ) {
+        const LocalGeometry& entry = entries[prim];
+        if ( int( entry.geom ) == exclude )
+            return false;
+        real_t scale;
+        Hit hit;
+        ray_t local = to_local( *ray, transforms[entry.geom], &scale );
+        real_t t = intersect_local( entry, geometries, local, &hit ) / scale;
+        if ( t > tmin && t < *tmax ) {
+            *tmax = t;
+            best = entry.geom;
+            best_hit = hit;
+        }
+        return false;
+    }
+};
+
+// stops at the first geometry along a ray
+struct AnyHitVisitor
+{
+    const Geometry* const* geometries;
+    const GeometryTransform* transforms;
+    const LocalGeometry* entries;
+    const ray_t* ray;
+    real_t tmin;
+    int exclude;
+
+    bool operator()( unsigned int prim, real_t* tmax ) {
+        const LocalGeometry& entry = entries[prim];
+        if ( int( entry.geom ) == exclude )
+            return false;
+        real_t scale;
+        Hit hit;
+        ray_t local = to_local( *ray, transforms[entry.geom], &scale );
+        real_t t = intersect_local( entry, geometries, local, &hit ) / scale;
+        return t > tmin && t < *tmax;
+    }
+};
+
+// tests whole leaves of the world space sphere table at once
+struct SphereLeafVisitor
+{
+    const SphereBatch* spheres;
+    const ray_t* ray;
+    real_t tmin;
+    // the table entry to ignore, or -1
+    int exclude;
+    // if true, stop at the first hit
+    bool any_hit;
+
+    // closest entry so far, or -1
+    int best;
+
+    bool operator()( unsigned int first, unsigned int count, real_t* tmax ) {
+        unsigned int end = first + count;
+        int hit;
+        if ( exclude >= int( first ) && exclude < int( end ) ) {
+            // test either side of the excluded sphere
+            hit = spheres->intersect( ray->eye, ray->direction, first, exclude, tmin, tmax );
+            int rest = spheres->intersect( ray->eye, ray->direction, exclude + 1, end, tmin, tmax );
+            hit = rest >= 0 ? rest : hit;
+        } else {
+            hit = spheres->intersect( ray->eye, ray->direction, first, end, tmin, tmax );
+        }
+        if ( hit >= 0 )
+            best = hit;
+        return any_hit && hit >= 0;
+    }
+};
+
+// tests whole leaves of the world space triangle table at once
+struct TriangleLeafVisitor
+{
+    const TriangleBatch* triangles;
+    const ray_t* ray;
+    real_t tmin;
+    // the table entry to ignore, or -1
+    int exclude;
+    // if true, stop at the first hit
+    bool any_hit;
+
+    // closest entry so far, or -1
+    int best;
+    real_t beta, gamma;
+
+    bool operator()( unsigned int first, unsigned int count, real_t* tmax ) {
+        unsigned int end = first + count;
+        int hit;
+        if ( exclude >= int( first ) && exclude < int( end ) ) {
+            // test either side of the excluded triangle
+            hit = triangles->intersect( ray->eye, ray->direction, first, exclude, tmin, tmax, &beta, &gamma );
+            int rest = triangles->intersect( ray->eye, ray->direction, exclude + 1, end, tmin, tmax, &beta, &gamma );
+            hit = rest >= 0 ? rest : hit;
+        } else {
+            hit = triangles->intersect( ray->eye, ray->direction, first, end, tmin, tmax, &beta, &gamma );
+        }
+        if ( hit >= 0 )
+            best = hit;
+        return any_hit && hit >= 0;
+    }
+};
+
+}
+
+SceneAccel::SceneAccel() : generation( 0 ) { }
+
+SceneAccel::~SceneAccel() { }
+
+void SceneAccel::build( const Scene* scene )
+{
+    assert( scene );
+
+    Geometry* const* scene_geoms = scene->get_geometries();
+    geometries.assign( scene_geoms, scene_geoms + scene->num_geometries() );
+    generation = scene->get_generation();
+    transforms.resize( geometries.size() );
+    kinds.resize( geometries.size() );
+    slots.resize( geometries.size() );
+
+    local_geoms.clear();
+    sphere_geoms.clear();
+    triangle_geoms.clear();
+    for ( size_t i = 0; i < geometries.size(); ++i ) {
+        const Geometry* geom = geometries[i];
+        const Sphere* sphere = dynamic_cast< const Sphere* >( geom );
+        const Model* model = dynamic_cast< const Model* >( geom );
+
+        if ( as_world_sphere( geom ) ) {
+            kinds[i] = KIND_SPHERE;
+            sphere_geoms.push_back( i );
+        } else if ( dynamic_cast< const Triangle* >( geom ) ) {
+            kinds[i] = KIND_TRIANGLE;
+            triangle_geoms.push_back( i );
+        } else {
+            LocalGeometry entry;
+            entry.kind = KIND_GENERAL;
+            entry.geom = i;
+            entry.mesh = 0;
+            entry.radius_sq = 0;
+            if ( model && model->mesh ) {
+                entry.kind = KIND_MODEL;
+                entry.mesh = model->mesh;
+            } else if ( sphere ) {
+                entry.kind = KIND_ELLIPSOID;
+                entry.radius_sq = sphere->radius * sphere->radius;
+            }
+            kinds[i] = entry.kind;
+            local_geoms.push_back( entry );
+        }
+    }
+
+    // fill the tables in scene order to get the bounds to build over
+    bounds.resize( local_geoms.size() );
+    sphere_bounds.resize( sphere_geoms.size() );
+    triangle_bounds.resize( triangle_geoms.size() );
+    spheres.clear();
+    for ( size_t i = 0; i < sphere_geoms.size(); ++i ) {
+        spheres.add( Vector3::Zero, 0 );
+    }
+    triangles.clear();
+    for ( size_t i = 0; i < triangle_geoms.size(); ++i ) {
+        triangles.add( Vector3::Zero, Vector3::Zero, Vector3::Zero );
+    }
+    sphere_bvh.clear();
+    triangle_bvh.clear();
+    update_geometry();
+
+    bvh.build( bounds.empty() ? NULL : &bounds[0], bounds.size(), 1 );
+    // small leaves of spheres and triangles are cheaper to test together
+    // than to split
+    sphere_bvh.build( sphere_bounds.empty() ? NULL : &sphere_bounds[0], sphere_bounds.size(), 4 );
+    triangle_bvh.build( triangle_bounds.empty() ? NULL : &triangle_bounds[0], triangle_bounds.size(), 4 );
+
+    // then put the tables into leaf order and fill them again
+    sort_by_leaves( sphere_bvh, &sphere_geoms );
+    sort_by_leaves( triangle_bvh, &triangle_geoms );
+    for ( size_t i = 0; i < local_geoms.size(); ++i ) {
+        slots[local_geoms[i].geom] = i;
+    }
+    for ( size_t i = 0; i < sphere_geoms.size(); ++i ) {
+        slots[sphere_geoms[i]] = i;
+    }
+    for ( size_t i = 0; i < triangle_geoms.size(); ++i ) {
+        slots[triangle_geoms[i]] = i;
+    }
+    update_geometry();
+}
+
+void SceneAccel::refit()
+{
+    update_geometry();
+    if ( !bounds.empty() )
+        bvh.refit( &bounds[0] );
+    if ( !sphere_bounds.empty() )
+        sphere_bvh.refit( &sphere_bounds[0] );
+    if ( !triangle_bounds.empty() )
+        triangle_bvh.refit( &triangle_bounds[0] );
+}
+
+bool SceneAccel::is_valid_for( const Scene* scene ) const
+{
+    // scenes start at generation 1, so this fails if never built
+    if ( scene->get_generation() != generation )
+        return false;
+
+    for ( size_t i = 0; i < geometries.size(); ++i ) {
+        // a sphere that stopped (or started) being uniformly scaled belongs
+        // in the other list
+        if ( ( kinds[i] == KIND_SPHERE || kinds[i] == KIND_ELLIPSOID ) &&
+             ( kinds[i] == KIND_SPHERE ) != ( as_world_sphere( geometries[i] ) != 0 ) )
+            return false;
+    }
+    return true;
+}
+
+bool SceneAccel::is_thread_safe() const
+{
+    // meshes streamed from disk page clusters in as rays reach them
+    for ( size_t i = 0; i < local_geoms.size(); ++i ) {
+        if ( local_geoms[i].mesh && local_geoms[i].mesh->get_clusters() )
+            return false;
+    }
+    return true;
+}
+
+void SceneAccel::update_geometry()
+{
+    for ( size_t i = 0; i < geometries.size(); ++i ) {
+        const Geometry& geom = *geometries[i];
+        GeometryTransform& xform = transforms[i];
+        make_transformation_matrix( &xform.transform, geom.position, geom.orientation, geom.scale );
+        make_inverse_transformation_matrix( &xform.inverse, geom.position, geom.orientation, geom.scale );
+        make_normal_matrix( &xform.normal, xform.transform );
+    }
+
+    for ( size_t i = 0; i < local_geoms.size(); ++i ) {
+        LocalGeometry& entry = local_geoms[i];
+        const Geometry* geom = geometries[entry.geom];
+        // the radius may have changed along with the transform
+        if ( entry.kind == KIND_ELLIPSOID ) {
+            real_t radius = static_cast< const Sphere* >( geom )->radius;
+            entry.radius_sq = radius * radius;
+        }
+        bounds[i] = transform_bounds( geom->get_bounds(), transforms[entry.geom].transform );
+    }
+
+    // bounds are stored by primitive index, which is the table entry until
+    // the hierarchy is built
+    const unsigned int* order = sphere_bvh.get_indices();
+    for ( size_t i = 0; i < sphere_geoms.size(); ++i ) {
+        const Sphere* sphere = static_cast< const Sphere* >( geometries[sphere_geoms[i]] );
+        real_t radius = sphere->radius * sphere->scale.x;
+        Vector3 extent( radius, radius, radius );
+        spheres.set( i, sphere->position, radius );
+        sphere_bounds[order ? order[i] : i] = BoundingBox( sphere->position - extent, sphere->position + extent );
+    }
+
+    order = triangle_bvh.get_indices();
+    for ( size_t i = 0; i < triangle_geoms.size(); ++i ) {
+        unsigned int index = triangle_geoms[i];
+        const Triangle* tri = static_cast< const Triangle* >( geometries[index] );
+        const Matrix4& mat = transforms[index].transform;
+        Vector3 v0 = mat.transform_point( tri->vertices[0].position );
+        Vector3 v1 = mat.transform_point( tri->vertices[1].position );
+        Vector3 v2 = mat.transform_point( tri->vertices[2].position );
+        triangles.set( i, v0, v1, v2 );
+
+        BoundingBox& box = triangle_bounds[order ? order[i] : i];
+        box = BoundingBox( v0, v0 );
+        box.expand( v1 );
+        box.expand( v2 );
+    }
+}
+
+int SceneAccel::intersect( const ray_t& ray, real_t tmin, real_t tmax, int exclude,
+                           real_t* time, Hit* hit ) const
+{
+    int best = -1;
+
+    if ( !local_geoms.empty() ) {
+        ClosestHitVisitor visitor;
+        visitor.geometries = &geometries[0];
+        visitor.transforms = &transforms[0];
+        visitor.entries = &local_geoms[0];
+        visitor.ray = &ray;
+        visitor.tmin = tmin;
+        visitor.exclude = exclude;
+        visitor.best = -1;
+
+        bvh.traverse( ray.eye, ray.direction, tmin, &tmax, visitor );
+
+        best = visitor.best;
+        *hit = visitor.best_hit;
+    }
+
+    // the sphere table only needs to beat the closest hit so far
+    if ( !sphere_geoms.empty() ) {
+        SphereLeafVisitor visitor;
+        visitor.spheres = &spheres;
+        visitor.ray = &ray;
+        visitor.tmin = tmin;
+        visitor.exclude = exclude >= 0 && kinds[exclude] == KIND_SPHERE ? slots[exclude] : -1;
+        visitor.any_hit = false;
+        visitor.best = -1;
+
+        sphere_bvh.traverse_leaves( ray.eye, ray.direction, tmin, &tmax, visitor );
+
+        if ( visitor.best >= 0 ) {
+            best = sphere_geoms[visitor.best];
+            hit->primitive = 0;
+        }
+    }
+
+    if ( !triangle_geoms.empty() ) {
+        TriangleLeafVisitor visitor;
+        visitor.triangles = &triangles;
+        visitor.ray = &ray;
+        visitor.tmin = tmin;
+        visitor.exclude = exclude >= 0 && kinds[exclude] == KIND_TRIANGLE ? slots[exclude] : -1;
+        visitor.any_hit = false;
+        visitor.best = -1;
+
+        triangle_bvh.traverse_leaves( ray.eye, ray.direction, tmin, &tmax, visitor );
+
+        if ( visitor.best >= 0 ) {
+            best = triangle_geoms[visitor.best];
+            hit->primitive = 0;
+            hit->beta = visitor.beta;
+            hit->gamma = visitor.gamma;
+        }
+    }
+
+    *time = tmax;
+    return best;
+}
+
+void SceneAccel::get_surface_point( const ray_t& ray, int geom, real_t time, const Hit& hit,
+                                    SurfacePoint* point ) const
+{
+    const GeometryTransform& xform = transforms[geom];
+    real_t scale;
+    ray_t local = to_local( ray, xform, &scale );
+
+    geometries[geom]->get_surface_point( local, time * scale, hit, point );
+    point->position = xform.transform.transform_point( point->position );
+    point->normal = normalize( xform.normal * point->normal );
+}
+
+bool SceneAccel::is_occluded( const ray_t& ray, real_t tmin, real_t tmax, int exclude ) const
+{
+    if ( !sphere_geoms.empty() ) {
+        SphereLeafVisitor visitor;
+        visitor.spheres = &spheres;
+        visitor.ray = &ray;
+        visitor.tmin = tmin;
+        visitor.exclude = exclude >= 0 && kinds[exclude] == KIND_SPHERE ? slots[exclude] : -1;
+        visitor.any_hit = true;
+        visitor.best = -1;
+
+        real_t sphere_tmax = tmax;
+        if ( sphere_bvh.traverse_leaves( ray.eye, ray.direction, tmin, &sphere_tmax, visitor ) )
+            return true;
+    }
+
+    if ( !triangle_geoms.empty() ) {
+        TriangleLeafVisitor visitor;
+        visitor.triangles = &triangles;
+        visitor.ray = &ray;
+        visitor.tmin = tmin;
+        visitor.exclude = exclude >= 0 && kinds[exclude] == KIND_TRIANGLE ? slots[exclude] : -1;
+        visitor.any_hit = true;
+        visitor.best = -1;
+
+        real_t triangle_tmax = tmax;
+        if ( triangle_bvh.traverse_leaves( ray.eye, ray.direction, tmin, &triangle_tmax, visitor ) )
+            return true;
+    }
+
+    if ( local_geoms.empty() )
+        return false;
+
+    AnyHitVisitor visitor;
+    visitor.geometries = &geometries[0];
+    visitor.transforms = &transforms[0];
+    visitor.entries = &local_geoms[0];
+    visitor.ray = &ray;
+    visitor.tmin = tmin;
+    visitor.exclude = exclude;
+
+    return bvh.traverse( ray.eye, ray.direction, tmin, &tmax, visitor );
+}
+
+const GeometryTransform& SceneAccel::get_transform( size_t index ) const
+{
+    assert( index < transforms.size() );
+    return transforms[index];
+}
+
+} /* _462 */
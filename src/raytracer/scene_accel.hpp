@@ -0,0 +1,202 @@
+/**
+ * @file scene_accel.hpp
+ * @brief Two-level acceleration structure over the geometries of a scene.
+ */
+
+#ifndef _462_RAYTRACER_SCENE_ACCEL_HPP_
+#define _462_RAYTRACER_SCENE_ACCEL_HPP_
+
+#include "math/matrix.hpp"
+#include "raytracer/ray.hpp"
+#include "scene/bvh.hpp"
+#include "scene/sphere_batch.hpp"
+#include "scene/triangle_batch.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+class Scene;
+class Geometry;
+class Mesh;
+struct Hit;
+struct SurfacePoint;
+
+/**
+ * The world transformation of a geometry, cached so that matrices are not
+ * rebuilt for every ray.
+ */
+struct GeometryTransform
+{
+    // local to world space
+    Matrix4 transform;
+    // world to local space
+    Matrix4 inverse;
+    // transforms local normals to world space. results must be renormalized.
+    Matrix3 normal;
+};
+
+/**
+ * How a geometry is intersected by SceneAccel. Each kind has its own
+ * specialized code, selected with a switch rather than a virtual call.
+ */
+enum GeometryKind
+{
+    // through its transform and the virtual Geometry::intersect
+    KIND_GENERAL,
+    // a model, through its transform and its mesh's hierarchy
+    KIND_MODEL,
+    // a non-uniformly scaled sphere, through its transform
+    KIND_ELLIPSOID,
+    // in the world space sphere table
+    KIND_SPHERE,
+    // in the world space triangle table
+    KIND_TRIANGLE
+};
+
+/**
+ * A geometry that is intersected in its own local space, with just the
+ * data its kind of intersection needs.
+ */
+struct LocalGeometry
+{
+    // KIND_GENERAL, KIND_MODEL, or KIND_ELLIPSOID
+    int kind;
+    // index of the geometry in the scene
+    unsigned int geom;
+    // the mesh of a model
+    const Mesh* mesh;
+    // the squared radius of a sphere
+    real_t radius_sq;
+};
+
+/**
+ * A two-level acceleration structure. Each mesh keeps a hierarchy over its
+ * triangles in local space (see Mesh::get_bvh), which never changes once the
+ * mesh is loaded. This class keeps the top level: a hierarchy over the world
+ * space bounds of every geometry. When geometries move, only the top level
+ * is refit, which takes time linear in the number of geometries.
+ *
+ * Spheres with uniform scale and loose triangles are special cases: they
+ * are baked into world space tables (of centers and radii, or of vertices)
+ * with their own hierarchies, and are intersected directly without
+ * transforming the ray or calling through Geometry. Models and other
+ * spheres are dispatched on their kind, so only unknown geometries go
+ * through a virtual call.
+ */
+class SceneAccel
+{
+public:
+
+    SceneAccel();
+    ~SceneAccel();
+
+    /**
+     * Builds the top level over all geometries currently in the scene.
+     */
+    void build( const Scene* scene );
+
+    /**
+     * Recomputes the transforms and bounds of all geometries from their
+     * current position, orientation, and scale, and refits the top level
+     * without changing its topology.
+     */
+    void refit();
+
+    /**
+     * Returns true if this was built over exactly the geometries currently
+     * in the given scene, so that refit() is sufficient to update it.
+     */
+    bool is_valid_for( const Scene* scene ) const;
+
+    /**
+     * Returns true if several threads may trace rays through this at once,
+     * which is not so for meshes streamed from disk.
+     */
+    bool is_thread_safe() const;
+
+    /**
+     * Finds the closest geometry hit by the ray with a time in (tmin, tmax).
+     * Times are world space distances in units of ray.direction.
+     * @param exclude The index of a geometry to ignore, or -1.
+     * @param time Set to the time of the hit, if any.
+     * @param hit Set to the geometry's record of the hit, if any.
+     * @return The index of the geometry hit, or -1 if none.
+     */
+    int intersect( const ray_t& ray, real_t tmin, real_t tmax, int exclude,
+                   real_t* time, Hit* hit ) const;
+
+    /**
+     * Computes the world space surface properties of a hit returned by
+     * intersect() for the same ray.
+     */
+    void get_surface_point( const ray_t& ray, int geom, real_t time, const Hit& hit,
+                            SurfacePoint* point ) const;
+
+    /**
+     * Returns true if any geometry other than exclude is hit by the ray with
+     * a time in (tmin, tmax). Stops at the first such hit.
+     */
+    bool is_occluded( const ray_t& ray, real_t tmin, real_t tmax, int exclude ) const;
+
+    /// Returns the cached transform of the given geometry.
+    const GeometryTransform& get_transform( size_t index ) const;
+
+private:
+
+    typedef std::vector< const Geometry* > GeometryList;
+    typedef std::vector< GeometryTransform > TransformList;
+    typedef std::vector< BoundingBox > BoundsList;
+    typedef std::vector< unsigned int > IndexList;
+
+    // the geometries this was built over, in scene order
+    GeometryList geometries;
+    // the generation of the scene they came from
+    unsigned long generation;
+    // world transform of each geometry
+    TransformList transforms;
+
+    typedef std::vector< LocalGeometry > LocalGeometryList;
+
+    // the kind of each geometry
+    std::vector< int > kinds;
+    // entry of each geometry in the list for its kind
+    std::vector< int > slots;
+
+    // the geometries intersected through their transforms
+    LocalGeometryList local_geoms;
+    // world space bounds of each of local_geoms
+    BoundsList bounds;
+    // hierarchy over bounds
+    Bvh bvh;
+
+    // world space spheres, in the leaf order of sphere_bvh so each leaf is
+    // a contiguous range of the table
+    SphereBatch spheres;
+    // index of the geometry for each entry of spheres
+    IndexList sphere_geoms;
+    // world space bounds of each sphere, by primitive index of sphere_bvh
+    BoundsList sphere_bounds;
+    // hierarchy over sphere_bounds
+    Bvh sphere_bvh;
+
+    // world space triangles, in the leaf order of triangle_bvh
+    TriangleBatch triangles;
+    // index of the geometry for each entry of triangles
+    IndexList triangle_geoms;
+    // world space bounds of each triangle, by primitive index of triangle_bvh
+    BoundsList triangle_bounds;
+    // hierarchy over triangle_bounds
+    Bvh triangle_bvh;
+
+    // recomputes transforms, tables, and bounds from the geometries
+    void update_geometry();
+
+    // no meaningful assignment or copy
+    SceneAccel( const SceneAccel& );
+    SceneAccel& operator=( const SceneAccel& );
+};
+
+} /* _462 */
+
+#endif /* _462_RAYTRACER_SCENE_ACCEL_HPP_ */
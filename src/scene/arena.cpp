@@ -0,0 +1,83 @@
+/**
+ * @file arena.cpp
+ * @brief A monotonic allocator for objects that share a lifetime.
+ */
+
+#include "scene/arena.hpp"
+
+#include <cstdlib>
+
+namespace _462 {
+
+// rounds size up to a multiple of the arena alignment
+static size_t align_size( size_t size )
+{
+    return ( size + Arena::ALIGNMENT - 1 ) & ~( Arena::ALIGNMENT - 1 );
+}
+
+// the block header is padded so the data after it stays aligned
+#define BLOCK_HEADER_SIZE align_size( sizeof( Block ) )
+
+Arena::Arena( size_t block_size )
+    : block_size( block_size ), blocks( 0 ), cursor( 0 ), limit( 0 ),
+      finalizers( 0 ), used( 0 ) { }
+
+Arena::~Arena()
+{
+    clear();
+}
+
+void* Arena::allocate( size_t size )
+{
+    size = align_size( size );
+    used += size;
+
+    if ( size <= size_t( limit - cursor ) ) {
+        void* rv = cursor;
+        cursor += size;
+        return rv;
+    }
+
+    // a request too large to share a block gets its own, leaving the
+    // current block's free space for later requests
+    if ( size > block_size / 4 )
+        return allocate_block( size );
+
+    cursor = static_cast< char* >( allocate_block( block_size ) );
+    limit = cursor + block_size;
+    void* rv = cursor;
+    cursor += size;
+    return rv;
+}
+
+void* Arena::allocate_block( size_t size )
+{
+    Block* block = static_cast< Block* >( malloc( BLOCK_HEADER_SIZE + size ) );
+    if ( !block )
+        throw std::bad_alloc();
+    block->next = blocks;
+    blocks = block;
+    return reinterpret_cast< char* >( block ) + BLOCK_HEADER_SIZE;
+}
+
+void Arena::clear()
+{
+    // run destructors first, since objects may still refer to each other
+    while ( finalizers ) {
+        Finalizer* finalizer = finalizers;
+        finalizers = finalizer->next;
+        finalizer->destroy( finalizer->object );
+    }
+
+    while ( blocks ) {
+        Block* block = blocks;
+        blocks = block->next;
+        free( block );
+    }
+
+    cursor = 0;
+    limit = 0;
+    used = 0;
+}
+
+} /* _462 */
@@ -0,0 +1,157 @@
+/**
+ * @file arena.hpp
+ * @brief A monotonic allocator for objects that share a lifetime.
+ */
+
+#ifndef _462_SCENE_ARENA_HPP_
+#define _462_SCENE_ARENA_HPP_
+
+#include <cstddef>
+#include <new>
+
+namespace _462 {
+
+/**
+ * Hands out memory from large blocks, bumping a pointer for each request.
+ * Nothing is freed individually; clear() destroys every object made with
+ * create() and frees all blocks at once. Objects made together end up
+ * next to each other in memory.
+ *
+ * Not thread safe.
+ */
+class Arena
+{
+public:
+
+    /// Every allocation is aligned to this many bytes.
+    static const size_t ALIGNMENT = 16;
+
+    /**
+     * @param block_size The size of each block. Larger requests get a
+     *  block of their own.
+     */
+    explicit Arena( size_t block_size = 64 * 1024 );
+    ~Arena();
+
+    /**
+     * Returns size bytes of uninitialized memory, valid until clear().
+     * Throws std::bad_alloc if out of memory.
+     */
+    void* allocate( size_t size );
+
+    /**
+     * Default-constructs a T in the arena. Its destructor is run by
+     * clear(), in the reverse order of creation.
+     */
+    template< typename T >
+    T* create();
+
+    /// Destroys all created objects and frees all memory.
+    void clear();
+
+    /// Returns the number of bytes handed out since the last clear().
+    size_t bytes_used() const { return used; }
+
+private:
+
+    struct Block
+    {
+        Block* next;
+    };
+
+    // a destructor to run on clear()
+    struct Finalizer
+    {
+        void ( *destroy )( void* );
+        void* object;
+        Finalizer* next;
+    };
+
+    template< typename T >
+    static void destroy_object( void* object ) {
+        static_cast< T* >( object )->~T();
+    }
+
+    // gets a new block able to hold at least size bytes
+    void* allocate_block( size_t size );
+
+    size_t block_size;
+    // all blocks, most recent first
+    Block* blocks;
+    // free space in the current block
+    char* cursor;
+    char* limit;
+    // most recently created object first
+    Finalizer* finalizers;
+    size_t used;
+
+    // no meaningful assignment or copy
+    Arena( const Arena& );
+    Arena& operator=( const Arena& );
+};
+
+template< typename T >
+T* Arena::create()
+{
+    Finalizer* finalizer = static_cast< Finalizer* >( allocate( sizeof( Finalizer ) ) );
+    T* object = new ( allocate( sizeof( T ) ) ) T();
+    finalizer->destroy = &destroy_object< T >;
+    finalizer->object = object;
+    finalizer->next = finalizers;
+    finalizers = finalizer;
+    return object;
+}
+
+/**
+ * A standard library allocator drawing from an arena, for containers of
+ * temporaries that are thrown away together. Deallocation is a no-op, so
+ * containers that reallocate as they grow leave their old storage behind
+ * until the arena is cleared.
+ */
+template< typename T >
+class ArenaAllocator
+{
+public:
+
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template< typename U >
+    struct rebind
+    {
+        typedef ArenaAllocator< U > other;
+    };
+
+    explicit ArenaAllocator( Arena* arena ) : arena( arena ) { }
+
+    template< typename U >
+    ArenaAllocator( const ArenaAllocator< U >& other ) : arena( other.arena ) { }
+
+    pointer address( reference x ) const { return &x; }
+    const_pointer address( const_reference x ) const { return &x; }
+
+    pointer allocate( size_type n, const void* = 0 ) {
+        return static_cast< pointer >( arena->allocate( n * sizeof( T ) ) );
+    }
+
+    void deallocate( pointer, size_type ) { }
+
+    size_type max_size() const { return size_t( -1 ) / sizeof( T ); }
+
+    void construct( pointer p, const T& value ) { new ( p ) T( value ); }
+    void destroy( pointer p ) { p->~T(); }
+
+    bool operator==( const ArenaAllocator& rhs ) const { return arena == rhs.arena; }
+    bool operator!=( const ArenaAllocator& rhs ) const { return arena != rhs.arena; }
+
+    Arena* arena;
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_ARENA_HPP_ */
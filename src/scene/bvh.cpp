@@ -0,0 +1,297 @@
+/**
+ * @file bvh.cpp
+ * @brief Axis-aligned bounding boxes and a bounding volume hierarchy.
+ */
+
+#include "scene/bvh.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace _462 {
+
+// number of buckets used to evaluate candidate splits
+#define BVH_NUM_BINS 12
+// past this depth, or once only median splits are sure to stay within
+// Bvh::MAX_DEPTH, nodes are split at the object median
+#define BVH_MAX_SAH_DEPTH 40
+// cost of traversing a node relative to intersecting a primitive
+#define BVH_TRAVERSAL_COST 0.125
+
+BoundingBox::BoundingBox()
+    : min( Vector3( std::numeric_limits< real_t >::infinity(),
+                    std::numeric_limits< real_t >::infinity(),
+                    std::numeric_limits< real_t >::infinity() ) ),
+      max( -min ) { }
+
+real_t BoundingBox::surface_area() const
+{
+    if ( is_empty() )
+        return 0;
+    Vector3 d = max - min;
+    return 2.0 * ( d.x * d.y + d.y * d.z + d.z * d.x );
+}
+
+BoundingBox transform_bounds( const BoundingBox& box, const Matrix4& mat )
+{
+    BoundingBox rv;
+
+    if ( box.is_empty() )
+        return rv;
+
+    for ( size_t i = 0; i < 8; ++i ) {
+        Vector3 corner( i & 1 ? box.max.x : box.min.x,
+                        i & 2 ? box.max.y : box.min.y,
+                        i & 4 ? box.max.z : box.min.z );
+        rv.expand( mat.transform_point( corner ) );
+    }
+
+    return rv;
+}
+
+namespace {
+
+struct BuildData
+{
+    const BoundingBox* bounds;
+    const Vector3* centroids;
+    unsigned int* indices;
+    size_t max_leaf_size;
+};
+
+// true for primitives that fall into a bin at or left of the split
+struct BinPredicate
+{
+    const Vector3* centroids;
+    size_t axis;
+    real_t cmin;
+    real_t scale;
+    size_t split;
+
+    bool operator()( unsigned int prim ) const {
+        size_t bin = size_t( ( centroids[prim][axis] - cmin ) * scale );
+        return std::min( bin, size_t( BVH_NUM_BINS - 1 ) ) <= split;
+    }
+};
+
+struct CentroidLess
+{
+    const Vector3* centroids;
+    size_t axis;
+
+    bool operator()( unsigned int a, unsigned int b ) const {
+        return centroids[a][axis] < centroids[b][axis];
+    }
+};
+
+struct Bin
+{
+    BoundingBox bounds;
+    size_t count;
+};
+
+}
+
+// returns the smallest power of two at least n, as an exponent
+static size_t ceil_log2( size_t n )
+{
+    size_t rv = 0;
+    while ( ( size_t( 1 ) << rv ) < n )
+        ++rv;
+    return rv;
+}
+
+static unsigned int build_node( std::vector< Bvh::Node >& nodes, const BuildData& data,
+                                size_t begin, size_t end, size_t depth )
+{
+    unsigned int node_index = nodes.size();
+    nodes.push_back( Bvh::Node() );
+
+    BoundingBox node_bounds;
+    BoundingBox centroid_bounds;
+    for ( size_t i = begin; i < end; ++i ) {
+        node_bounds.expand( data.bounds[data.indices[i]] );
+        centroid_bounds.expand( data.centroids[data.indices[i]] );
+    }
+    nodes[node_index].bounds = node_bounds;
+
+    size_t count = end - begin;
+
+    // pick the axis of greatest centroid spread
+    Vector3 extent = centroid_bounds.max - centroid_bounds.min;
+    size_t axis = 0;
+    if ( extent.y > extent[axis] )
+        axis = 1;
+    if ( extent.z > extent[axis] )
+        axis = 2;
+
+    size_t mid = begin;
+    bool make_leaf = count == 1;
+
+    if ( !make_leaf && extent[axis] <= 0 ) {
+        // all centroids coincide, so no split separates anything
+        make_leaf = count <= data.max_leaf_size;
+        mid = begin + count / 2;
+    } else if ( !make_leaf && depth < BVH_MAX_SAH_DEPTH && depth + ceil_log2( count ) < Bvh::MAX_DEPTH ) {
+        // median splits take at most ceil_log2( count ) more levels, so
+        // allowing a skewed split only while that would still fit keeps
+        // every leaf within MAX_DEPTH
+        Bin bins[BVH_NUM_BINS];
+        BinPredicate pred;
+        pred.centroids = data.centroids;
+        pred.axis = axis;
+        pred.cmin = centroid_bounds.min[axis];
+        pred.scale = BVH_NUM_BINS / extent[axis];
+
+        for ( size_t i = 0; i < BVH_NUM_BINS; ++i )
+            bins[i].count = 0;
+        for ( size_t i = begin; i < end; ++i ) {
+            unsigned int prim = data.indices[i];
+            size_t b = size_t( ( data.centroids[prim][axis] - pred.cmin ) * pred.scale );
+            b = std::min( b, size_t( BVH_NUM_BINS - 1 ) );
+            bins[b].count++;
+            bins[b].bounds.expand( data.bounds[prim] );
+        }
+
+        // sweep from the right to get the area and count right of each split
+        real_t right_cost[BVH_NUM_BINS];
+        BoundingBox acc;
+        size_t acc_count = 0;
+        for ( size_t i = BVH_NUM_BINS - 1; i > 0; --i ) {
+            acc.expand( bins[i].bounds );
+            acc_count += bins[i].count;
+            right_cost[i - 1] = acc.surface_area() * acc_count;
+        }
+
+        // then from the left, evaluating every split
+        real_t best_cost = std::numeric_limits< real_t >::infinity();
+        size_t best_split = 0;
+        acc = BoundingBox();
+        acc_count = 0;
+        for ( size_t i = 0; i < BVH_NUM_BINS - 1; ++i ) {
+            acc.expand( bins[i].bounds );
+            acc_count += bins[i].count;
+            real_t cost = acc.surface_area() * acc_count + right_cost[i];
+            if ( cost < best_cost ) {
+                best_cost = cost;
+                best_split = i;
+            }
+        }
+
+        real_t area = node_bounds.surface_area();
+        best_cost = BVH_TRAVERSAL_COST + ( area > 0 ? best_cost / area : 0 );
+
+        if ( count <= data.max_leaf_size && best_cost >= real_t( count ) ) {
+            make_leaf = true;
+        } else {
+            pred.split = best_split;
+            mid = std::partition( data.indices + begin, data.indices + end, pred ) - data.indices;
+        }
+    } else if ( !make_leaf ) {
+        make_leaf = count <= data.max_leaf_size;
+    }
+
+    if ( make_leaf ) {
+        nodes[node_index].offset = begin;
+        nodes[node_index].count = count;
+        return node_index;
+    }
+
+    // fall back to the object median if binning failed to separate anything
+    if ( mid == begin || mid == end ) {
+        CentroidLess less;
+        less.centroids = data.centroids;
+        less.axis = axis;
+        mid = begin + count / 2;
+        std::nth_element( data.indices + begin, data.indices + mid, data.indices + end, less );
+    }
+
+    // first child immediately follows its parent
+    build_node( nodes, data, begin, mid, depth + 1 );
+    unsigned int right = build_node( nodes, data, mid, end, depth + 1 );
+    nodes[node_index].offset = right;
+    nodes[node_index].count = 0;
+    return node_index;
+}
+
+Bvh::Bvh() { }
+
+Bvh::~Bvh() { }
+
+void Bvh::build( const BoundingBox* bounds, size_t num_prims, size_t max_leaf_size )
+{
+    clear();
+
+    if ( num_prims == 0 )
+        return;
+
+    assert( bounds && max_leaf_size > 0 );
+
+    std::vector< Vector3 > centroids( num_prims );
+    indices.resize( num_prims );
+    for ( size_t i = 0; i < num_prims; ++i ) {
+        centroids[i] = bounds[i].center();
+        indices[i] = i;
+    }
+
+    BuildData data;
+    data.bounds = bounds;
+    data.centroids = &centroids[0];
+    data.indices = &indices[0];
+    data.max_leaf_size = max_leaf_size;
+
+    nodes.reserve( 2 * num_prims );
+    build_node( nodes, data, 0, num_prims, 0 );
+}
+
+void Bvh::refit( const BoundingBox* bounds )
+{
+    // children always come after their parents, so a reverse sweep
+    // sees every child before its parent
+    for ( size_t i = nodes.size(); i-- > 0; ) {
+        Node& node = nodes[i];
+        BoundingBox box;
+        if ( node.count > 0 ) {
+            for ( unsigned int j = 0; j < node.count; ++j ) {
+                box.expand( bounds[indices[node.offset + j]] );
+            }
+        } else {
+            box = nodes[i + 1].bounds;
+            box.expand( nodes[node.offset].bounds );
+        }
+        node.bounds = box;
+    }
+}
+
+void Bvh::clear()
+{
+    nodes.clear();
+    indices.clear();
+}
+
+BoundingBox Bvh::get_bounds() const
+{
+    return nodes.empty() ? BoundingBox() : nodes[0].bounds;
+}
+
+const Bvh::Node* Bvh::get_nodes() const
+{
+    return nodes.empty() ? NULL : &nodes[0];
+}
+
+size_t Bvh::num_nodes() const
+{
+    return nodes.size();
+}
+
+const unsigned int* Bvh::get_indices() const
+{
+    return indices.empty() ? NULL : &indices[0];
+}
+
+size_t Bvh::num_indices() const
+{
+    return indices.size();
+}
+
+} /* _462 */
@@ -0,0 +1,342 @@
+/**
+ * @file bvh.hpp
+ * @brief Axis-aligned bounding boxes and a bounding volume hierarchy.
+ */
+
+#ifndef _462_SCENE_BVH_HPP_
+#define _462_SCENE_BVH_HPP_
+
+#include "math/vector.hpp"
+#include "math/matrix.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/**
+ * An axis-aligned bounding box. A default-constructed box is empty, and
+ * expanding an empty box by a point yields a box containing only that point.
+ */
+struct BoundingBox
+{
+    Vector3 min;
+    Vector3 max;
+
+    /// Creates an empty box.
+    BoundingBox();
+
+    BoundingBox( const Vector3& min, const Vector3& max )
+        : min( min ), max( max ) { }
+
+    /// Grows this box to contain the given point.
+    void expand( const Vector3& p ) {
+        min = vmin( min, p );
+        max = vmax( max, p );
+    }
+
+    /// Grows this box to contain the given box.
+    void expand( const BoundingBox& b ) {
+        min = vmin( min, b.min );
+        max = vmax( max, b.max );
+    }
+
+    bool is_empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    Vector3 center() const {
+        return ( min + max ) * 0.5;
+    }
+
+    /// Returns true if the point is inside the box or on its boundary.
+    bool contains( const Vector3& p ) const {
+        return p.x >= min.x && p.x <= max.x
+            && p.y >= min.y && p.y <= max.y
+            && p.z >= min.z && p.z <= max.z;
+    }
+
+    /// Returns the surface area of the box, or 0 if empty.
+    real_t surface_area() const;
+
+    /**
+     * Slab test against a ray given by its origin and the reciprocal of its
+     * direction. Returns true if the ray enters the box between tmin and
+     * tmax, and places the entry distance in tnear.
+     */
+    bool intersect( const Vector3& eye, const Vector3& inv_dir,
+                    real_t tmin, real_t tmax, real_t* tnear ) const {
+        real_t t0 = tmin;
+        real_t t1 = tmax;
+        for ( size_t i = 0; i < 3; ++i ) {
+            real_t tn = ( min[i] - eye[i] ) * inv_dir[i];
+            real_t tf = ( max[i] - eye[i] ) * inv_dir[i];
+            if ( tn > tf )
+                std::swap( tn, tf );
+            // written so that NaNs (0 * inf) leave the interval unchanged
+            t0 = tn > t0 ? tn : t0;
+            t1 = tf < t1 ? tf : t1;
+            if ( t0 > t1 )
+                return false;
+        }
+        *tnear = t0;
+        return true;
+    }
+};
+
+/**
+ * Returns the box containing the given box after transformation by mat.
+ */
+BoundingBox transform_bounds( const BoundingBox& box, const Matrix4& mat );
+
+/**
+ * A bounding volume hierarchy over an abstract set of primitives, each of
+ * which is only known by its index and bounding box. The tree is built with
+ * a binned surface area heuristic.
+ *
+ * Nodes are stored in depth-first order: the first child of an interior node
+ * immediately follows it, and every child comes after its parent. This
+ * allows refit() to update all bounds in a single reverse sweep.
+ */
+class Bvh
+{
+public:
+
+    /**
+     * The greatest depth of a leaf, the root being at depth 0. Built trees
+     * never exceed it, so traversals can keep their pending nodes in a
+     * fixed stack.
+     */
+    static const size_t MAX_DEPTH = 63;
+
+    struct Node
+    {
+        BoundingBox bounds;
+        // interior: index of the second child. leaf: first entry in the
+        // primitive index list.
+        unsigned int offset;
+        // number of primitives in a leaf, 0 for interior nodes
+        unsigned int count;
+    };
+
+    Bvh();
+    ~Bvh();
+
+    /**
+     * Builds the hierarchy over num_prims primitives, replacing any
+     * previous tree.
+     * @param bounds The bounding box of each primitive.
+     * @param num_prims The number of primitives.
+     * @param max_leaf_size The largest number of primitives in a leaf.
+     */
+    void build( const BoundingBox* bounds, size_t num_prims, size_t max_leaf_size = 4 );
+
+    /**
+     * Recomputes the bounds of every node from new primitive bounds without
+     * changing the topology of the tree. Takes time linear in the number of
+     * nodes. The bounds must be for the same primitives given to build().
+     */
+    void refit( const BoundingBox* bounds );
+
+    /// Removes all nodes.
+    void clear();
+
+    bool empty() const { return nodes.empty(); }
+
+    /// Returns the bounds of the whole tree.
+    BoundingBox get_bounds() const;
+
+    const Node* get_nodes() const;
+    size_t num_nodes() const;
+    /// Primitive indices referenced by the leaves, in leaf order.
+    const unsigned int* get_indices() const;
+    size_t num_indices() const;
+
+    /**
+     * Visits, in roughly front-to-back order, every primitive whose leaf is
+     * entered by the ray before *tmax. For each, invokes
+     * visitor( prim_index, tmax ), which may shrink *tmax to cull farther
+     * nodes and returns true to stop the traversal early.
+     * @return true if the visitor stopped the traversal.
+     */
+    template< typename Visitor >
+    bool traverse( const Vector3& eye, const Vector3& dir,
+                   real_t tmin, real_t* tmax, Visitor& visitor ) const;
+
+    /**
+     * Like traverse(), but invokes visitor( first, count, tmax ) once per
+     * leaf, where [first, first + count) is the leaf's range of entries in
+     * get_indices(). Useful when primitives are stored in leaf order and
+     * can be tested as a group.
+     */
+    template< typename Visitor >
+    bool traverse_leaves( const Vector3& eye, const Vector3& dir,
+                          real_t tmin, real_t* tmax, Visitor& visitor ) const;
+
+    /**
+     * Like traverse_leaves(), but over nodes laid out as get_nodes() are and
+     * kept elsewhere, e.g. mapped from a file, so they need not be copied
+     * into a Bvh. The nodes are not checked, and must form a tree no deeper
+     * than MAX_DEPTH. Null is an empty tree.
+     */
+    template< typename Visitor >
+    static bool traverse_nodes( const Node* nodes, const Vector3& eye, const Vector3& dir,
+                                real_t tmin, real_t* tmax, Visitor& visitor );
+
+    /**
+     * Visits every leaf whose bounds contain the point, invoking
+     * visitor( first, count ) with the leaf's range of entries in
+     * get_indices().
+     */
+    template< typename Visitor >
+    void traverse_point( const Vector3& point, Visitor& visitor ) const;
+
+private:
+
+    // adapts a per-primitive visitor to a per-leaf one
+    template< typename Visitor >
+    struct LeafAdapter
+    {
+        const unsigned int* indices;
+        Visitor* visitor;
+
+        bool operator()( unsigned int first, unsigned int count, real_t* tmax ) {
+            for ( unsigned int i = 0; i < count; ++i ) {
+                if ( ( *visitor )( indices[first + i], tmax ) )
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    typedef std::vector< Node > NodeList;
+    typedef std::vector< unsigned int > IndexList;
+
+    NodeList nodes;
+    IndexList indices;
+};
+
+template< typename Visitor >
+bool Bvh::traverse( const Vector3& eye, const Vector3& dir,
+                    real_t tmin, real_t* tmax, Visitor& visitor ) const
+{
+    LeafAdapter< Visitor > adapter;
+    adapter.indices = get_indices();
+    adapter.visitor = &visitor;
+    return traverse_leaves( eye, dir, tmin, tmax, adapter );
+}
+
+template< typename Visitor >
+bool Bvh::traverse_leaves( const Vector3& eye, const Vector3& dir,
+                           real_t tmin, real_t* tmax, Visitor& visitor ) const
+{
+    return traverse_nodes( get_nodes(), eye, dir, tmin, tmax, visitor );
+}
+
+template< typename Visitor >
+bool Bvh::traverse_nodes( const Node* nodes, const Vector3& eye, const Vector3& dir,
+                          real_t tmin, real_t* tmax, Visitor& visitor )
+{
+    // a node has at most one pending sibling per ancestor, plus the two
+    // children it pushes
+    static const size_t STACK_SIZE = MAX_DEPTH + 1;
+
+    // a degenerate ray (e.g. reflected off a zero normal) would pass every
+    // slab test below, so reject it outright
+    if ( !nodes || dir.x != dir.x || dir.y != dir.y || dir.z != dir.z )
+        return false;
+
+    const Vector3 inv_dir( 1.0 / dir.x, 1.0 / dir.y, 1.0 / dir.z );
+    const Node* base = nodes;
+    // pending nodes along with the distance at which the ray enters them
+    unsigned int stack[STACK_SIZE];
+    real_t stack_tnear[STACK_SIZE];
+    size_t top = 0;
+    real_t tnear;
+
+    if ( !base->bounds.intersect( eye, inv_dir, tmin, *tmax, &tnear ) )
+        return false;
+
+    stack[top] = 0;
+    stack_tnear[top] = tnear;
+    ++top;
+
+    while ( top > 0 ) {
+        --top;
+        // the visitor may have found a closer hit since this node was pushed
+        if ( stack_tnear[top] > *tmax )
+            continue;
+
+        const Node& node = base[stack[top]];
+
+        if ( node.count > 0 ) {
+            if ( visitor( node.offset, node.count, tmax ) )
+                return true;
+            continue;
+        }
+
+        unsigned int left = unsigned( &node - base ) + 1;
+        unsigned int right = node.offset;
+        real_t tleft, tright;
+        bool hit_left = base[left].bounds.intersect( eye, inv_dir, tmin, *tmax, &tleft );
+        bool hit_right = base[right].bounds.intersect( eye, inv_dir, tmin, *tmax, &tright );
+
+        assert( top + 2 <= STACK_SIZE );
+
+        // push the farther child first so the nearer one is visited first
+        if ( hit_left && hit_right && tleft < tright ) {
+            stack[top] = right;
+            stack_tnear[top++] = tright;
+            stack[top] = left;
+            stack_tnear[top++] = tleft;
+        } else {
+            if ( hit_left ) {
+                stack[top] = left;
+                stack_tnear[top++] = tleft;
+            }
+            if ( hit_right ) {
+                stack[top] = right;
+                stack_tnear[top++] = tright;
+            }
+        }
+    }
+
+    return false;
+}
+
+template< typename Visitor >
+void Bvh::traverse_point( const Vector3& point, Visitor& visitor ) const
+{
+    static const size_t STACK_SIZE = MAX_DEPTH + 1;
+
+    if ( nodes.empty() || !nodes[0].bounds.contains( point ) )
+        return;
+
+    const Node* base = &nodes[0];
+    unsigned int stack[STACK_SIZE];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while ( top > 0 ) {
+        const Node& node = base[stack[--top]];
+
+        if ( node.count > 0 ) {
+            visitor( node.offset, node.count );
+            continue;
+        }
+
+        unsigned int left = unsigned( &node - base ) + 1;
+        unsigned int right = node.offset;
+
+        assert( top + 2 <= STACK_SIZE );
+
+        // push the second child first so the tree is visited in order
+        if ( base[right].bounds.contains( point ) )
+            stack[top++] = right;
+        if ( base[left].bounds.contains( point ) )
+            stack[top++] = left;
+    }
+}
+
+} /* _462 */
+
+#endif /* _462_SCENE_BVH_HPP_ */
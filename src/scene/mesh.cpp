@@ -7,12 +7,16 @@
  */
 
 #include "scene/mesh.hpp"
+#include "scene/mesh_clusters.hpp"
+#include "scene/arena.hpp"
 #include "application/opengl.hpp"
+#include "application/parallel.hpp"
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <map>
 
 namespace _462 {
@@ -51,14 +55,59 @@ enum ObjFormat
 
 Mesh::Mesh()
 {
+    normal_weighting = NORMALS_UNIFORM;
     has_tcoords = false;
     has_normals = false;
+    clusters = 0;
 }
 
-Mesh::~Mesh() { }
+Mesh::~Mesh()
+{
+    delete clusters;
+}
+
+// skips spaces and tabs
+static const char* skip_space( const char* str )
+{
+    while ( *str == ' ' || *str == '\t' )
+        ++str;
+    return str;
+}
+
+// returns the length of the token at the start of str
+static size_t token_length( const char* str )
+{
+    return strcspn( str, " \t\r\n" );
+}
+
+// returns true if the token of the given length is equal to name
+static bool token_equals( const char* token, size_t len, const char* name )
+{
+    return len == strlen( name ) && strncmp( token, name, len ) == 0;
+}
+
+// parses a number and advances str past it, returning false on failure
+static bool parse_real( const char** str, real_t* val )
+{
+    char* end;
+    *val = strtod( *str, &end );
+    if ( end == *str )
+        return false;
+    *str = end;
+    return true;
+}
 
 bool Mesh::load()
 {
+    if ( is_mesh_cluster_file( filename.c_str() ) ) {
+        std::cout << "Opening clustered mesh '" << filename << "'..." << std::endl;
+        delete clusters;
+        clusters = new ClusteredMesh();
+        // normals were loaded or generated before the clusters were saved
+        has_normals = true;
+        return clusters->open( filename.c_str(), ClusteredMesh::cache_budget );
+    }
+
     std::cout << "Loading mesh from '" << filename << "'..." << std::endl;
 
     std::string line;
@@ -74,6 +123,9 @@ bool Mesh::load()
     static const char* scan_vertex_normal = "%d//%d";
     static const char* scan_vertex_uv_normal = "%d/%d/%d";
 
+    // at most 4 are used, the fifth is to detect faces with too many
+    static const size_t MAX_FACE_TOKENS = 5;
+
     TriIndex tri[4];
 
     FaceList face_list;
@@ -83,75 +135,96 @@ bool Mesh::load()
 
     int line_num = 0;
 
-    std::string token;
-
     triangles.clear();
 
     ObjFormat format = VERTEX_ONLY;
 
-    typedef std::map< TriIndex, unsigned int > VertexMap;
-    VertexMap vertex_map;
+    // the vertex map holds a node per distinct vertex, all of which are
+    // thrown away at the end, so allocate them from a scratch arena
+    typedef std::map< TriIndex, unsigned int, std::less< TriIndex >,
+                      ArenaAllocator< std::pair< const TriIndex, unsigned int > > > VertexMap;
+    Arena scratch;
+    ArenaAllocator< char > scratch_alloc( &scratch );
+    VertexMap vertex_map( std::less< TriIndex >(), scratch_alloc );
 
     if ( !file.is_open() ) {
         std::cout << "Error opening file '" << filename << "' for mesh loading.\n";
         return false;
     }
 
+    // lines are tokenized in place rather than through string streams, so
+    // the only allocation per line is growing the line buffer
     while ( getline( file, line ) )
     {
-        std::stringstream stream( line );
-        stream >> token;
+        const char* token = skip_space( line.c_str() );
+        size_t len = token_length( token );
+        const char* args = token + len;
         line_num++;
 
-        if ( token == "v" ) {
+        if ( token_equals( token, len, "v" ) ) {
 
             Vector3 position;
-            stream >> position.x >> position.y >> position.z;
 
-            if ( stream.fail() ) {
+            if (    !parse_real( &args, &position.x )
+                 || !parse_real( &args, &position.y )
+                 || !parse_real( &args, &position.z ) ) {
                 std::cerr << "position syntax error on line " << line_num << std::endl;
                 return false;
             }
 
             position_list.push_back( position );
 
-        } else if ( token == "vn" ) {
+        } else if ( token_equals( token, len, "vn" ) ) {
             Vector3 normal;
-            stream >> normal.x >> normal.y >> normal.z;
 
-            if( stream.fail() ) {
+            if (    !parse_real( &args, &normal.x )
+                 || !parse_real( &args, &normal.y )
+                 || !parse_real( &args, &normal.z ) ) {
                 std::cerr << "normal syntax error on line " << line_num << std::endl;
                 return false;
             }
             normal_list.push_back( normal );
 
-        } else if ( token == "vt" ) {
+        } else if ( token_equals( token, len, "vt" ) ) {
 
             Vector2 uv;
-            stream >> uv.x >> uv.y;
 
-            if ( stream.fail() ) {
+            if ( !parse_real( &args, &uv.x ) || !parse_real( &args, &uv.y ) ) {
                 std::cerr << "uv syntax error on line " << line_num << std::endl;
                 return false;
             }
 
             uv_list.push_back( uv );
 
-        } else if ( token == "f" ) {
+        } else if ( token_equals( token, len, "f" ) ) {
 
-            std::vector< std::string > face_tokens;
-            std::string vert;
+            // start of each vertex token, each ending at whitespace
+            const char* face_tokens[MAX_FACE_TOKENS];
+            size_t face_token_lengths[MAX_FACE_TOKENS];
+            size_t num_vertex = 0;
 
             while ( true ) {
-                stream >> vert;
-                if( stream.fail() )
+                const char* vert = skip_space( args );
+                size_t vert_len = token_length( vert );
+                if ( vert_len == 0 )
                     break;
-                face_tokens.push_back( vert );
+                if ( num_vertex < MAX_FACE_TOKENS ) {
+                    face_tokens[num_vertex] = vert;
+                    face_token_lengths[num_vertex] = vert_len;
+                }
+                ++num_vertex;
+                args = vert + vert_len;
+            }
+
+            if ( num_vertex > 4 || num_vertex < 3 ) {
+                std::cerr << "Syntax error at line " << line_num
+                          << ", face has incorrect number of vertices" << std::endl;
+                return false;
             }
 
             // if it's the first time parsing a face, figure out the face format
             if ( face_list.size() == 0 ) {
-                std::string token = face_tokens[0];
+                std::string token( face_tokens[0], face_token_lengths[0] );
 
                 if ( token.find( "//" ) != std::string::npos ) {
                     format = VERTEX_NORMAL;
@@ -172,20 +245,11 @@ bool Mesh::load()
                 }
             }
 
-            size_t num_vertex;
-            num_vertex = face_tokens.size();
-
-            if ( num_vertex > 4 || num_vertex < 3 ) {
-                std::cerr << "Syntax error at line " << line_num
-                          << ", face has incorrect number of vertices" << std::endl;
-                return false;
-            }
-
             for ( size_t i = 0; i < num_vertex; ++i ) {
                 switch ( format )
                 {
                 case VERTEX_ONLY:
-                    sscanf( face_tokens[i].c_str(),
+                    sscanf( face_tokens[i],
                             scan_vertex,
                             &tri[i].vertex );
                     tri[i].normal = 0;
@@ -193,7 +257,7 @@ bool Mesh::load()
                     break;
 
                 case VERTEX_UV:
-                    sscanf( face_tokens[i].c_str(),
+                    sscanf( face_tokens[i],
                             scan_vertex_uv,
                             &tri[i].vertex,
                             &tri[i].tcoord );
@@ -201,7 +265,7 @@ bool Mesh::load()
                     break;
 
                 case VERTEX_NORMAL:
-                    sscanf( face_tokens[i].c_str(),
+                    sscanf( face_tokens[i],
                             scan_vertex_normal,
                             &tri[i].vertex,
                             &tri[i].normal );
@@ -209,7 +273,7 @@ bool Mesh::load()
                     break;
 
                 case VERTEX_UV_NORMAL:
-                    sscanf( face_tokens[i].c_str(),
+                    sscanf( face_tokens[i],
                             scan_vertex_uv_normal,
                             &tri[i].vertex,
                             &tri[i].tcoord,
@@ -237,14 +301,9 @@ bool Mesh::load()
                 face_list.push_back( f2 );
             }
 
-        } else if ( token == " " ) {
-
         } else {
             //std::cerr << "Unknown token on line " << line_num << std::endl;
         }
-
-        token.clear();
-        line.clear();
     }
 
     // verify index list sanity
@@ -285,11 +344,11 @@ bool Mesh::load()
             std::pair< VertexMap::iterator, bool > rv = vertex_map.insert( std::make_pair( face.v[j], vert_idx_counter ) );
             if ( rv.second ) {
                 MeshVertex v;
-                v.position = position_list[face.v[j].vertex];
+                v.set_position( position_list[face.v[j].vertex] );
                 int nidx = face.v[j].normal;
-                v.normal = nidx == -1 ? Vector3::Zero : normal_list[nidx];
+                v.set_normal( nidx == -1 ? Vector3::UnitZ : normal_list[nidx] );
                 int tidx = face.v[j].tcoord;
-                v.tex_coord = tidx == -1 ? Vector2::Zero : uv_list[tidx];
+                v.set_tex_coord( tidx == -1 ? Vector2::Zero : uv_list[tidx] );
                 vertices.push_back( v );
                 vert_idx_counter++;
             }
@@ -299,6 +358,22 @@ bool Mesh::load()
         triangles.push_back( tri );
     }
 
+    // free the parsed data before generating normals and the hierarchy,
+    // which need memory of their own, and drop the slack left by the
+    // reserve above
+    FaceList().swap( face_list );
+    PositionList().swap( position_list );
+    NormalList().swap( normal_list );
+    UVList().swap( uv_list );
+    vertex_map.clear();
+    scratch.clear();
+    MeshVertexList( vertices ).swap( vertices );
+
+    if ( !has_normals ) {
+        compute_normals();
+    }
+    build_bvh();
+
     std::cout << "Successfully loaded mesh '" << filename << "'.\n";
     return true;
 }
@@ -323,60 +398,174 @@ size_t Mesh::num_vertices() const
     return vertices.size();
 }
 
-bool Mesh::are_normals_valid() const
+BoundingBox Mesh::get_bounds() const
 {
-    return has_normals;
+    return clusters ? clusters->get_bounds() : bvh.get_bounds();
 }
 
-bool Mesh::are_tex_coords_valid() const
+const Bvh& Mesh::get_bvh() const
 {
-    return has_tcoords;
+    return bvh;
 }
 
-// number of floats per vertex
-#define VERTEX_SIZE 8
+const ClusteredMesh* Mesh::get_clusters() const
+{
+    return clusters;
+}
 
-bool Mesh::create_gl_data()
+void Mesh::build_bvh()
 {
-    // if no vertices, nothing to do
-    if ( vertices.empty() || triangles.empty() ) {
-        return false;
-    }
+    std::vector< BoundingBox > bounds( triangles.size() );
 
-    // compute normals if needed
-    if ( !has_normals ) {
-        // first zero out
-        for ( size_t i = 0; i < vertices.size(); ++i ) {
-            vertices[i].normal = Vector3::Zero;
+    for ( size_t i = 0; i < triangles.size(); ++i ) {
+        for ( size_t j = 0; j < 3; ++j ) {
+            bounds[i].expand( vertices[triangles[i].vertices[j]].get_position() );
         }
+    }
 
-        // then sum in all triangle normals
-        for ( size_t i = 0; i < triangles.size(); ++i ) {
+    bvh.build( bounds.empty() ? NULL : &bounds[0], bounds.size() );
+}
+
+// number of triangles or vertices per parallel chunk
+#define NORMAL_GRAIN 4096
+
+// computes the weighted normal of each corner of a range of triangles
+struct CornerNormalTask
+{
+    const MeshVertex* vertices;
+    const MeshTriangle* triangles;
+    Mesh::NormalWeighting weighting;
+    // three per triangle
+    Vector3* corner_normals;
+
+    void operator()( size_t begin, size_t end ) const {
+        for ( size_t i = begin; i < end; ++i ) {
             Vector3 pos[3];
             for ( size_t j = 0; j < 3; ++j ) {
-                pos[j] = vertices[triangles[i].vertices[j]].position;
+                pos[j] = vertices[triangles[i].vertices[j]].get_position();
             }
-            Vector3 normal = normalize( cross( pos[1] - pos[0], pos[2] - pos[0] ) );
+            Vector3 normal = cross( pos[1] - pos[0], pos[2] - pos[0] );
+            Vector3* corners = corner_normals + 3 * i;
+
+            // degenerate triangles have no normal to add
+            if ( normal == Vector3::Zero ) {
+                corners[0] = corners[1] = corners[2] = Vector3::Zero;
+                continue;
+            }
+            // the length of the cross product is twice the area
+            if ( weighting != Mesh::NORMALS_AREA )
+                normal = normalize( normal );
+
             for ( size_t j = 0; j < 3; ++j ) {
-                vertices[triangles[i].vertices[j]].normal += normal;
+                corners[j] = normal;
+                if ( weighting == Mesh::NORMALS_ANGLE ) {
+                    Vector3 e1 = normalize( pos[( j + 1 ) % 3] - pos[j] );
+                    Vector3 e2 = normalize( pos[( j + 2 ) % 3] - pos[j] );
+                    corners[j] *= acos( clamp( dot( e1, e2 ), -1.0, 1.0 ) );
+                }
             }
         }
+    }
+};
 
-        // then normalize
-        for ( size_t i = 0; i < vertices.size(); ++i ) {
-            vertices[i].normal = normalize( vertices[i].normal );
+// sums the corner normals at each of a range of vertices
+struct VertexNormalTask
+{
+    const Vector3* corner_normals;
+    // the corners at vertex v are corners[first[v]] to corners[first[v + 1]]
+    const unsigned int* first;
+    const unsigned int* corners;
+    MeshVertex* vertices;
+
+    void operator()( size_t begin, size_t end ) const {
+        for ( size_t v = begin; v < end; ++v ) {
+            Vector3 normal = Vector3::Zero;
+            for ( unsigned int i = first[v]; i < first[v + 1]; ++i ) {
+                normal += corner_normals[corners[i]];
+            }
+            vertices[v].set_normal( normalize( normal ) );
         }
+    }
+};
 
-        has_normals = true;
+void Mesh::compute_normals()
+{
+    if ( vertices.empty() || triangles.empty() ) {
+        return;
+    }
+
+    // each vertex gathers from its own corners rather than each triangle
+    // scattering into its vertices, so no two threads write the same
+    // vertex, and sums are in triangle order whatever the thread count
+    std::vector< Vector3 > corner_normals( 3 * triangles.size() );
+    CornerNormalTask corner_task;
+    corner_task.vertices = &vertices[0];
+    corner_task.triangles = &triangles[0];
+    corner_task.weighting = normal_weighting;
+    corner_task.corner_normals = &corner_normals[0];
+    parallel_for( triangles.size(), NORMAL_GRAIN, corner_task );
+
+    // group the corners by vertex with a counting sort
+    std::vector< unsigned int > first( vertices.size() + 1, 0 );
+    std::vector< unsigned int > corners( 3 * triangles.size() );
+    for ( size_t i = 0; i < triangles.size(); ++i ) {
+        for ( size_t j = 0; j < 3; ++j ) {
+            ++first[triangles[i].vertices[j] + 1];
+        }
+    }
+    for ( size_t v = 0; v < vertices.size(); ++v ) {
+        first[v + 1] += first[v];
+    }
+    std::vector< unsigned int > next( first.begin(), first.end() - 1 );
+    for ( size_t i = 0; i < triangles.size(); ++i ) {
+        for ( size_t j = 0; j < 3; ++j ) {
+            corners[next[triangles[i].vertices[j]]++] = 3 * i + j;
+        }
+    }
+
+    VertexNormalTask vertex_task;
+    vertex_task.corner_normals = &corner_normals[0];
+    vertex_task.first = &first[0];
+    vertex_task.corners = &corners[0];
+    vertex_task.vertices = &vertices[0];
+    parallel_for( vertices.size(), NORMAL_GRAIN, vertex_task );
+
+    has_normals = true;
+}
+
+bool Mesh::are_normals_valid() const
+{
+    return has_normals;
+}
+
+bool Mesh::are_tex_coords_valid() const
+{
+    return has_tcoords;
+}
+
+// number of floats per vertex
+#define VERTEX_SIZE 8
+
+bool Mesh::create_gl_data()
+{
+    // too large to draw, so only the raytracer sees it
+    if ( clusters ) {
+        std::cout << "Mesh '" << filename << "' is out of core, not drawing it with opengl.\n";
+        return true;
+    }
+
+    // if no vertices, nothing to do
+    if ( vertices.empty() || triangles.empty() ) {
+        return false;
     }
 
     // build vertex data
     vertex_data.resize( vertices.size() * VERTEX_SIZE );
     float* vertex = &vertex_data[0];
     for ( size_t i = 0; i < vertices.size(); ++i ) {
-        vertices[i].tex_coord.to_array( vertex + 0 );
-        vertices[i].normal.to_array( vertex + 2 );
-        vertices[i].position.to_array( vertex + 5 );
+        vertices[i].get_tex_coord().to_array( vertex + 0 );
+        vertices[i].get_normal().to_array( vertex + 2 );
+        vertices[i].get_position().to_array( vertex + 5 );
         vertex += VERTEX_SIZE;
     }
     // build index data
@@ -394,6 +583,8 @@ bool Mesh::create_gl_data()
 
 void Mesh::render() const
 {
+    if ( clusters )
+        return;
     assert( index_data.size() > 0 );
     glInterleavedArrays( GL_T2F_N3F_V3F, VERTEX_SIZE * sizeof vertex_data[0], &vertex_data[0] );
     glDrawElements( GL_TRIANGLES, index_data.size(), GL_UNSIGNED_INT, &index_data[0] );
@@ -10,17 +10,44 @@
 #define _462_SCENE_MESH_HPP_
 
 #include "math/vector.hpp"
+#include "math/packing.hpp"
+#include "scene/bvh.hpp"
 
 #include <vector>
 #include <cassert>
 
 namespace _462 {
 
+/**
+ * A vertex of a mesh, packed into 20 bytes since meshes can have millions:
+ * a float position, an octahedral normal, and half float texture
+ * coordinates. Read and write it through the accessors.
+ */
 struct MeshVertex
 {
-    Vector3 position;
-    Vector3 normal;
-    Vector2 tex_coord;
+    Vector3 get_position() const {
+        return Vector3( position[0], position[1], position[2] );
+    }
+    void set_position( const Vector3& p ) {
+        position[0] = float( p.x );
+        position[1] = float( p.y );
+        position[2] = float( p.z );
+    }
+
+    Vector3 get_normal() const { return unpack_unit_vector( normal ); }
+    void set_normal( const Vector3& n ) { normal = pack_unit_vector( n ); }
+
+    Vector2 get_tex_coord() const {
+        return Vector2( unpack_half( tex_coord[0] ), unpack_half( tex_coord[1] ) );
+    }
+    void set_tex_coord( const Vector2& t ) {
+        tex_coord[0] = pack_half( float( t.x ) );
+        tex_coord[1] = pack_half( float( t.y ) );
+    }
+
+    float position[3];
+    unsigned int normal;
+    unsigned short tex_coord[2];
 };
 
 struct MeshTriangle
@@ -29,6 +56,8 @@ struct MeshTriangle
     unsigned int vertices[3];
 };
 
+class ClusteredMesh;
+
 /**
  * A mesh of triangles.
  */
@@ -36,11 +65,25 @@ class Mesh
 {
 public:
 
+    /// How face normals are weighted when generating vertex normals.
+    enum NormalWeighting
+    {
+        // every face counts the same
+        NORMALS_UNIFORM,
+        // faces count by their area
+        NORMALS_AREA,
+        // faces count by their angle at the vertex
+        NORMALS_ANGLE
+    };
+
     Mesh();
     ~Mesh();
 
     /**
-     * Loads the model into a list of triangles and vertices.
+     * Loads the model into a list of triangles and vertices. If the file
+     * has no normals, smooth normals are generated with normal_weighting.
+     * A cluster file (see save_mesh_clusters) is opened instead, leaving
+     * the triangles on disk; see get_clusters().
      * @return True on success.
      */
     bool load();
@@ -54,15 +97,28 @@ public:
     /// The number of elements in the vertex array.
     size_t num_vertices() const;
 
-    /// Returns true if the loaded model contained normal data.
+    /// Returns the bounding box of all triangles.
+    BoundingBox get_bounds() const;
+    /// Returns the hierarchy over the triangles, built by load().
+    const Bvh& get_bvh() const;
+    /**
+     * Returns the clusters if the mesh was loaded from a cluster file, in
+     * which case it has no triangles, vertices, or hierarchy in memory.
+     * Null otherwise.
+     */
+    const ClusteredMesh* get_clusters() const;
+
+    /// Returns true if the model has normals, loaded or generated.
     bool are_normals_valid() const;
     /// Returns true if the loaded model contained texture coordinate data.
     bool are_tex_coords_valid() const;
 
     // scene loader stores the filename of the mesh here
     std::string filename;
+    // and how to weight generated normals, if the file has none
+    NormalWeighting normal_weighting;
 
-    /// Creates opengl data for rendering and computes normals if needed
+    /// Creates opengl data for rendering
     bool create_gl_data();
     /// Renders the mesh using opengl.
     void render() const;
@@ -81,6 +137,17 @@ private:
     bool has_tcoords;
     bool has_normals;
 
+    // bounding volume hierarchy over the triangles, indexed by triangle
+    Bvh bvh;
+
+    // owned, for meshes loaded from cluster files
+    ClusteredMesh* clusters;
+
+    // builds bvh from the current triangles
+    void build_bvh();
+    // sets each vertex normal to the weighted mean of its faces' normals
+    void compute_normals();
+
     typedef std::vector< float > FloatList;
     typedef std::vector< unsigned int > IndexList;
 
@@ -0,0 +1,538 @@
+/**
+ * @file mesh_clusters.cpp
+ * @brief Meshes too large for memory, paged in from a file as needed.
+ *
+ * A cluster file is a header and a table of clusters, followed by the
+ * clusters themselves, each starting on an aligned offset so it can be
+ * mapped on its own. A cluster holds its vertices, then its triangles
+ * indexing those vertices, then the nodes of its hierarchy, whose leaves
+ * refer to ranges of its triangles.
+ */
+
+#include "scene/mesh_clusters.hpp"
+
+#include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace _462 {
+
+static const char CLUSTER_FILE_MAGIC[8] = "P4CLUST";
+// bump whenever the layout changes
+static const unsigned int CLUSTER_FILE_VERSION = 1;
+// written as is, so it reads back differently on the wrong byte order
+static const unsigned int CLUSTER_FILE_BYTE_ORDER = 0x01020304;
+// clusters start at multiples of this, a common page size
+static const size_t CLUSTER_ALIGNMENT = 4096;
+
+size_t ClusteredMesh::cache_budget = 256 * 1024 * 1024;
+
+struct ClusterFileHeader
+{
+    char magic[8];
+    unsigned int version;
+    unsigned int byte_order;
+    unsigned int real_size;
+    unsigned int alignment;
+    unsigned int num_clusters;
+    unsigned int num_triangles;
+};
+
+// what is written for each cluster in the table
+struct ClusterRecord
+{
+    BoundingBox bounds;
+    // in units of CLUSTER_ALIGNMENT
+    unsigned int offset;
+    // in bytes
+    unsigned int size;
+    unsigned int first_triangle;
+    unsigned int num_triangles;
+    unsigned int num_vertices;
+    unsigned int num_nodes;
+};
+
+static size_t align( size_t offset, size_t alignment )
+{
+    return ( offset + alignment - 1 ) / alignment * alignment;
+}
+
+// the offsets of the parts of a cluster, from its start
+static size_t triangles_offset( size_t num_vertices )
+{
+    return num_vertices * sizeof( MeshVertex );
+}
+
+static size_t nodes_offset( size_t num_vertices, size_t num_triangles )
+{
+    return align( triangles_offset( num_vertices ) + num_triangles * sizeof( MeshTriangle ), 8 );
+}
+
+// returns true if the nodes are a tree that Bvh::traverse_nodes can walk:
+// laid out depth first with each subtree a contiguous range, no deeper than
+// Bvh::MAX_DEPTH, and with leaves in the range of the triangles
+static bool check_nodes( const Bvh::Node* nodes, size_t num_nodes, size_t num_triangles )
+{
+    if ( num_nodes == 0 )
+        return true;
+
+    // subtrees left to check, each rooted at node and ending before end.
+    // as in a traversal, at most one sibling per ancestor is pending.
+    struct Subtree
+    {
+        size_t node;
+        size_t end;
+        size_t depth;
+    };
+    Subtree stack[Bvh::MAX_DEPTH + 1];
+    size_t top = 0;
+    stack[top].node = 0;
+    stack[top].end = num_nodes;
+    stack[top].depth = 0;
+    ++top;
+
+    while ( top > 0 ) {
+        Subtree tree = stack[--top];
+        const Bvh::Node& node = nodes[tree.node];
+
+        if ( node.count > 0 ) {
+            if ( tree.end != tree.node + 1 || node.offset + (size_t) node.count > num_triangles )
+                return false;
+            continue;
+        }
+
+        // the first child follows the node, the second starts at offset
+        if ( tree.depth >= Bvh::MAX_DEPTH || node.offset <= tree.node + 1 || node.offset >= tree.end )
+            return false;
+        stack[top].node = node.offset;
+        stack[top].end = tree.end;
+        stack[top].depth = tree.depth + 1;
+        ++top;
+        stack[top].node = tree.node + 1;
+        stack[top].end = node.offset;
+        stack[top].depth = tree.depth + 1;
+        ++top;
+    }
+    return true;
+}
+
+static size_t cluster_size( size_t num_vertices, size_t num_triangles, size_t num_nodes )
+{
+    return nodes_offset( num_vertices, num_triangles ) + num_nodes * sizeof( Bvh::Node );
+}
+
+bool save_mesh_clusters( const Mesh& mesh, const char* filename, size_t max_cluster_size )
+{
+    const Bvh& mesh_bvh = mesh.get_bvh();
+    const Bvh::Node* nodes = mesh_bvh.get_nodes();
+    const unsigned int* order = mesh_bvh.get_indices();
+    const MeshTriangle* triangles = mesh.get_triangles();
+    const MeshVertex* vertices = mesh.get_vertices();
+    size_t num_nodes = mesh_bvh.num_nodes();
+
+    if ( !nodes || mesh.get_clusters() ) {
+        std::cout << "Error: mesh '" << mesh.filename << "' has no triangles to save.\n";
+        return false;
+    }
+
+    // for each subtree: the triangles under it, which are a range of the
+    // leaf order, and the end of its nodes. children come after their
+    // parents, so a reverse sweep sees children first.
+    std::vector< unsigned int > counts( num_nodes );
+    std::vector< unsigned int > firsts( num_nodes );
+    std::vector< unsigned int > ends( num_nodes );
+    for ( size_t i = num_nodes; i-- > 0; ) {
+        if ( nodes[i].count > 0 ) {
+            counts[i] = nodes[i].count;
+            firsts[i] = nodes[i].offset;
+            ends[i] = i + 1;
+        } else {
+            counts[i] = counts[i + 1] + counts[nodes[i].offset];
+            firsts[i] = firsts[i + 1];
+            ends[i] = ends[nodes[i].offset];
+        }
+    }
+
+    // the clusters are the largest subtrees that are small enough
+    std::vector< unsigned int > roots;
+    std::vector< unsigned int > stack( 1, 0 );
+    while ( !stack.empty() ) {
+        unsigned int i = stack.back();
+        stack.pop_back();
+        if ( counts[i] <= max_cluster_size || nodes[i].count > 0 ) {
+            roots.push_back( i );
+        } else {
+            // right first, so clusters come out in leaf order
+            stack.push_back( nodes[i].offset );
+            stack.push_back( i + 1 );
+        }
+    }
+
+    std::vector< ClusterRecord > records( roots.size() );
+    size_t offset = align( sizeof( ClusterFileHeader ) + records.size() * sizeof( ClusterRecord ),
+                           CLUSTER_ALIGNMENT );
+
+    FILE* file = fopen( filename, "wb" );
+    if ( !file ) {
+        std::cout << "Error opening file '" << filename << "' for writing.\n";
+        return false;
+    }
+
+    // clusters are written first, then the table once it is filled in
+    std::vector< int > local_index( mesh.num_vertices(), -1 );
+    std::vector< MeshVertex > local_vertices;
+    std::vector< MeshTriangle > local_triangles;
+    std::vector< Bvh::Node > local_nodes;
+    std::vector< char > data;
+    bool ok = true;
+
+    for ( size_t c = 0; ok && c < roots.size(); ++c ) {
+        unsigned int root = roots[c];
+        unsigned int first = firsts[root];
+        unsigned int count = counts[root];
+
+        local_vertices.clear();
+        local_triangles.clear();
+        for ( unsigned int i = first; i < first + count; ++i ) {
+            MeshTriangle tri = triangles[order[i]];
+            for ( size_t j = 0; j < 3; ++j ) {
+                int& local = local_index[tri.vertices[j]];
+                if ( local < 0 ) {
+                    local = local_vertices.size();
+                    local_vertices.push_back( vertices[tri.vertices[j]] );
+                }
+                tri.vertices[j] = local;
+            }
+            local_triangles.push_back( tri );
+        }
+        // reset only what this cluster touched
+        for ( unsigned int i = first; i < first + count; ++i ) {
+            for ( size_t j = 0; j < 3; ++j ) {
+                local_index[triangles[order[i]].vertices[j]] = -1;
+            }
+        }
+
+        // the subtree, renumbered from its root and its first triangle
+        local_nodes.assign( nodes + root, nodes + ends[root] );
+        for ( size_t i = 0; i < local_nodes.size(); ++i ) {
+            local_nodes[i].offset -= local_nodes[i].count > 0 ? first : root;
+        }
+
+        size_t nv = local_vertices.size();
+        size_t nt = local_triangles.size();
+        size_t nn = local_nodes.size();
+        size_t size = cluster_size( nv, nt, nn );
+        if ( offset / CLUSTER_ALIGNMENT > 0xffffffffu || size > 0xffffffffu ) {
+            std::cout << "Error: mesh is too large for a cluster file.\n";
+            ok = false;
+            break;
+        }
+
+        data.assign( align( size, CLUSTER_ALIGNMENT ), 0 );
+        memcpy( &data[0], &local_vertices[0], nv * sizeof( MeshVertex ) );
+        memcpy( &data[triangles_offset( nv )], &local_triangles[0], nt * sizeof( MeshTriangle ) );
+        memcpy( &data[nodes_offset( nv, nt )], &local_nodes[0], nn * sizeof( Bvh::Node ) );
+
+        ClusterRecord& record = records[c];
+        record.bounds = nodes[root].bounds;
+        record.offset = offset / CLUSTER_ALIGNMENT;
+        record.size = size;
+        record.first_triangle = first;
+        record.num_triangles = count;
+        record.num_vertices = nv;
+        record.num_nodes = nn;
+
+        ok = fseek( file, offset, SEEK_SET ) == 0
+            && fwrite( &data[0], data.size(), 1, file ) == 1;
+        offset += data.size();
+    }
+
+    ClusterFileHeader header;
+    memset( &header, 0, sizeof header );
+    memcpy( header.magic, CLUSTER_FILE_MAGIC, sizeof header.magic );
+    header.version = CLUSTER_FILE_VERSION;
+    header.byte_order = CLUSTER_FILE_BYTE_ORDER;
+    header.real_size = sizeof( real_t );
+    header.alignment = CLUSTER_ALIGNMENT;
+    header.num_clusters = records.size();
+    header.num_triangles = mesh.num_triangles();
+
+    ok = ok && fseek( file, 0, SEEK_SET ) == 0
+        && fwrite( &header, sizeof header, 1, file ) == 1
+        && fwrite( &records[0], sizeof( ClusterRecord ), records.size(), file ) == records.size();
+    ok = fclose( file ) == 0 && ok;
+
+    if ( !ok ) {
+        std::cout << "Error writing cluster file '" << filename << "'.\n";
+        return false;
+    }
+
+    std::cout << "Saved " << records.size() << " clusters to '" << filename << "'.\n";
+    return true;
+}
+
+bool is_mesh_cluster_file( const char* filename )
+{
+    char magic[sizeof CLUSTER_FILE_MAGIC];
+    FILE* file = fopen( filename, "rb" );
+    if ( !file )
+        return false;
+    bool rv = fread( magic, sizeof magic, 1, file ) == 1
+        && memcmp( magic, CLUSTER_FILE_MAGIC, sizeof magic ) == 0;
+    fclose( file );
+    return rv;
+}
+
+ClusteredMesh::ClusteredMesh()
+    : file( 0 ), total_triangles( 0 ), budget( 0 )
+{
+    memset( &stats, 0, sizeof stats );
+}
+
+ClusteredMesh::~ClusteredMesh()
+{
+    close();
+}
+
+bool ClusteredMesh::open( const char* filename, size_t budget )
+{
+    close();
+
+    file = fopen( filename, "rb" );
+    if ( !file ) {
+        std::cout << "Error opening file '" << filename << "'.\n";
+        return false;
+    }
+    this->filename = filename;
+    this->budget = budget;
+
+    ClusterFileHeader header;
+    const char* error = 0;
+    if ( fread( &header, sizeof header, 1, file ) != 1 ) {
+        error = "file too short";
+    } else if ( memcmp( header.magic, CLUSTER_FILE_MAGIC, sizeof header.magic ) != 0 ) {
+        error = "bad magic number";
+    } else if ( header.version != CLUSTER_FILE_VERSION ) {
+        error = "unsupported version";
+    } else if ( header.byte_order != CLUSTER_FILE_BYTE_ORDER || header.real_size != sizeof( real_t ) ) {
+        error = "written on an incompatible machine";
+    } else if ( header.alignment != CLUSTER_ALIGNMENT ) {
+        error = "unsupported alignment";
+    }
+
+    std::vector< ClusterRecord > records;
+    if ( !error ) {
+        records.resize( header.num_clusters );
+        if ( fread( records.empty() ? 0 : &records[0], sizeof( ClusterRecord ),
+                    records.size(), file ) != records.size() ) {
+            error = "file too short";
+        }
+    }
+
+    // clusters are mapped, and reading a mapping past the end of the file
+    // is a crash rather than an error, so check they are all there
+    long file_size = -1;
+    if ( !error && fseek( file, 0, SEEK_END ) == 0 )
+        file_size = ftell( file );
+    if ( !error && file_size < 0 )
+        error = "unable to find its size";
+
+    std::vector< BoundingBox > bounds;
+    for ( size_t i = 0; !error && i < records.size(); ++i ) {
+        const ClusterRecord& record = records[i];
+        if ( size_t( record.offset ) * CLUSTER_ALIGNMENT + record.size > size_t( file_size )
+             || record.size < cluster_size( record.num_vertices, record.num_triangles, record.num_nodes )
+             || record.num_nodes == 0
+             || record.first_triangle + (size_t) record.num_triangles > header.num_triangles ) {
+            error = "bad cluster";
+            break;
+        }
+        ClusterEntry entry;
+        entry.bounds = record.bounds;
+        entry.offset = record.offset;
+        entry.size = record.size;
+        entry.first_triangle = record.first_triangle;
+        entry.num_triangles = record.num_triangles;
+        entry.num_vertices = record.num_vertices;
+        entry.num_nodes = record.num_nodes;
+        clusters.push_back( entry );
+        bounds.push_back( entry.bounds );
+    }
+
+    if ( error ) {
+        std::cout << "Error: invalid cluster file '" << filename << "', " << error << ".\n";
+        close();
+        return false;
+    }
+
+    total_triangles = header.num_triangles;
+    bvh.build( bounds.empty() ? 0 : &bounds[0], bounds.size() );
+    resident.assign( clusters.size(), 0 );
+    invalid.assign( clusters.size(), false );
+    return true;
+}
+
+void ClusteredMesh::close()
+{
+    while ( !lru.empty() ) {
+        evict();
+    }
+    if ( file ) {
+        fclose( file );
+        file = 0;
+    }
+    clusters.clear();
+    resident.clear();
+    invalid.clear();
+    bvh.clear();
+    total_triangles = 0;
+}
+
+BoundingBox ClusteredMesh::get_bounds() const
+{
+    return bvh.get_bounds();
+}
+
+void ClusteredMesh::get_triangle( unsigned int index, MeshVertex vertices[3] ) const
+{
+    // clusters are in triangle order, so find the last one starting at or
+    // before the index
+    size_t lo = 0;
+    size_t hi = clusters.size();
+    while ( hi - lo > 1 ) {
+        size_t mid = ( lo + hi ) / 2;
+        if ( clusters[mid].first_triangle <= index ) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const Cluster* cluster = page_in( lo );
+    assert( cluster && index - cluster->first_triangle < clusters[lo].num_triangles );
+    const MeshTriangle& tri = cluster->triangles[index - cluster->first_triangle];
+    for ( size_t j = 0; j < 3; ++j ) {
+        vertices[j] = cluster->vertices[tri.vertices[j]];
+    }
+}
+
+const ClusteredMesh::Cluster* ClusteredMesh::page_in( unsigned int index ) const
+{
+    ++stats.lookups;
+
+    ResidentCluster* cluster = resident[index];
+    if ( cluster ) {
+        lru.splice( lru.begin(), lru, cluster->lru_position );
+        return &cluster->cluster;
+    }
+    if ( invalid[index] ) {
+        return 0;
+    }
+
+    ++stats.page_ins;
+    cluster = new ResidentCluster();
+    if ( !map_cluster( index, cluster ) ) {
+        std::cout << "Error: invalid cluster " << index << " in '" << filename << "'.\n";
+        invalid[index] = true;
+        delete cluster;
+        return 0;
+    }
+
+    while ( !lru.empty() && stats.resident_bytes + cluster->bytes > budget ) {
+        evict();
+    }
+
+    lru.push_front( index );
+    cluster->lru_position = lru.begin();
+    resident[index] = cluster;
+    stats.resident_bytes += cluster->bytes;
+    stats.peak_bytes = std::max( stats.peak_bytes, stats.resident_bytes );
+    return &cluster->cluster;
+}
+
+void ClusteredMesh::evict() const
+{
+    unsigned int index = lru.back();
+    lru.pop_back();
+    ResidentCluster* cluster = resident[index];
+    stats.resident_bytes -= cluster->bytes;
+    ++stats.evictions;
+    unmap_cluster( cluster );
+    delete cluster;
+    resident[index] = 0;
+}
+
+bool ClusteredMesh::map_cluster( unsigned int index, ResidentCluster* resident ) const
+{
+    const ClusterEntry& entry = clusters[index];
+    size_t offset = size_t( entry.offset ) * CLUSTER_ALIGNMENT;
+    const char* data = 0;
+
+#ifndef _WIN32
+    // the mapping must start on a page, which may be larger than a cluster
+    // file's alignment
+    size_t page = sysconf( _SC_PAGESIZE );
+    size_t map_offset = offset / page * page;
+    resident->map_size = offset - map_offset + entry.size;
+    resident->map = mmap( 0, resident->map_size, PROT_READ, MAP_PRIVATE, fileno( file ), map_offset );
+    if ( resident->map == MAP_FAILED ) {
+        resident->map = 0;
+        return false;
+    }
+    data = static_cast< const char* >( resident->map ) + ( offset - map_offset );
+#else
+    // no mapping, so read it instead
+    resident->map_size = entry.size;
+    resident->map = malloc( entry.size );
+    if ( !resident->map || fseek( file, offset, SEEK_SET ) != 0
+         || fread( resident->map, entry.size, 1, file ) != 1 ) {
+        unmap_cluster( resident );
+        return false;
+    }
+    data = static_cast< const char* >( resident->map );
+#endif
+
+    Cluster& cluster = resident->cluster;
+    cluster.vertices = reinterpret_cast< const MeshVertex* >( data );
+    cluster.triangles = reinterpret_cast< const MeshTriangle* >( data + triangles_offset( entry.num_vertices ) );
+    cluster.first_triangle = entry.first_triangle;
+
+    // check everything that is used as an index before trusting it
+    bool ok = true;
+    for ( size_t i = 0; ok && i < entry.num_triangles; ++i ) {
+        for ( size_t j = 0; j < 3; ++j ) {
+            ok = ok && cluster.triangles[i].vertices[j] < entry.num_vertices;
+        }
+    }
+    const Bvh::Node* nodes = reinterpret_cast< const Bvh::Node* >(
+        data + nodes_offset( entry.num_vertices, entry.num_triangles ) );
+    if ( !ok || !check_nodes( nodes, entry.num_nodes, entry.num_triangles ) ) {
+        unmap_cluster( resident );
+        return false;
+    }
+
+    // the nodes are traversed where they are mapped
+    cluster.nodes = entry.num_nodes > 0 ? nodes : 0;
+    resident->bytes = resident->map_size;
+    return true;
+}
+
+void ClusteredMesh::unmap_cluster( ResidentCluster* resident ) const
+{
+#ifndef _WIN32
+    if ( resident->map )
+        munmap( resident->map, resident->map_size );
+#else
+    free( resident->map );
+#endif
+    resident->map = 0;
+    resident->cluster.nodes = 0;
+}
+
+} /* _462 */
@@ -0,0 +1,189 @@
+/**
+ * @file mesh_clusters.hpp
+ * @brief Meshes too large for memory, paged in from a file as needed.
+ */
+
+#ifndef _462_SCENE_MESH_CLUSTERS_HPP_
+#define _462_SCENE_MESH_CLUSTERS_HPP_
+
+#include "scene/mesh.hpp"
+
+#include <cstdio>
+#include <list>
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Writes a loaded mesh as a cluster file, which ClusteredMesh renders
+ * without loading it all. The mesh's hierarchy is cut into subtrees of at
+ * most max_cluster_size triangles, each stored with its own vertices and
+ * nodes so it can be read on its own.
+ * Prints a message to stdout if an error occurs.
+ * @return True on success, false on error.
+ */
+bool save_mesh_clusters( const Mesh& mesh, const char* filename, size_t max_cluster_size );
+
+/// Returns true if the file is a cluster file, judging by its header.
+bool is_mesh_cluster_file( const char* filename );
+
+/// Counts of how well the clusters of a mesh fit in the cache.
+struct ClusterStats
+{
+    // clusters entered by rays, and how many of those had to be read in
+    size_t lookups;
+    size_t page_ins;
+    // clusters dropped to make room for others
+    size_t evictions;
+    // bytes of clusters in memory, now and at most
+    size_t resident_bytes;
+    size_t peak_bytes;
+};
+
+/**
+ * A mesh read from a cluster file. Only the bounds of the clusters stay in
+ * memory; a cluster's vertices, triangles, and hierarchy are mapped from
+ * the file when a ray first enters its bounds, and the least recently used
+ * clusters are unmapped to keep the total under a budget.
+ *
+ * Triangles are numbered in the order of the file, so Hit::primitive
+ * identifies a triangle across page ins. Paging changes the cache from
+ * const functions, so a ClusteredMesh must not be traced from several
+ * threads at once.
+ */
+class ClusteredMesh
+{
+public:
+
+    /// A cluster in memory.
+    struct Cluster
+    {
+        const MeshVertex* vertices;
+        // indices into vertices
+        const MeshTriangle* triangles;
+        // a tree over triangles, which are in leaf order, for
+        // Bvh::traverse_nodes. null if the cluster has no triangles.
+        const Bvh::Node* nodes;
+        // the number of the cluster's first triangle in the whole mesh
+        unsigned int first_triangle;
+    };
+
+    ClusteredMesh();
+    ~ClusteredMesh();
+
+    /**
+     * Opens a cluster file, reading the cluster bounds.
+     * Prints a message to stdout if an error occurs.
+     * @param budget The most bytes of clusters to keep in memory. At least
+     *  one cluster is always kept, however large.
+     * @return True on success, false on error.
+     */
+    bool open( const char* filename, size_t budget );
+    void close();
+
+    BoundingBox get_bounds() const;
+    size_t num_triangles() const { return total_triangles; }
+
+    /**
+     * Visits, in roughly front-to-back order, every cluster whose bounds
+     * the ray enters before *tmax, paging each in. For each, invokes
+     * visitor( cluster, tmax ), which may shrink *tmax. The cluster may be
+     * paged out once the visitor returns.
+     */
+    template< typename Visitor >
+    void traverse( const Vector3& eye, const Vector3& dir,
+                   real_t tmin, real_t* tmax, Visitor& visitor ) const;
+
+    /// Copies out the vertices of a triangle, paging in its cluster.
+    void get_triangle( unsigned int index, MeshVertex vertices[3] ) const;
+
+    const ClusterStats& get_stats() const { return stats; }
+
+    /// The budget given to meshes loaded from cluster files by Mesh::load.
+    static size_t cache_budget;
+
+private:
+
+    // where a cluster is in the file
+    struct ClusterEntry
+    {
+        BoundingBox bounds;
+        // in units of the file's alignment
+        unsigned int offset;
+        unsigned int size;
+        unsigned int first_triangle;
+        unsigned int num_triangles;
+        unsigned int num_vertices;
+        unsigned int num_nodes;
+    };
+
+    typedef std::list< unsigned int > LruList;
+
+    struct ResidentCluster
+    {
+        Cluster cluster;
+        // the mapping, which may start before the cluster's data
+        void* map;
+        size_t map_size;
+        // counted against the budget
+        size_t bytes;
+        LruList::iterator lru_position;
+    };
+
+    // adapts a per-cluster visitor to the hierarchy over clusters
+    template< typename Visitor >
+    struct ClusterVisitor
+    {
+        const ClusteredMesh* mesh;
+        Visitor* visitor;
+
+        bool operator()( unsigned int index, real_t* tmax ) {
+            const Cluster* cluster = mesh->page_in( index );
+            if ( cluster )
+                ( *visitor )( *cluster, tmax );
+            return false;
+        }
+    };
+
+    // returns the cluster, reading it if needed, or null if it is invalid
+    const Cluster* page_in( unsigned int index ) const;
+    // unmaps the least recently used cluster
+    void evict() const;
+    // maps and checks a cluster's data
+    bool map_cluster( unsigned int index, ResidentCluster* resident ) const;
+    void unmap_cluster( ResidentCluster* resident ) const;
+
+    FILE* file;
+    std::string filename;
+    std::vector< ClusterEntry > clusters;
+    // over the clusters
+    Bvh bvh;
+    size_t total_triangles;
+    size_t budget;
+
+    // the cache, which changes as rays page clusters in
+    mutable std::vector< ResidentCluster* > resident;
+    // most recently used first
+    mutable LruList lru;
+    mutable ClusterStats stats;
+    // clusters that failed to load, so the error is printed once
+    mutable std::vector< bool > invalid;
+
+    // no meaningful assignment or copy
+    ClusteredMesh( const ClusteredMesh& );
+    ClusteredMesh& operator=( const ClusteredMesh& );
+};
+
+template< typename Visitor >
+void ClusteredMesh::traverse( const Vector3& eye, const Vector3& dir,
+                              real_t tmin, real_t* tmax, Visitor& visitor ) const
+{
+    ClusterVisitor< Visitor > cluster_visitor;
+    cluster_visitor.mesh = this;
+    cluster_visitor.visitor = &visitor;
+    bvh.traverse( eye, dir, tmin, tmax, cluster_visitor );
+}
+
+} /* _462 */
+
+#endif /* _462_SCENE_MESH_CLUSTERS_HPP_ */
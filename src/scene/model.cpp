@@ -8,6 +8,7 @@
 
 #include "scene/model.hpp"
 #include "scene/material.hpp"
+#include "scene/mesh_clusters.hpp"
 #include <GL/gl.h>
 #include <iostream>
 #include <cstring>
@@ -32,148 +33,217 @@ void Model::render() const
         material->reset_gl_state();
 }
 
-real_t Model::getTime(MeshVertex v0, MeshVertex v1, MeshVertex v2, ray_t myRay){
-
-	real_t a = v0.position.x - v1.position.x; 
-	real_t b = v0.position.y - v1.position.y;
-	real_t c = v0.position.z - v1.position.z;
-	real_t d = v0.position.x - v2.position.x; 
-	real_t e = v0.position.y - v2.position.y;
-	real_t f = v0.position.z - v2.position.z;
-	real_t g = myRay.direction.x;
-	real_t h = myRay.direction.y;
-	real_t i = myRay.direction.z;
-	real_t j = v0.position.x - myRay.eye.x;
-	real_t k = v0.position.y - myRay.eye.y;
-	real_t l = v0.position.z - myRay.eye.z;
-	
-	real_t akMinusjb = a * k - j * b;
-	real_t jcMinusal = j * c - a * l;
-	real_t blMinuskc = b * l - k * c;
-	real_t eiMinushf = e * i - h * f;
-	real_t gfMinusdi = g * f - d * i;
-	real_t dhMinuseg = d * h - e * g;
-
-	real_t M = a * eiMinushf + b * gfMinusdi + c * dhMinuseg;
-	real_t t = -1.0 * (f * akMinusjb + e * jcMinusal + d * blMinuskc)/M;
-
-	if( (t < SLOP_FACTOR) || (t > 100) )
-		return -1;
-
-	this->gamma = (i * akMinusjb + h * jcMinusal + g * blMinuskc)/M;
-
-	if( (this->gamma < 0) || (this->gamma > 1) )
-		return -1;
-
-	this->beta = (j * eiMinushf + k * gfMinusdi + l * dhMinuseg)/M;
-
-	if( (this->beta < 0) || (this->beta > 1 - this->gamma) )
-		return -1;
-
-	Vector3 myNormal = (this->beta * v1.normal) + (this->gamma * v2.normal) + ((1 - this->beta - this->gamma) * v0.normal);
-	myNormal = normalize(myNormal);
-
-	if(dot(myNormal,myRay.direction) >= 0)
-				t= -1;
-
-	return t;
+BoundingBox Model::get_bounds() const
+{
+    return mesh ? mesh->get_bounds() : BoundingBox();
 }
 
-real_t Model::intersect(ray_t myRay){
-	
-	const MeshTriangle* myMesh = mesh->get_triangles();
-	const MeshVertex* myVertices = mesh->get_vertices();
-	real_t t = -1;
-	real_t time = 100;
-
-	for(int i = 0; i < mesh->num_triangles(); i++){
-
-		MeshVertex v0 = myVertices[myMesh[i].vertices[0]];
-		MeshVertex v1 = myVertices[myMesh[i].vertices[1]];
-		MeshVertex v2 = myVertices[myMesh[i].vertices[2]];
-
-		t = getTime(v0,v1,v2,myRay);
-
-		if( (t > SLOP_FACTOR) && (t < time) ){
-
-			time = t;
-
-			real_t magic = 0.25;
-
-			if(v1.tex_coord.x - v2.tex_coord.x > magic)
-				std::cout<< "GOTEM";
-
-			if(v2.tex_coord.x - v0.tex_coord.x > magic)
-				std::cout << "GOTEM";
+/**
+ * Intersects a ray with the triangle (v0,v1,v2), ignoring back faces.
+ * @return The time of the hit, or -1 on a miss. On a hit, beta and gamma
+ *  are the barycentric weights of v1 and v2.
+ */
+static real_t intersect_triangle( const MeshVertex& v0, const MeshVertex& v1, const MeshVertex& v2,
+                                  const ray_t& ray, real_t* beta, real_t* gamma )
+{
+    //variable names taken from shirley text
+    //corresponding to equation 4.2
 
-			if(v0.tex_coord.x - v1.tex_coord.x > magic)
-				std::cout << "GOTEM";
+    Vector3 p0 = v0.get_position();
+    Vector3 p1 = v1.get_position();
+    Vector3 p2 = v2.get_position();
 
-			if(v1.tex_coord.y - v2.tex_coord.y > magic)
-				std::cout<< "GOTEM";
+    real_t a = p0.x - p1.x;
+    real_t b = p0.y - p1.y;
+    real_t c = p0.z - p1.z;
+    real_t d = p0.x - p2.x;
+    real_t e = p0.y - p2.y;
+    real_t f = p0.z - p2.z;
+    real_t g = ray.direction.x;
+    real_t h = ray.direction.y;
+    real_t i = ray.direction.z;
+    real_t j = p0.x - ray.eye.x;
+    real_t k = p0.y - ray.eye.y;
+    real_t l = p0.z - ray.eye.z;
 
-			if(v2.tex_coord.y - v0.tex_coord.y > magic)
-				std::cout << "GOTEM";
+    real_t akMinusjb = a * k - j * b;
+    real_t jcMinusal = j * c - a * l;
+    real_t blMinuskc = b * l - k * c;
+    real_t eiMinushf = e * i - h * f;
+    real_t gfMinusdi = g * f - d * i;
+    real_t dhMinuseg = d * h - e * g;
 
-			if(v0.tex_coord.y - v1.tex_coord.y > magic)
-				std::cout << "GOTEM";
+    real_t M = a * eiMinushf + b * gfMinusdi + c * dhMinuseg;
+    real_t t = -1.0 * (f * akMinusjb + e * jcMinusal + d * blMinuskc)/M;
 
-			this->normal = (beta * v1.normal) + (gamma * v2.normal) + ((1-beta-gamma) * v0.normal);
-			this->normal = normalize(normal);
+    if( (t < SLOP_FACTOR) || (t > 100) )
+        return -1;
 
-			Vector2 coords = (this->beta * v1.tex_coord) + (this->gamma * v2.tex_coord) + ((1 - this->beta - this->gamma) * v0.tex_coord);
+    *gamma = (i * akMinusjb + h * jcMinusal + g * blMinuskc)/M;
 
-			int width;
-			int height;
+    if( (*gamma < 0) || (*gamma > 1) )
+        return -1;
 
-			material->get_texture_size(&width, &height);
+    *beta = (j * eiMinushf + k * gfMinusdi + l * dhMinuseg)/M;
 
-			int x = coords.x * width;
-			int y = coords.y * height;
+    if( (*beta < 0) || (*beta > 1 - *gamma) )
+        return -1;
 
-			this->texture = material->get_texture_pixel(x, y);
-	
-			this->diffuse = material->diffuse;
+    Vector3 normal = (*beta * v1.get_normal()) + (*gamma * v2.get_normal()) + ((1 - *beta - *gamma) * v0.get_normal());
+    normal = normalize(normal);
 
-			this->ambient = material->ambient;
+    if ( dot( normal, ray.direction ) >= 0 )
+        return -1;
 
-			this->specular = material->specular;
+    return t;
+}
 
-			this->intersection = myRay.eye + (t * myRay.direction);
-		}
+namespace {
 
-	}
+// finds the closest triangle of a mesh hit by a ray
+struct MeshHitVisitor
+{
+    const MeshTriangle* triangles;
+    const MeshVertex* vertices;
+    const ray_t* ray;
+
+    // the closest triangle so far, or -1 if none
+    int best;
+    real_t beta;
+    real_t gamma;
+
+    bool operator()( unsigned int index, real_t* tmax ) {
+        const MeshTriangle& tri = triangles[index];
+        real_t b, g;
+        real_t t = intersect_triangle( vertices[tri.vertices[0]],
+                                       vertices[tri.vertices[1]],
+                                       vertices[tri.vertices[2]],
+                                       *ray, &b, &g );
+        if ( t > SLOP_FACTOR && t < *tmax ) {
+            *tmax = t;
+            best = index;
+            beta = b;
+            gamma = g;
+        }
+        return false;
+    }
+
+    // tests a leaf's range of triangles, for trees over triangles stored
+    // in leaf order
+    bool operator()( unsigned int first, unsigned int count, real_t* tmax ) {
+        for ( unsigned int i = first; i < first + count; ++i ) {
+            ( *this )( i, tmax );
+        }
+        return false;
+    }
+};
+
+// runs a MeshHitVisitor over each cluster of an out-of-core mesh
+struct ClusterHitVisitor
+{
+    MeshHitVisitor mesh_visitor;
+
+    // the closest triangle so far in the whole mesh, or -1 if none
+    int best;
+
+    void operator()( const ClusteredMesh::Cluster& cluster, real_t* tmax ) {
+        mesh_visitor.triangles = cluster.triangles;
+        mesh_visitor.vertices = cluster.vertices;
+        mesh_visitor.best = -1;
+        Bvh::traverse_nodes( cluster.nodes, mesh_visitor.ray->eye, mesh_visitor.ray->direction,
+                             SLOP_FACTOR, tmax, mesh_visitor );
+        if ( mesh_visitor.best >= 0 )
+            best = cluster.first_triangle + mesh_visitor.best;
+    }
+};
+
+real_t intersect_clusters( const ClusteredMesh& clusters, const ray_t& ray, Hit* hit )
+{
+    ClusterHitVisitor visitor;
+    visitor.mesh_visitor.ray = &ray;
+    visitor.best = -1;
 
-	if(time == 100)
-		return -1;
-	else
-		return time;
-}
+    real_t time = 100;
+    clusters.traverse( ray.eye, ray.direction, SLOP_FACTOR, &time, visitor );
 
-Color3 Model::getAmbientColor(){
-	return this->ambient;
-}
+    if ( visitor.best < 0 )
+        return -1;
 
-Color3 Model::getDiffuseColor(){
-	return this->diffuse;
+    hit->primitive = visitor.best;
+    hit->beta = visitor.mesh_visitor.beta;
+    hit->gamma = visitor.mesh_visitor.gamma;
+    return time;
 }
 
-Vector3 Model::getNormal(){
-	return this->normal;
 }
 
-Color3 Model::getSpecularColor(){
-	return this->specular;
+real_t Model::intersect( const ray_t& ray, Hit* hit ) const
+{
+    return mesh ? intersect_mesh( *mesh, ray, hit ) : -1;
 }
 
-Vector3 Model::getIntersectionPt(){
-	return this->intersection;
+real_t Model::intersect_mesh( const Mesh& mesh, const ray_t& ray, Hit* hit )
+{
+    if ( mesh.get_clusters() )
+        return intersect_clusters( *mesh.get_clusters(), ray, hit );
+    if ( mesh.num_triangles() == 0 )
+        return -1;
+
+    MeshHitVisitor visitor;
+    visitor.triangles = mesh.get_triangles();
+    visitor.vertices = mesh.get_vertices();
+    visitor.ray = &ray;
+    visitor.best = -1;
+
+    real_t time = 100;
+    mesh.get_bvh().traverse( ray.eye, ray.direction, SLOP_FACTOR, &time, visitor );
+
+    if ( visitor.best < 0 )
+        return -1;
+
+    hit->primitive = visitor.best;
+    hit->beta = visitor.beta;
+    hit->gamma = visitor.gamma;
+    return time;
 }
 
-Color3 Model::getTextureColor(){
-	return this->texture;
+void Model::get_surface_point( const ray_t& ray, real_t time, const Hit& hit,
+                               SurfacePoint* point ) const
+{
+    MeshVertex vertices[3];
+    if ( mesh->get_clusters() ) {
+        mesh->get_clusters()->get_triangle( hit.primitive, vertices );
+    } else {
+        const MeshTriangle& tri = mesh->get_triangles()[hit.primitive];
+        for ( size_t i = 0; i < 3; ++i ) {
+            vertices[i] = mesh->get_vertices()[tri.vertices[i]];
+        }
+    }
+    const MeshVertex& v0 = vertices[0];
+    const MeshVertex& v1 = vertices[1];
+    const MeshVertex& v2 = vertices[2];
+    real_t beta = hit.beta;
+    real_t gamma = hit.gamma;
+    real_t alpha = 1 - beta - gamma;
+
+    point->normal = normalize( beta * v1.get_normal() + gamma * v2.get_normal() + alpha * v0.get_normal() );
+
+    Vector2 coords = beta * v1.get_tex_coord() + gamma * v2.get_tex_coord() + alpha * v0.get_tex_coord();
+
+    int width;
+    int height;
+
+    material->get_texture_size( &width, &height );
+
+    int x = coords.x * width;
+    int y = coords.y * height;
+
+    point->texture = material->get_texture_pixel( x, y );
+    point->diffuse = material->diffuse;
+    point->ambient = material->ambient;
+    point->specular = material->specular;
+    point->position = ray.eye + time * ray.direction;
 }
 
-
 } /* _462 */
 
@@ -14,7 +14,9 @@
 namespace _462 {
 
 /**
- * A mesh of triangles.
+ * An instance of a mesh of triangles. Many models may share one mesh, along
+ * with the mesh's acceleration structure; a model only adds a transform and
+ * a material, and holds no per-ray state.
  */
 class Model : public Geometry
 {
@@ -26,27 +28,18 @@ public:
     Model();
     virtual ~Model();
 
-	Color3 ambient;
-	Color3 diffuse;
-	Color3 specular;
-	Color3 texture;
-	Vector3 normal;
-	Vector3 intersection;
-
     virtual void render() const;
-	virtual real_t intersect(ray_t myRay);
-	virtual Color3 getAmbientColor();
-	virtual Color3 getDiffuseColor();
-	virtual Vector3 getNormal();
-	virtual Color3 getSpecularColor();
-	virtual Vector3 getIntersectionPt();
-	virtual Color3 getTextureColor();
-
-private:
-	real_t beta;
-	real_t gamma;
-	real_t getTime(MeshVertex v0, MeshVertex v1, MeshVertex v2, ray_t myRay);
-
+    virtual BoundingBox get_bounds() const;
+    virtual real_t intersect( const ray_t& ray, Hit* hit ) const;
+    virtual void get_surface_point( const ray_t& ray, real_t time, const Hit& hit,
+                                    SurfacePoint* point ) const;
+
+    /**
+     * Intersects a ray in the local space of a model with a mesh, ignoring
+     * back faces. Same semantics as Geometry::intersect. Lets callers that
+     * already know they hold a model skip the virtual call.
+     */
+    static real_t intersect_mesh( const Mesh& mesh, const ray_t& ray, Hit* hit );
 };
 
 
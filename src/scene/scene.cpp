@@ -32,6 +32,43 @@ PointLight::PointLight():
     attenuation.quadratic = 0;
 }
 
+AreaLight::AreaLight():
+    shape( SHAPE_SPHERE ),
+    position( Vector3::Zero ),
+    color( Color3::White ),
+    radius( 1 ),
+    edge_u( Vector3::UnitX ),
+    edge_v( Vector3::UnitZ ),
+    num_samples( 4 )
+{
+    attenuation.constant = 1;
+    attenuation.linear = 0;
+    attenuation.quadratic = 0;
+}
+
+Vector3 AreaLight::sample( real_t u, real_t v, const Vector3& from ) const
+{
+    if ( shape == SHAPE_QUAD )
+        return position + ( u - 0.5 ) * edge_u + ( v - 0.5 ) * edge_v;
+
+    // the hemisphere around the direction to the point, where height is
+    // uniform since a hemisphere's area grows linearly with it
+    Vector3 w = from - position;
+    real_t len = length( w );
+    w = len > 0 ? w / len : Vector3::UnitZ;
+    Vector3 a = fabs( w.x ) < 0.9 ? Vector3::UnitX : Vector3::UnitY;
+    a = normalize( cross( w, a ) );
+    Vector3 b = cross( w, a );
+
+    real_t z = u;
+    real_t r = sqrt( std::max( real_t( 0 ), 1 - z * z ) );
+    real_t phi = 2 * PI * v;
+    return position + radius * ( r * cos( phi ) * a + r * sin( phi ) * b + z * w );
+}
+
+
+// the last generation of any scene, so each one is unique
+static unsigned long last_generation = 0;
 
 Scene::Scene()
 {
@@ -63,6 +100,16 @@ size_t Scene::num_lights() const
     return point_lights.size();
 }
 
+const AreaLight* Scene::get_area_lights() const
+{
+    return area_lights.empty() ? NULL : &area_lights[0];
+}
+
+size_t Scene::num_area_lights() const
+{
+    return area_lights.size();
+}
+
 Material* const* Scene::get_materials() const
 {
     return materials.empty() ? NULL : &materials[0];
@@ -85,31 +132,36 @@ size_t Scene::num_meshes() const
 
 void Scene::reset()
 {
-    for ( GeometryList::iterator i = geometries.begin(); i != geometries.end(); ++i ) {
-        delete *i;
-    }
-    for ( MaterialList::iterator i = materials.begin(); i != materials.end(); ++i ) {
-        delete *i;
-    }
-    for ( MeshList::iterator i = meshes.begin(); i != meshes.end(); ++i ) {
-        delete *i;
-    }
-
     geometries.clear();
     materials.clear();
     meshes.clear();
     point_lights.clear();
+    area_lights.clear();
+    arena.clear();
+    next_generation();
 
     camera = Camera();
+    camera_path.clear();
 
     background_color = Color3::Black;
     ambient_light = Color3::Black;
     refractive_index = 1.0;
 }
 
+Arena* Scene::get_arena()
+{
+    return &arena;
+}
+
 void Scene::add_geometry( Geometry* g )
 {
     geometries.push_back( g );
+    next_generation();
+}
+
+void Scene::next_generation()
+{
+    generation = ++last_generation;
 }
 
 void Scene::add_material( Material* m )
@@ -127,6 +179,11 @@ void Scene::add_light( const PointLight& l )
     point_lights.push_back( l );
 }
 
+void Scene::add_area_light( const AreaLight& l )
+{
+    area_lights.push_back( l );
+}
+
 
 } /* _462 */
 
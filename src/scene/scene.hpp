@@ -13,14 +13,44 @@
 #include "math/quaternion.hpp"
 #include "math/matrix.hpp"
 #include "math/camera.hpp"
+#include "math/camera_path.hpp"
 #include "scene/material.hpp"
 #include "scene/mesh.hpp"
+#include "scene/bvh.hpp"
+#include "scene/arena.hpp"
 #include "raytracer/raytracer.hpp"
 #include <string>
 #include <vector>
 
 namespace _462 {
 
+/**
+ * Where a ray hit a geometry. Filled in by Geometry::intersect and handed
+ * back to Geometry::get_surface_point for the closest hit only, so that
+ * surface properties are not computed for hits that are later discarded.
+ */
+struct Hit
+{
+    // index of the primitive hit within the geometry, e.g. a mesh triangle
+    unsigned int primitive;
+    // barycentric weights of the second and third vertex, for triangles
+    real_t beta;
+    real_t gamma;
+};
+
+/**
+ * The surface properties at a ray hit.
+ */
+struct SurfacePoint
+{
+    Vector3 position;
+    // not necessarily normalized
+    Vector3 normal;
+    Color3 ambient;
+    Color3 diffuse;
+    Color3 specular;
+    Color3 texture;
+};
 
 class Geometry
 {
@@ -49,14 +79,31 @@ public:
      * Renders this geometry using OpenGL in the local coordinate space.
      */
     virtual void render() const = 0;
-	virtual real_t intersect(ray_t myRay) = 0;
-	virtual Color3 getAmbientColor() = 0;
-	virtual Color3 getDiffuseColor() = 0;
-	virtual Vector3 getNormal() = 0;
-	virtual Color3 getSpecularColor() = 0;
-	virtual Vector3 getIntersectionPt() = 0;
-	virtual Color3 getTextureColor() = 0;
 
+    /**
+     * Returns the bounding box of this geometry in its local space.
+     */
+    virtual BoundingBox get_bounds() const = 0;
+
+    /**
+     * Intersects a ray with this geometry. Both are in local space.
+     * Does not modify the geometry, so one geometry may be intersected by
+     * many rays at once.
+     * @param ray The ray, with a normalized direction.
+     * @param hit Filled in with the location of the hit, if any.
+     * @return The time of the hit, or a negative number if there is none.
+     */
+    virtual real_t intersect( const ray_t& ray, Hit* hit ) const = 0;
+
+    /**
+     * Computes the surface properties at a hit found by intersect.
+     * @param ray The ray given to intersect.
+     * @param time The time returned by intersect.
+     * @param hit The hit filled in by intersect.
+     * @param point Filled in with the local space surface properties.
+     */
+    virtual void get_surface_point( const ray_t& ray, real_t time, const Hit& hit,
+                                    SurfacePoint* point ) const = 0;
 };
 
 
@@ -79,6 +126,45 @@ struct PointLight
     Attenuation attenuation;
 };
 
+/**
+ * A light with an area, which casts soft shadows. It shades like a grid of
+ * point lights spread over its surface, sharing its color between them.
+ */
+struct AreaLight
+{
+    enum Shape
+    {
+        // a sphere of the given radius around position
+        SHAPE_SPHERE,
+        // a parallelogram centered on position, spanning
+        // position +/- edge_u / 2 +/- edge_v / 2
+        SHAPE_QUAD
+    };
+
+    AreaLight();
+
+    /**
+     * Returns the point of the light at (u, v) in [0, 1)^2, uniformly
+     * distributed over its area for uniform (u, v). For spheres, only the
+     * half facing the given point is sampled, since the other half is
+     * hidden from it.
+     */
+    Vector3 sample( real_t u, real_t v, const Vector3& from ) const;
+
+    Shape shape;
+    Vector3 position;
+    Color3 color;
+    PointLight::Attenuation attenuation;
+    // for spheres
+    real_t radius;
+    // for quads
+    Vector3 edge_u;
+    Vector3 edge_v;
+    // the points in penumbras are shaded with a grid of
+    // num_samples * num_samples shadow rays
+    unsigned int num_samples;
+};
+
 /**
  * The container class for information used to render a scene composed of
  * Geometries.
@@ -89,6 +175,8 @@ public:
 
     /// the camera
     Camera camera;
+    /// keyframed camera motion for animations, empty for still images
+    CameraPath camera_path;
     /// the background color
     Color3 background_color;
     /// the amibient light of the scene
@@ -99,7 +187,7 @@ public:
     /// Creates a new empty scene.
     Scene();
 
-    /// Destroys this scene. Invokes delete on everything in geometries.
+    /// Destroys this scene and everything allocated from its arena.
     ~Scene();
 
     // accessor functions
@@ -107,36 +195,63 @@ public:
     size_t num_geometries() const;
     const PointLight* get_lights() const;
     size_t num_lights() const;
+    const AreaLight* get_area_lights() const;
+    size_t num_area_lights() const;
     Material* const* get_materials() const;
     size_t num_materials() const;
     Mesh* const* get_meshes() const;
     size_t num_meshes() const;
 
-    /// Clears the scene, and invokes delete on everything in geometries.
+    /**
+     * Returns a number that changes whenever geometry is added or the scene
+     * is reset, and that no other scene ever has. Structures built over the
+     * geometries keep it to tell whether they still match, which comparing
+     * pointers cannot, as the arena reuses addresses after a reset.
+     */
+    unsigned long get_generation() const { return generation; }
+
+    /// Clears the scene, destroying everything allocated from its arena.
     void reset();
 
+    /**
+     * Returns the arena holding the scene's geometries, materials, and
+     * meshes. Everything in it is destroyed at once by reset().
+     */
+    Arena* get_arena();
+
     // functions to add things to the scene
-    // all pointers are deleted by the scene upon scene deconstruction.
+    // all pointers must be created with get_arena()->create(), and are
+    // destroyed along with the arena.
     void add_geometry( Geometry* g );
     void add_material( Material* m );
     void add_mesh( Mesh* m );
     void add_light( const PointLight& l );
+    void add_area_light( const AreaLight& l );
 
 private:
 
     typedef std::vector< PointLight > PointLightList;
+    typedef std::vector< AreaLight > AreaLightList;
     typedef std::vector< Material* > MaterialList;
     typedef std::vector< Mesh* > MeshList;
     typedef std::vector< Geometry* > GeometryList;
 
     // list of all lights in the scene
     PointLightList point_lights;
+    AreaLightList area_lights;
     // all materials used by geometries
     MaterialList materials;
     // all meshes used by models
     MeshList meshes;
-    // list of all geometries. deleted in dctor, so should be allocated on heap.
+    // list of all geometries
     GeometryList geometries;
+    // owns everything in the lists above
+    Arena arena;
+    // changes with the list of geometries
+    unsigned long generation;
+
+    // moves to a generation no scene has had
+    void next_generation();
 
 private:
 
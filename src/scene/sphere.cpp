@@ -9,6 +9,9 @@
 #include "scene/sphere.hpp"
 #include "application/opengl.hpp"
 
+#include <algorithm>
+#include <limits>
+
 namespace _462 {
 
 #define SPHERE_NUM_LAT 80
@@ -98,92 +101,47 @@ void Sphere::render() const
         material->reset_gl_state();
 }
 
-real_t Sphere::intersect(ray_t myRay){
-
-	//equations taken from shirley
-
-	Vector3 e = myRay.eye;
-	Vector3 c = Vector3(0,0,0);
-	Vector3 d = myRay.direction;
-
-	if(length(myRay.eye - c) < radius)
-		return -1;
-
-	Vector3 eMinusc = e - c;
-
-	real_t bSquared = pow(dot(d, eMinusc),2);
-	real_t twoC = dot(eMinusc, eMinusc) - pow(radius,2);
-	real_t twoA = dot(d,d);
-	real_t bSquaredMinus4AC = bSquared - (twoC * twoA);
-	real_t sqrt = std::sqrt(bSquaredMinus4AC);
-	real_t time;
-
-	if(bSquaredMinus4AC >= 0){
-		real_t negativeB = -1.0 * dot(d,eMinusc);
-		real_t t1 = (negativeB + sqrt) / twoA;
-		real_t t2 = (negativeB - sqrt) / twoA;
-		color = this->material->ambient;
-		if( (t1 > SLOP_FACTOR) ){
-			if( (t1 < t2) )
-				time = t1;
-			else{
-				if( t2 > SLOP_FACTOR )
-					time =  t2;
-				else
-					time = t1;
-			}
-			intersection = myRay.eye + (time * myRay.direction);
-
-			real_t lat = acos(intersection.y);
-			real_t sinlat = sin(lat);
-			real_t lon = acos(intersection.z / sinlat);
-
-			lat = lat - floor(lat);
-			lon = lon - floor(lon);
-
-			int width;
-			int height;
-
-			material->get_texture_size(&width, &height);
-
-			width = width * lat;
-			height = height * lon;
-
-			texture = material->get_texture_pixel(width, height);
-
-			normal = intersection - c;
-			return time;
-		}
-	}
-
-	return -1;
-}
-
-Color3 Sphere::getAmbientColor(){
-	return this->material->ambient;
-}
-
-Color3 Sphere::getDiffuseColor(){
-	return this->material->diffuse;
-}
-
-Vector3 Sphere::getNormal(){
-	return normal;
-}
-
-Color3 Sphere::getSpecularColor(){
-	return this->material->specular;
+BoundingBox Sphere::get_bounds() const
+{
+    Vector3 extent( radius, radius, radius );
+    return BoundingBox( -extent, extent );
 }
 
-Vector3 Sphere::getIntersectionPt(){
-	return intersection;
+real_t Sphere::intersect( const ray_t& ray, Hit* hit ) const
+{
+    real_t time = intersect_sphere( ray.eye, ray.direction, Vector3::Zero,
+                                    radius * radius, SLOP_FACTOR );
+    hit->primitive = 0;
+    return time < std::numeric_limits< real_t >::infinity() ? time : -1;
 }
 
-Color3 Sphere::getTextureColor(){
-	return Color3::White;
+void Sphere::get_surface_point( const ray_t& ray, real_t time, const Hit& /*hit*/,
+                                SurfacePoint* point ) const
+{
+    point->position = ray.eye + time * ray.direction;
+    // the sphere is centered at the origin
+    point->normal = point->position;
+    point->ambient = material->ambient;
+    point->diffuse = material->diffuse;
+    point->specular = material->specular;
+
+    // texture coordinates match the ones used to render with opengl, only
+    // computed now that we know this is the hit being shaded
+    int width, height;
+    material->get_texture_size( &width, &height );
+    if ( width > 0 && height > 0 ) {
+        Vector3 p = point->position / radius;
+        real_t lon = atan2( p.x, p.z ) / ( 2 * PI );
+        real_t lat = acos( clamp( p.y, -1.0, 1.0 ) ) / PI;
+        real_t u = lon < 0 ? lon + 1 : lon;
+        real_t v = 1 - lat;
+        int x = std::min( int( u * width ), width - 1 );
+        int y = std::min( int( v * height ), height - 1 );
+        point->texture = material->get_texture_pixel( x, y );
+    } else {
+        point->texture = Color3::White;
+    }
 }
 
-
-
 } /* _462 */
 
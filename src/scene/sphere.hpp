@@ -10,6 +10,7 @@
 #define _462_SCENE_SPHERE_HPP_
 
 #include "scene/scene.hpp"
+#include "scene/sphere_batch.hpp"
 
 namespace _462 {
 
@@ -23,25 +24,13 @@ public:
     real_t radius;
     const Material* material;
 
-	Color3 color;
-	Color3 diffuse;
-	Color3 ambient;
-	Color3 texture;
-
-	Vector3 normal;
-	Vector3 intersection;
-
     Sphere();
     virtual ~Sphere();
     virtual void render() const;
-	virtual real_t intersect(ray_t myRay);
-	virtual Color3 getAmbientColor();
-	virtual Color3 getDiffuseColor();
-	virtual Vector3 getNormal();
-	virtual Color3 getSpecularColor();
-	virtual Vector3 getIntersectionPt();
-	virtual Color3 getTextureColor();
-
+    virtual BoundingBox get_bounds() const;
+    virtual real_t intersect( const ray_t& ray, Hit* hit ) const;
+    virtual void get_surface_point( const ray_t& ray, real_t time, const Hit& hit,
+                                    SurfacePoint* point ) const;
 };
 
 } /* _462 */
@@ -0,0 +1,83 @@
+/**
+ * @file sphere_batch.cpp
+ * @brief Ray-sphere intersection kernels.
+ */
+
+#include "scene/sphere_batch.hpp"
+
+#include <algorithm>
+
+namespace _462 {
+
+void SphereBatch::clear()
+{
+    center_x.clear();
+    center_y.clear();
+    center_z.clear();
+    radius_sq.clear();
+}
+
+void SphereBatch::add( const Vector3& center, real_t radius )
+{
+    center_x.push_back( center.x );
+    center_y.push_back( center.y );
+    center_z.push_back( center.z );
+    radius_sq.push_back( radius * radius );
+}
+
+void SphereBatch::set( size_t i, const Vector3& center, real_t radius )
+{
+    assert( i < size() );
+    center_x[i] = center.x;
+    center_y[i] = center.y;
+    center_z[i] = center.z;
+    radius_sq[i] = radius * radius;
+}
+
+int SphereBatch::intersect( const Vector3& eye, const Vector3& dir,
+                            size_t begin, size_t end,
+                            real_t tmin, real_t* tmax ) const
+{
+    // spheres are tested in fixed-size chunks with no branches in the inner
+    // loop, so the compiler can run several spheres per instruction
+    static const size_t CHUNK = 8;
+    const real_t inf = std::numeric_limits< real_t >::infinity();
+    const real_t a = dot( dir, dir );
+    const real_t inv_a = 1.0 / a;
+    real_t times[CHUNK];
+    int best = -1;
+
+    for ( size_t base = begin; base < end; base += CHUNK ) {
+        size_t n = std::min( CHUNK, end - base );
+        const real_t* cx = &center_x[base];
+        const real_t* cy = &center_y[base];
+        const real_t* cz = &center_z[base];
+        const real_t* r2 = &radius_sq[base];
+
+        for ( size_t i = 0; i < n; ++i ) {
+            real_t ox = cx[i] - eye.x;
+            real_t oy = cy[i] - eye.y;
+            real_t oz = cz[i] - eye.z;
+            real_t b = ox * dir.x + oy * dir.y + oz * dir.z;
+            real_t c = ox * ox + oy * oy + oz * oz - r2[i];
+            real_t disc = b * b - a * c;
+            real_t root = std::sqrt( disc > 0 ? disc : 0 );
+            real_t tnear = ( b - root ) * inv_a;
+            real_t tfar = ( b + root ) * inv_a;
+            real_t t = tnear > tmin ? tnear : tfar;
+            // rays from inside a sphere never hit it
+            times[i] = disc >= 0 && c > 0 && t > tmin ? t : inf;
+        }
+
+        for ( size_t i = 0; i < n; ++i ) {
+            if ( times[i] < *tmax ) {
+                *tmax = times[i];
+                best = int( base + i );
+            }
+        }
+    }
+
+    return best;
+}
+
+} /* _462 */
@@ -0,0 +1,86 @@
+/**
+ * @file sphere_batch.hpp
+ * @brief Ray-sphere intersection kernels.
+ */
+
+#ifndef _462_SCENE_SPHERE_BATCH_HPP_
+#define _462_SCENE_SPHERE_BATCH_HPP_
+
+#include "math/vector.hpp"
+
+#include <limits>
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Intersects a ray with a sphere, without computing anything needed only for
+ * shading. Rays starting inside the sphere do not hit it.
+ * @param eye The origin of the ray.
+ * @param dir The direction of the ray, need not be normalized.
+ * @param center The center of the sphere.
+ * @param radius_sq The square of the radius of the sphere.
+ * @param tmin Hits at or before this time are ignored.
+ * @return The time of the nearest hit after tmin, or infinity if none.
+ */
+inline real_t intersect_sphere( const Vector3& eye, const Vector3& dir,
+                                const Vector3& center, real_t radius_sq,
+                                real_t tmin )
+{
+    const real_t inf = std::numeric_limits< real_t >::infinity();
+    Vector3 oc = center - eye;
+    real_t c = dot( oc, oc ) - radius_sq;
+    if ( c <= 0 )
+        return inf;
+
+    real_t b = dot( dir, oc );
+    real_t a = dot( dir, dir );
+    real_t disc = b * b - a * c;
+    // reject misses before paying for the square root
+    if ( disc < 0 )
+        return inf;
+
+    real_t root = sqrt( disc );
+    real_t t = ( b - root ) / a;
+    if ( t > tmin )
+        return t;
+    t = ( b + root ) / a;
+    return t > tmin ? t : inf;
+}
+
+/**
+ * Many spheres in a shared coordinate frame, stored as separate arrays of
+ * center coordinates and squared radii so one ray can be tested against
+ * many of them at once.
+ */
+class SphereBatch
+{
+public:
+
+    void clear();
+    void add( const Vector3& center, real_t radius );
+    /// Replaces the sphere at index i.
+    void set( size_t i, const Vector3& center, real_t radius );
+    size_t size() const { return radius_sq.size(); }
+
+    /**
+     * Finds the nearest hit among spheres [begin, end) with time in
+     * (tmin, *tmax). Same semantics as intersect_sphere.
+     * @return The index of the sphere hit, with *tmax set to its time, or
+     *  -1 if none, with *tmax unchanged.
+     */
+    int intersect( const Vector3& eye, const Vector3& dir,
+                   size_t begin, size_t end,
+                   real_t tmin, real_t* tmax ) const;
+
+private:
+
+    typedef std::vector< real_t > RealList;
+
+    RealList center_x, center_y, center_z;
+    RealList radius_sq;
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_SPHERE_BATCH_HPP_ */
@@ -51,7 +51,16 @@ void Triangle::render() const
         vertices[0].material->reset_gl_state();
 }
 
-real_t Triangle::intersect(ray_t myRay){
+BoundingBox Triangle::get_bounds() const
+{
+    BoundingBox box;
+    for ( size_t i = 0; i < 3; ++i )
+        box.expand( vertices[i].position );
+    return box;
+}
+
+real_t Triangle::intersect( const ray_t& myRay, Hit* hit ) const
+{
 	//variable names taken from shirley text
 	//corresponding to equation 4.2
 
@@ -91,79 +100,57 @@ real_t Triangle::intersect(ray_t myRay){
 	if( (beta < 0) || (beta > 1 - gamma) )
 		return -1;
 
-	Vector2 coords = (beta * vertices[1].tex_coord) + (gamma * vertices[2].tex_coord) + ((1-beta-gamma) * vertices[0].tex_coord);
-
-	double scratch;
-
-	coords.x = modf(coords.x, &scratch);
-	coords.y = modf(coords.y, &scratch);
+	hit->primitive = 0;
+	hit->beta = beta;
+	hit->gamma = gamma;
+	return t;
+}
 
+// looks up the texture color of a material at the given coordinates in [0,1)
+static Color3 texture_lookup( const Material* material, const Vector2& coords )
+{
 	int width;
 	int height;
-	int x;
-	int y;
-
-	vertices[1].material->get_texture_size(&width, &height);
 
-	x = coords.x * width;
-	y = coords.y * height;
+	material->get_texture_size(&width, &height);
 
-	Color3 betaPixel = vertices[1].material->get_texture_pixel(x,y);
+	int x = coords.x * width;
+	int y = coords.y * height;
 
-	vertices[2].material->get_texture_size(&width, &height);
+	return material->get_texture_pixel(x, y);
+}
 
-	x = coords.x * width;
-	y = coords.y * height;
+void Triangle::get_surface_point( const ray_t& myRay, real_t time, const Hit& hit,
+                                  SurfacePoint* point ) const
+{
+	real_t beta = hit.beta;
+	real_t gamma = hit.gamma;
+	real_t alpha = 1 - beta - gamma;
 
-	Color3 gammaPixel = vertices[2].material->get_texture_pixel(x, y);
+	Vector2 coords = (beta * vertices[1].tex_coord) + (gamma * vertices[2].tex_coord) + (alpha * vertices[0].tex_coord);
 
-	vertices[0].material->get_texture_size(&width, &height);
+	double scratch;
 
-	x = coords.x * width;
-	y = coords.y * height;
+	coords.x = modf(coords.x, &scratch);
+	coords.y = modf(coords.y, &scratch);
 
-	Color3 betaGammaPixel = vertices[0].material->get_texture_pixel(x, y);
+	Color3 betaPixel = texture_lookup(vertices[1].material, coords);
+	Color3 gammaPixel = texture_lookup(vertices[2].material, coords);
+	Color3 alphaPixel = texture_lookup(vertices[0].material, coords);
 
-	texture = beta * betaPixel + gamma * gammaPixel + (1-beta-gamma) * betaGammaPixel;
+	point->texture = beta * betaPixel + gamma * gammaPixel + alpha * alphaPixel;
 
-	diffuse = (beta * vertices[1].material->diffuse) + (gamma * vertices[2].material->diffuse) + ((1-beta-gamma) * vertices[0].material->diffuse);
+	point->diffuse = (beta * vertices[1].material->diffuse) + (gamma * vertices[2].material->diffuse) + (alpha * vertices[0].material->diffuse);
 
-	ambient = (beta * vertices[1].material->ambient) + (gamma * vertices[2].material->ambient) + ((1-beta-gamma) * vertices[0].material->ambient);
+	point->ambient = (beta * vertices[1].material->ambient) + (gamma * vertices[2].material->ambient) + (alpha * vertices[0].material->ambient);
 	
-	specular = (beta * vertices[1].material->specular) + (gamma * vertices[2].material->specular) + ((1-beta-gamma) * vertices[0].material->specular);
+	point->specular = (beta * vertices[1].material->specular) + (gamma * vertices[2].material->specular) + (alpha * vertices[0].material->specular);
 	
-	normal = (beta * vertices[1].normal) + (gamma * vertices[2].normal) + ((1-beta-gamma) * vertices[0].normal);
-	normal = normalize(normal);
-
-	intersection = myRay.eye + (t * myRay.direction);
-
-	return t;
-}
-
-Color3 Triangle::getAmbientColor(){
-	return ambient;
-}
-
-Color3 Triangle::getDiffuseColor(){
-	return diffuse;
-}
-
-Vector3 Triangle::getNormal(){
-	return normal;
-}
-
-Color3 Triangle::getSpecularColor(){
-	return specular;
-}
-
-Vector3 Triangle::getIntersectionPt(){
-	return intersection;
-}
+	point->normal = (beta * vertices[1].normal) + (gamma * vertices[2].normal) + (alpha * vertices[0].normal);
+	point->normal = normalize(point->normal);
 
-Color3 Triangle::getTextureColor(){
-	return texture;
+	point->position = myRay.eye + (time * myRay.direction);
 }
 
-
 } /* _462 */
 
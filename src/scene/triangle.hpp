@@ -36,27 +36,13 @@ public:
     // the triangle's vertices, in CCW order
     Vertex vertices[3];
 
-	Color3 color;
-	Color3 diffuse;
-	Color3 ambient;
-	Color3 specular;
-	Color3 texture;
-
-	Vector3 intersection;
-
-	Vector3 normal;
-
     Triangle();
     virtual ~Triangle();
     virtual void render() const;
-	virtual real_t intersect(ray_t myRay);
-	virtual Color3 getAmbientColor();
-	virtual Color3 getDiffuseColor();
-	virtual Vector3 getNormal();
-	virtual Color3 getSpecularColor();
-	virtual Vector3 getIntersectionPt();
-	virtual Color3 getTextureColor();
-
+    virtual BoundingBox get_bounds() const;
+    virtual real_t intersect( const ray_t& ray, Hit* hit ) const;
+    virtual void get_surface_point( const ray_t& ray, real_t time, const Hit& hit,
+                                    SurfacePoint* point ) const;
 };
 
 
@@ -0,0 +1,64 @@
+/**
+ * @file triangle_batch.cpp
+ * @brief Ray-triangle intersection over many triangles.
+ */
+
+#include "scene/triangle_batch.hpp"
+
+namespace _462 {
+
+void TriangleBatch::clear()
+{
+    triangles.clear();
+}
+
+void TriangleBatch::add( const Vector3& v0, const Vector3& v1, const Vector3& v2 )
+{
+    triangles.push_back( Tri( v0, v1, v2 ) );
+}
+
+void TriangleBatch::set( size_t i, const Vector3& v0, const Vector3& v1, const Vector3& v2 )
+{
+    assert( i < triangles.size() );
+    triangles[i] = Tri( v0, v1, v2 );
+}
+
+int TriangleBatch::intersect( const Vector3& eye, const Vector3& dir,
+                              size_t begin, size_t end, real_t tmin, real_t* tmax,
+                              real_t* beta, real_t* gamma ) const
+{
+    int best = -1;
+
+    // moller-trumbore, which gives the same barycentric coordinates as
+    // solving the full 3x3 system in Triangle::intersect
+    for ( size_t i = begin; i < end; ++i ) {
+        const Tri& tri = triangles[i];
+        Vector3 p = cross( dir, tri.edge2 );
+        real_t det = dot( tri.edge1, p );
+        if ( det == 0 )
+            continue;
+        real_t inv_det = 1.0 / det;
+
+        Vector3 s = eye - tri.v0;
+        real_t b = dot( s, p ) * inv_det;
+        if ( b < 0 || b > 1 )
+            continue;
+
+        Vector3 q = cross( s, tri.edge1 );
+        real_t g = dot( dir, q ) * inv_det;
+        if ( g < 0 || b + g > 1 )
+            continue;
+
+        real_t t = dot( tri.edge2, q ) * inv_det;
+        if ( t > tmin && t < *tmax ) {
+            *tmax = t;
+            *beta = b;
+            *gamma = g;
+            best = int( i );
+        }
+    }
+
+    return best;
+}
+
+} /* _462 */
@@ -0,0 +1,60 @@
+/**
+ * @file triangle_batch.hpp
+ * @brief Ray-triangle intersection over many triangles.
+ */
+
+#ifndef _462_SCENE_TRIANGLE_BATCH_HPP_
+#define _462_SCENE_TRIANGLE_BATCH_HPP_
+
+#include "math/vector.hpp"
+
+#include <vector>
+
+namespace _462 {
+
+/**
+ * Many triangles in a shared coordinate frame, each stored as one vertex and
+ * the two edges leaving it, which is all the intersection test needs.
+ */
+class TriangleBatch
+{
+public:
+
+    void clear();
+    void add( const Vector3& v0, const Vector3& v1, const Vector3& v2 );
+    /// Replaces the triangle at index i.
+    void set( size_t i, const Vector3& v0, const Vector3& v1, const Vector3& v2 );
+    size_t size() const { return triangles.size(); }
+
+    /**
+     * Finds the nearest hit among triangles [begin, end) with time in
+     * (tmin, *tmax). Triangles are two-sided.
+     * @param beta Set to the barycentric weight of the second vertex.
+     * @param gamma Set to the barycentric weight of the third vertex.
+     * @return The index of the triangle hit, with *tmax set to its time, or
+     *  -1 if none, with *tmax, beta, and gamma unchanged.
+     */
+    int intersect( const Vector3& eye, const Vector3& dir,
+                   size_t begin, size_t end, real_t tmin, real_t* tmax,
+                   real_t* beta, real_t* gamma ) const;
+
+private:
+
+    struct Tri
+    {
+        Tri( const Vector3& v0, const Vector3& v1, const Vector3& v2 )
+            : v0( v0 ), edge1( v1 - v0 ), edge2( v2 - v0 ) { }
+
+        Vector3 v0;
+        Vector3 edge1;
+        Vector3 edge2;
+    };
+
+    typedef std::vector< Tri > TriList;
+
+    TriList triangles;
+};
+
+} /* _462 */
+
+#endif /* _462_SCENE_TRIANGLE_BATCH_HPP_ */